@@ -97,6 +97,7 @@ mapGeomPredicate(GeomPredicateDesc const p)
 struct HvaultQualAnalyzerData {
     HvaultTableInfo const * table;
     Oid geomopers[HvaultGeomNumRealOpers];
+    Oid distop; /* <-> or InvalidOid if not supported by PostGIS */
 };
 
 struct HvaultQualSimpleData {
@@ -251,17 +252,26 @@ isCatalogJoinEC (EquivalenceClass *ec, HvaultTableInfo const *table)
 }
 
 static Oid
-getGeometryOpOid (char const *opname, SPIPlanPtr prep_stmt)
+getGeometryOpOid (char const *opname, SPIPlanPtr prep_stmt, bool missing_ok)
 {
     Datum param[1];
     Datum val;
     bool isnull;
 
     param[0] = CStringGetTextDatum(opname);
-    if (SPI_execute_plan(prep_stmt, param, " ", true, 1) != SPI_OK_SELECT ||
-        SPI_processed != 1 || 
+    if (SPI_execute_plan(prep_stmt, param, " ", true, 1) != SPI_OK_SELECT)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Can't find geometry operator %s", opname)));
+        return InvalidOid; /* Will never reach this */
+    }
+
+    if (SPI_processed == 0 && missing_ok)
+        return InvalidOid;
+
+    if (SPI_processed != 1 || 
         SPI_tuptable->tupdesc->natts != 1 ||
-        SPI_tuptable->tupdesc->attrs[0]->atttypid != OIDOID)
+        TupleDescAttr(SPI_tuptable->tupdesc, 0)->atttypid != OIDOID)
     {
         ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
                         errmsg("Can't find geometry operator %s", opname)));
@@ -311,8 +321,10 @@ getGeometryOpers (HvaultQualAnalyzer analyzer)
     for (i = 0; i < HvaultGeomNumRealOpers; i++)
     {
         analyzer->geomopers[i] = getGeometryOpOid(hvaultGeomopstr[i], 
-                                                  prep_stmt);
+                                                  prep_stmt, false);
     }
+    /* Distance operator is not available in PostGIS prior to 2.0 */
+    analyzer->distop = getGeometryOpOid("<->", prep_stmt, true);
     
     if (SPI_finish() != SPI_OK_FINISH)    
     {
@@ -559,6 +571,58 @@ hvaultCreatePredicate (HvaultQual * qual, List ** fdw_expr)
                           geom_qual->pred.isneg);
 }
 
+/* Checks whether pathkeys represent ORDER BY point <-> expr ordering
+   and returns expr. Returns NULL if ordering is not supported */
+Expr *
+hvaultAnalyzeOrdering (HvaultQualAnalyzer analyzer, List * pathkeys)
+{
+    PathKey *pathkey;
+    ListCell *l;
+
+    if (!OidIsValid(analyzer->distop) || list_length(pathkeys) != 1)
+        return NULL;
+
+    pathkey = (PathKey *) linitial(pathkeys);
+    if (pathkey->pk_strategy != BTLessStrategyNumber || 
+        pathkey->pk_nulls_first)
+        return NULL;
+
+    foreach(l, pathkey->pk_eclass->ec_members)
+    {
+        EquivalenceMember *em = (EquivalenceMember *) lfirst(l);
+        OpExpr *opexpr;
+        Expr *first, *second, *arg;
+        HvaultColumnType coltype;
+
+        if (!IsA(em->em_expr, OpExpr))
+            continue;
+
+        opexpr = (OpExpr *) em->em_expr;
+        if (opexpr->opno != analyzer->distop || 
+            list_length(opexpr->args) != 2)
+            continue;
+
+        /* Distance is symmetric, so we don't need commutator here */
+        first = linitial(opexpr->args);
+        second = lsecond(opexpr->args);
+        if (isFootprintOpArgs(first, analyzer->table, &coltype))
+            arg = second;
+        else if (isFootprintOpArgs(second, analyzer->table, &coltype))
+            arg = first;
+        else
+            continue;
+
+        if (coltype != HvaultColumnPoint)
+            continue;
+
+        if (!isCatalogQual(arg, analyzer->table))
+            continue;
+
+        return arg;
+    }
+    return NULL;
+}
+
 /* Unpacks List representation of predicate into separate fields */
 void 
 hvaultUnpackPredicate (List * pred, 
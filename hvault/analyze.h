@@ -45,6 +45,10 @@ List * hvaultAnalyzeECs (HvaultQualAnalyzer analyzer, List * ecs);
    Returns NULL if predicate is not available for this qual */
 List * hvaultCreatePredicate (HvaultQual * qual, List ** fdw_expr);
 
+/* Checks whether pathkeys represent ORDER BY point <-> expr ordering
+   and returns expr. Returns NULL if ordering is not supported */
+Expr * hvaultAnalyzeOrdering (HvaultQualAnalyzer analyzer, List * pathkeys);
+
 /* Unpacks List representation of predicate into separate fields */
 void hvaultUnpackPredicate (List * predicate, 
                             HvaultColumnType * coltype, 
@@ -17,6 +17,9 @@ struct HvaultCatalogQueryData
 
 #define NO_LIMIT ((size_t)(-1))
 
+/* Number of records sorted together when cursor is reordered */
+#define CATALOG_SORT_BATCH 1000
+
 /*
  * Query construction routines
  */
@@ -223,14 +226,35 @@ hvaultCatalogGetCosts (HvaultCatalogQuery query,
 
     parsetree = pg_parse_query(query_str.data);
     Assert(list_length(parsetree) == 1);
+#if PG_VERSION_NUM >= 150000
+    stmt_list = pg_analyze_and_rewrite_fixedparams(linitial(parsetree), 
+                                                   query_str.data, 
+                                                   argtypes, 
+                                                   nargs,
+                                                   NULL);
+#elif PG_VERSION_NUM >= 100000
+    stmt_list = pg_analyze_and_rewrite(linitial(parsetree), 
+                                       query_str.data, 
+                                       argtypes, 
+                                       nargs,
+                                       NULL);
+#else
     stmt_list = pg_analyze_and_rewrite(linitial(parsetree), 
                                        query_str.data, 
                                        argtypes, 
                                        nargs);
+#endif
     Assert(list_length(stmt_list) == 1);
+#if PG_VERSION_NUM >= 130000
+    plan = pg_plan_query((Query *) linitial(stmt_list), 
+                         query_str.data,
+                         CURSOR_OPT_GENERIC_PLAN, 
+                         NULL);
+#else
     plan = pg_plan_query((Query *) linitial(stmt_list), 
                          CURSOR_OPT_GENERIC_PLAN, 
                          NULL);
+#endif
 
     *startup_cost = plan->planTree->startup_cost;
     *total_cost = plan->planTree->total_cost;
@@ -256,6 +280,21 @@ hvaultCatalogPackQuery(HvaultCatalogQuery query)
  * Catalog cursor routines
  */
 
+/* Rows sorted together share one memory context */
+typedef struct
+{
+    MemoryContext       memctx;
+    int                 nrows;         /* Rows that are not freed yet */
+} CatalogBatch;
+
+typedef struct
+{
+    MemoryContext       memctx;        /* Own context or context of batch */
+    CatalogBatch *      batch;         /* NULL if row has own context */
+    HvaultCatalogItem * item;
+    void *              sort_key;
+} CatalogRow;
+
 struct HvaultCatalogCursorData 
 {
     char const *        query;         /* Catalog query string */
@@ -264,8 +303,23 @@ struct HvaultCatalogCursorData
     char const *        name;
 
     MemoryContext       memctx;
-    HeapTuple           cur_tuple;
-    HvaultCatalogItem * item;
+    CatalogRow *        cur;
+    CatalogRow *        prev;          /* Kept valid until the next record */
+    List *              ahead;         /* Rows fetched in advance */
+    int                 lookahead;
+    bool                eof;
+
+    /* Selection of granules processed by this instance */
+    char const *        key;           /* NULL if all records are processed */
+    int                 shard_index;
+    int                 shard_count;
+    char const *        queue;         /* Work queue table or NULL */
+    SPIPlanPtr          queue_stmt;
+
+    /* Reordering of records on the client side */
+    HvaultCatalogSortKeyFunc sort_key;  /* NULL if records are not reordered */
+    HvaultCatalogSortCmpFunc sort_cmp;
+    void *              sort_arg;
 };
 
 /* Creates new catalog cursor and initializes it with packed query */
@@ -286,11 +340,43 @@ hvaultCatalogInitCursor (List * packed_query, MemoryContext memctx)
     return cursor;
 }
 
+static void
+freeRow (CatalogRow * row)
+{
+    if (row == NULL)
+        return;
+    HASH_CLEAR(hh, row->item);
+    if (row->batch != NULL)
+    {
+        /* Row itself is allocated in the batch context */
+        if (--row->batch->nrows == 0)
+            MemoryContextDelete(row->memctx);
+        return;
+    }
+    MemoryContextDelete(row->memctx);
+    pfree(row);
+}
+
+static void
+freeRows (HvaultCatalogCursor cursor)
+{
+    ListCell * l;
+
+    freeRow(cursor->cur);
+    freeRow(cursor->prev);
+    cursor->cur = cursor->prev = NULL;
+    foreach(l, cursor->ahead)
+        freeRow(lfirst(l));
+    list_free(cursor->ahead);
+    cursor->ahead = NIL;
+    cursor->eof = false;
+}
+
 /* Destroys cursor and all it's data */
 void 
 hvaultCatalogFreeCursor (HvaultCatalogCursor cursor)
 {
-    HASH_CLEAR(hh, cursor->item);
+    freeRows(cursor);
 
     if (cursor->memctx != NULL) 
     {
@@ -318,6 +404,12 @@ hvaultCatalogFreeCursor (HvaultCatalogCursor cursor)
         cursor->prep_stmt = NULL;
     }
 
+    if (cursor->queue_stmt != NULL)
+    {
+        SPI_freeplan(cursor->queue_stmt);
+        cursor->queue_stmt = NULL;
+    }
+
     if (SPI_finish() != SPI_OK_FINISH)
     {
         ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
@@ -334,51 +426,163 @@ hvaultCatalogGetNumArgs (HvaultCatalogCursor cursor)
     return cursor->nargs;
 }
 
-static HvaultCatalogCursorResult 
-fetchTuple (HvaultCatalogCursor cursor, Portal file_cursor)
+/* 
+ * Copies fetched tuple with its values for future access. Row gets its own
+ * memory context unless it belongs to a batch.
+ */
+static CatalogRow *
+makeRow (HvaultCatalogCursor cursor, 
+         HeapTuple           src, 
+         TupleDesc           tupdesc,
+         CatalogBatch *      batch)
 {
     MemoryContext oldmemctx = NULL;
+    CatalogRow * row;
+    HeapTuple tuple;
+    int i;
+
+    if (batch != NULL)
+    {
+        row = MemoryContextAlloc(batch->memctx, sizeof(CatalogRow));
+        row->memctx = batch->memctx;
+        batch->nrows++;
+    }
+    else
+    {
+        row = MemoryContextAlloc(cursor->memctx, sizeof(CatalogRow));
+        row->memctx = AllocSetContextCreate(cursor->memctx,
+                                            "hvault_fdw catalog row",
+                                            ALLOCSET_SMALL_MINSIZE,
+                                            ALLOCSET_SMALL_INITSIZE,
+                                            ALLOCSET_SMALL_MAXSIZE);
+    }
+    row->batch = batch;
+    row->item = NULL;
+    row->sort_key = NULL;
+
+    oldmemctx = MemoryContextSwitchTo(row->memctx);
+    tuple = heap_copytuple(src);
+    for (i = 0; i < tupdesc->natts; i++)
+    {
+        HvaultCatalogItem * column = NULL;
+        bool isnull;
+
+        column = palloc(sizeof(HvaultCatalogItem));
+        column->name = SPI_fname(tupdesc, i+1);
+        column->typid = TupleDescAttr(tupdesc, i)->atttypid;
+        column->val = heap_getattr(tuple, i+1, tupdesc, &isnull);
+        column->str = isnull ? NULL : SPI_getvalue(tuple, tupdesc, i+1);
+        HASH_ADD_KEYPTR(hh, row->item, column->name, 
+                        strlen(column->name), column);
+    }
+    MemoryContextSwitchTo(oldmemctx);
+
+    return row;
+}
+
+/* Appends up to num rows to lookahead list */
+static void
+fetchRows (HvaultCatalogCursor cursor, 
+           Portal              file_cursor, 
+           int                 num,
+           CatalogBatch *      batch)
+{
+    MemoryContext oldmemctx;
     int i;
 
     Assert(file_cursor);
-    SPI_cursor_fetch(file_cursor, true, 1);
-    if (SPI_processed != 1 || SPI_tuptable == NULL)
+    SPI_cursor_fetch(file_cursor, true, num);
+    if (SPI_tuptable == NULL || SPI_processed < num)
     {
         /* Can't fetch more files */
-        return HvaultCatalogCursorEOF;
-    }   
+        cursor->eof = true;
+    }
+    if (SPI_tuptable == NULL)
+        return;
 
     oldmemctx = MemoryContextSwitchTo(cursor->memctx);
-    /* Defensively copy whole tuple for future access*/
-    if (cursor->cur_tuple != NULL) 
-        pfree(cursor->cur_tuple);
-    cursor->cur_tuple = heap_copytuple(SPI_tuptable->vals[0]);
+    for (i = 0; i < SPI_processed; i++)
+    {
+        cursor->ahead = lappend(cursor->ahead, makeRow(
+            cursor, SPI_tuptable->vals[i], SPI_tuptable->tupdesc, batch));
+    }
+    MemoryContextSwitchTo(oldmemctx);
+}
 
-    for (i = 0; i < SPI_tuptable->tupdesc->natts; i++)
+static int
+compareRows (void const * a, void const * b, void * arg)
+{
+    CatalogRow const * ra = *(CatalogRow * const *) a;
+    CatalogRow const * rb = *(CatalogRow * const *) b;
+    HvaultCatalogCursor cursor = arg;
+
+    return cursor->sort_cmp(ra->sort_key, rb->sort_key);
+}
+
+/* 
+ * Fetches next batch of records and appends them to lookahead list sorted 
+ * by their keys. Computing of keys may be expensive, so memory and startup 
+ * time are bounded by the batch size instead of catalog size.
+ */
+static void
+sortBatch (HvaultCatalogCursor cursor, Portal file_cursor)
+{
+    MemoryContext oldmemctx, memctx;
+    CatalogBatch * batch;
+    CatalogRow ** rows;
+    ListCell * l;
+    int i, first, nrows;
+
+    memctx = AllocSetContextCreate(cursor->memctx,
+                                   "hvault_fdw catalog batch",
+                                   ALLOCSET_DEFAULT_MINSIZE,
+                                   ALLOCSET_DEFAULT_INITSIZE,
+                                   ALLOCSET_DEFAULT_MAXSIZE);
+    batch = MemoryContextAlloc(memctx, sizeof(CatalogBatch));
+    batch->memctx = memctx;
+    batch->nrows = 0;
+
+    first = list_length(cursor->ahead);
+    fetchRows(cursor, file_cursor, CATALOG_SORT_BATCH, batch);
+    nrows = batch->nrows;
+    if (nrows == 0)
     {
-        char * name = NULL;
-        HvaultCatalogItem * column = NULL;
-        bool isnull;
+        MemoryContextDelete(memctx);
+        return;
+    }
 
-        name = SPI_fname(SPI_tuptable->tupdesc, i+1);
-        HASH_FIND_STR(cursor->item, name, column);
-        if (!column) 
-        {
-            column = palloc(sizeof(HvaultCatalogItem));
-            column->name = name;
-            column->typid = SPI_tuptable->tupdesc->attrs[i]->atttypid;
-            HASH_ADD_KEYPTR(hh, cursor->item, column->name, 
-                            strlen(column->name), column);
-        }
+    rows = palloc(sizeof(CatalogRow *) * nrows);
+    i = 0;
+    oldmemctx = MemoryContextSwitchTo(memctx);
+    foreach(l, cursor->ahead)
+    {
+        CatalogRow * row = lfirst(l);
 
-        column->val = heap_getattr(cursor->cur_tuple, i+1, 
-                                   SPI_tuptable->tupdesc, &isnull);
-        column->str = isnull ? NULL : SPI_getvalue(cursor->cur_tuple, 
-                                                   SPI_tuptable->tupdesc, i+1);
+        if (row->batch != batch)
+            continue;
+        row->sort_key = cursor->sort_key(row->item, cursor->sort_arg);
+        rows[i++] = row;
     }
     MemoryContextSwitchTo(oldmemctx);
+    qsort_arg(rows, nrows, sizeof(CatalogRow *), compareRows, cursor);
 
-    return HvaultCatalogCursorOK;
+    i = 0;
+    foreach(l, cursor->ahead)
+    {
+        if (first-- <= 0)
+            lfirst(l) = rows[i++];
+    }
+    pfree(rows);
+}
+
+/* Appends up to num rows to lookahead list, whole batch if reordered */
+static void
+fetchAhead (HvaultCatalogCursor cursor, Portal file_cursor, int num)
+{
+    if (cursor->sort_key != NULL)
+        sortBatch(cursor, file_cursor);
+    else
+        fetchRows(cursor, file_cursor, num, NULL);
 }
 
 /* Starts cursor with specified parameters */
@@ -445,6 +649,7 @@ hvaultCatlogResetCursor (HvaultCatalogCursor cursor)
         SPI_cursor_close(file_cursor);
         cursor->name = NULL;
     }
+    freeRows(cursor);
 
     if (SPI_finish() != SPI_OK_FINISH)
     {
@@ -454,6 +659,183 @@ hvaultCatlogResetCursor (HvaultCatalogCursor cursor)
     }
 }
 
+/* Makes cursor read records in batches and return each batch ordered by 
+   keys computed from record values */
+void
+hvaultCatalogSetReorder (HvaultCatalogCursor      cursor,
+                         HvaultCatalogSortKeyFunc key,
+                         HvaultCatalogSortCmpFunc cmp,
+                         void *                   arg)
+{
+    cursor->sort_key = key;
+    cursor->sort_cmp = cmp;
+    cursor->sort_arg = arg;
+}
+
+/* Sets number of records fetched in advance of the current one */
+void
+hvaultCatalogSetLookahead (HvaultCatalogCursor cursor, int num)
+{
+    cursor->lookahead = Max(num, 0);
+}
+
+/* Restricts cursor to records with key % count = index */
+void
+hvaultCatalogSetShard (HvaultCatalogCursor cursor, 
+                       char const *        key,
+                       int                 index,
+                       int                 count)
+{
+    if (index < 0 || index >= count)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Shard index %d is out of range [0, %d)", 
+                               index, count)));
+        return; /* Will never reach this */
+    }
+    cursor->key = key;
+    cursor->shard_index = index;
+    cursor->shard_count = count;
+}
+
+/* 
+ * Restricts cursor to records whose keys are taken from work queue table.
+ * Several instances that scan the same catalog delete keys from the queue
+ * skipping rows locked by others, so every granule is processed once. If 
+ * scan transaction aborts, its keys return to the queue.
+ */
+void
+hvaultCatalogSetWorkQueue (HvaultCatalogCursor cursor,
+                           char const *        key,
+                           char const *        queue)
+{
+#if PG_VERSION_NUM < 90500
+    ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                    errmsg("Work queue requires SKIP LOCKED support"),
+                    errhint("Upgrade to PostgreSQL 9.5 or later")));
+    return; /* Will never reach this */
+#endif
+    cursor->key = key;
+    cursor->queue = queue;
+}
+
+/* Deletes key from work queue. Returns false if it is taken by others */
+static bool
+claimFromQueue (HvaultCatalogCursor cursor, HvaultCatalogItem const * key)
+{
+    int res;
+    bool claimed;
+
+    if (SPI_connect() != SPI_OK_CONNECT)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Can't connect to SPI")));
+        return false; /* Will never reach this */
+    }
+
+    if (cursor->queue_stmt == NULL)
+    {
+        StringInfoData query_str;
+        char const * queue = quote_identifier(cursor->queue);
+        char const * column = quote_identifier(cursor->key);
+        Oid argtype = key->typid;
+
+        initStringInfo(&query_str);
+        appendStringInfo(&query_str, 
+                         "DELETE FROM %s WHERE %s IN (SELECT %s FROM %s "
+                         "WHERE %s = $1 FOR UPDATE SKIP LOCKED)",
+                         queue, column, column, queue, column);
+        cursor->queue_stmt = SPI_prepare(query_str.data, 1, &argtype);
+        if (!cursor->queue_stmt)
+        {
+            ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                            errmsg("Can't prepare work queue query: %s", 
+                                   query_str.data)));
+            return false; /* Will never reach this */
+        }
+        if (SPI_keepplan(cursor->queue_stmt) != 0)
+        {
+            ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                            errmsg("Can't save prepared plan")));
+            return false; /* Will never reach this */
+        }
+    }
+
+    res = SPI_execute_plan(cursor->queue_stmt, (Datum *) &key->val, NULL, 
+                           false, 0);
+    if (res != SPI_OK_DELETE)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Can't claim granule from work queue %s: %d", 
+                               cursor->queue, res)));
+        return false; /* Will never reach this */
+    }
+    claimed = SPI_processed > 0;
+
+    if (SPI_finish() != SPI_OK_FINISH)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Can't finish access to SPI")));
+        return false; /* Will never reach this */
+    }
+    return claimed;
+}
+
+/* Checks whether current record belongs to this scan */
+bool
+hvaultCatalogClaimRecord (HvaultCatalogCursor cursor)
+{
+    HvaultCatalogItem * key = NULL;
+
+    if (cursor->key == NULL)
+        return true;
+
+    Assert(cursor->cur);
+    HASH_FIND_STR(cursor->cur->item, cursor->key, key);
+    if (key == NULL)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Catalog key %s is not fetched by catalog "
+                               "query", cursor->key),
+                        errhint("Set hvault.shard_count before query is "
+                                "planned")));
+        return false; /* Will never reach this */
+    }
+    if (key->str == NULL)
+        return false;
+
+    if (cursor->shard_count > 1)
+    {
+        int64 val;
+
+        switch (key->typid)
+        {
+            case INT2OID:
+                val = DatumGetInt16(key->val);
+                break;
+            case INT4OID:
+                val = DatumGetInt32(key->val);
+                break;
+            case INT8OID:
+                val = DatumGetInt64(key->val);
+                break;
+            default:
+                ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                                errmsg("Catalog key %s must be integer for "
+                                       "sharding", cursor->key)));
+                return false; /* Will never reach this */
+        }
+        if ((val % cursor->shard_count + cursor->shard_count) % 
+                cursor->shard_count != cursor->shard_index)
+            return false;
+    }
+
+    if (cursor->queue != NULL)
+        return claimFromQueue(cursor, key);
+
+    return true;
+}
+
 /* Moves cursor to the next catalog record */
 HvaultCatalogCursorResult 
 hvaultCatalogNext (HvaultCatalogCursor cursor)
@@ -474,7 +856,26 @@ hvaultCatalogNext (HvaultCatalogCursor cursor)
     }    
 
     file_cursor = SPI_cursor_find(cursor->name);
-    res = fetchTuple(cursor, file_cursor);
+    if (cursor->ahead == NIL && !cursor->eof)
+        fetchAhead(cursor, file_cursor, 1);
+
+    freeRow(cursor->prev);
+    cursor->prev = cursor->cur;
+    cursor->cur = NULL;
+    if (cursor->ahead != NIL)
+    {
+        cursor->cur = linitial(cursor->ahead);
+        cursor->ahead = list_delete_first(cursor->ahead);
+        res = HvaultCatalogCursorOK;
+    }
+    else
+    {
+        res = HvaultCatalogCursorEOF;
+    }
+
+    if (!cursor->eof && list_length(cursor->ahead) < cursor->lookahead)
+        fetchAhead(cursor, file_cursor, 
+                   cursor->lookahead - list_length(cursor->ahead));
  
     if (SPI_finish() != SPI_OK_FINISH)
     {
@@ -490,7 +891,24 @@ hvaultCatalogNext (HvaultCatalogCursor cursor)
 HvaultCatalogItem const * 
 hvaultCatalogGetValues (HvaultCatalogCursor cursor)
 {
-    return cursor->item;
+    return cursor->cur != NULL ? cursor->cur->item : NULL;
+}
+
+/* Get values of records fetched in advance */
+List *
+hvaultCatalogGetLookahead (HvaultCatalogCursor cursor)
+{
+    List * res = NIL;
+    ListCell * l;
+
+    /* Sorted cursor may keep more records ahead */
+    foreach(l, cursor->ahead)
+    {
+        if (list_length(res) >= cursor->lookahead)
+            break;
+        res = lappend(res, ((CatalogRow *) lfirst(l))->item);
+    }
+    return res;
 }
 
 double 
@@ -528,7 +946,7 @@ hvaultGetNumFiles(char const *catalog)
     pfree(query_str->data);
     pfree(query_str);
     if (SPI_tuptable->tupdesc->natts != 1 ||
-        SPI_tuptable->tupdesc->attrs[0]->atttypid != INT8OID)
+        TupleDescAttr(SPI_tuptable->tupdesc, 0)->atttypid != INT8OID)
     {
         ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
                         errmsg("Can't get number of rows in catalog %s", 
@@ -22,6 +22,13 @@ typedef struct {
     UT_hash_handle hh;
 } HvaultCatalogItem;
 
+/* Computes sort key of catalog record in current memory context */
+typedef void * (* HvaultCatalogSortKeyFunc) (HvaultCatalogItem const * item,
+                                              void *                    arg);
+
+/* Compares sort keys of two records */
+typedef int (* HvaultCatalogSortCmpFunc) (void const * a, void const * b);
+
 
 /*
  * Query construction routines
@@ -91,6 +98,27 @@ void hvaultCatalogStartCursor (HvaultCatalogCursor cursor,
    HvaultCatalogCursorNotStarted */
 void hvaultCatlogResetCursor (HvaultCatalogCursor cursor);
 
+/* Sets number of records fetched in advance of the current one */
+void hvaultCatalogSetLookahead (HvaultCatalogCursor cursor, int num);
+
+/* Restricts cursor to records with key % count = index */
+void hvaultCatalogSetShard (HvaultCatalogCursor cursor, 
+                            char const *        key,
+                            int                 index,
+                            int                 count);
+
+/* Restricts cursor to records whose keys are taken from work queue table */
+void hvaultCatalogSetWorkQueue (HvaultCatalogCursor cursor,
+                                char const *        key,
+                                char const *        queue);
+
+/* Makes cursor read records in batches and return each batch ordered by 
+   keys computed from record values */
+void hvaultCatalogSetReorder (HvaultCatalogCursor      cursor,
+                              HvaultCatalogSortKeyFunc key,
+                              HvaultCatalogSortCmpFunc cmp,
+                              void *                   arg);
+
 /* Returns number of parameters in catalog query */
 int hvaultCatalogGetNumArgs (HvaultCatalogCursor cursor);
 
@@ -103,6 +131,13 @@ HvaultCatalogCursorResult hvaultCatalogNext (HvaultCatalogCursor cursor);
 /* Get current record's values */
 HvaultCatalogItem const * hvaultCatalogGetValues (HvaultCatalogCursor cursor);
 
+/* Checks whether current record belongs to this scan according to shard and
+   work queue settings. Record is removed from work queue if it is claimed */
+bool hvaultCatalogClaimRecord (HvaultCatalogCursor cursor);
+
+/* Get list of values of records fetched in advance */
+List * hvaultCatalogGetLookahead (HvaultCatalogCursor cursor);
+
 
 /*
  * Other functions
@@ -4,6 +4,7 @@ import glob
 import os
 import re
 import psycopg2
+import numpy
 from osgeo import gdal
 
 def proc_metadata(mod03):
@@ -43,6 +44,53 @@ def proc_metadata(mod03):
             'footprint': fp,
             'tile':      tile}
 
+def read_subdataset(gd, name):
+    for sds, desc in gd.GetSubDatasets():
+        if sds.endswith(":" + name):
+            ds = gdal.Open(sds)
+            if ds:
+                return ds.ReadAsArray().astype(numpy.float64)
+    return None
+
+def max_step(a):
+    step = 0.0
+    if a.shape[0] > 1:
+        step = max(step, numpy.abs(numpy.diff(a, axis=0)).max())
+    if a.shape[1] > 1:
+        step = max(step, numpy.abs(numpy.diff(a, axis=1)).max())
+    return step
+
+# Returns flat list of [lonmin, latmin, lonmax, latmax] boxes of each scan.
+# Boxes are widened by one geolocation step to cover pixel footprints.
+def scan_bboxes(geo, scan_lines):
+    gd = gdal.Open(geo)
+    if not gd:
+        return None
+    lat = read_subdataset(gd, "Latitude")
+    lon = read_subdataset(gd, "Longitude")
+    if lat is None or lon is None or lat.shape != lon.shape:
+        return None
+
+    res = []
+    for first in range(0, lat.shape[0], scan_lines):
+        slat = lat[first:first+scan_lines]
+        slon = lon[first:first+scan_lines]
+        if not ((slat >= -90) & (slat <= 90) & 
+                (slon >= -180) & (slon <= 180)).all():
+            # Invalid points make interpolation unpredictable
+            res.extend([-180.0, -90.0, 180.0, 90.0])
+            continue
+
+        step = max_step(slat)
+        if slon.max() - slon.min() > 180:
+            # Scan crosses 180th meridian
+            lonmin, lonmax = -180.0, 180.0
+        else:
+            step = max(step, max_step(slon))
+            lonmin, lonmax = slon.min() - step, slon.max() + step
+        res.extend([lonmin, slat.min() - step, lonmax, slat.max() + step])
+    return res
+
 def create_catalog(conn, catalog, tile_column):
     cursor = conn.cursor()
     if tile == False:
@@ -71,6 +119,23 @@ def add_catalog_product(conn, catalog, prod):
         query = "ALTER TABLE " + catalog + " ADD " + prod + " text ; "
         cursor.execute(query) 
 
+def add_scan_bbox_column(conn, catalog):
+    cursor = conn.cursor()
+    query = """ SELECT 1 FROM information_schema.columns 
+            WHERE table_name = %s AND column_name = %s ; """
+    cursor.execute(query, (catalog, scan_bbox))
+    if not cursor.fetchone():
+        query = "ALTER TABLE " + catalog + " ADD " + scan_bbox + " float8[] ; "
+        cursor.execute(query) 
+
+def set_scan_bbox(conn, catalog, meta, bboxes):
+    cursor = conn.cursor()
+    query = "UPDATE " + catalog + " SET " + scan_bbox + """ = %s 
+        WHERE starttime = %s AND stoptime = %s 
+            AND footprint = ST_GeometryFromText(%s) """
+    cursor.execute(query, \
+                   (bboxes, meta['start'], meta['stop'], meta['footprint']))
+
 def add_file(conn, catalog, prod, filename, meta):
     # This is not threadsafe!!! Avoid running multiple copies of script
     cursor = conn.cursor()
@@ -109,6 +174,12 @@ base_path = '/home/kikht/Downloads/hdf'
 catalog = 'gdal_catalog'
 known_products = set(( 'mod13q1', ))
 tile = True # Set to False to disable tile extraction
+# Per-scan bounding boxes are computed from geolocation of these products 
+# with given number of lines per scan. They are used by hvault to skip scans
+# without reading them, set scan_bbox table option to enable it.
+scan_bbox = 'scan_bbox'
+#scan_bbox_products = { 'mod03': 10 }
+scan_bbox_products = dict()
 
 
 conn = psycopg2.connect(database=database)
@@ -116,6 +187,8 @@ conn.autocommit = True
 create_catalog(conn, catalog, tile);
 for prod in known_products:
     add_catalog_product(conn, catalog, prod);
+if scan_bbox_products:
+    add_scan_bbox_column(conn, catalog)
 
 prod_re = re.compile("^M[OY]D([^\.]*)\..*\.hdf$")
 for curdir, dirnames, filenames in os.walk(base_path):
@@ -141,6 +214,10 @@ for curdir, dirnames, filenames in os.walk(base_path):
         
         print "Adding file " + fullname
         add_file(conn, catalog, prod, fullname, meta)
+        if prod in scan_bbox_products:
+            bboxes = scan_bboxes(fullname, scan_bbox_products[prod])
+            if bboxes:
+                set_scan_bbox(conn, catalog, meta, bboxes)
         
            
 conn.close()
@@ -16,6 +16,7 @@
 #include <executor/spi.h>
 #include <foreign/fdwapi.h>
 #include <foreign/foreign.h>
+#include <miscadmin.h>
 #include <nodes/bitmapset.h>
 #include <nodes/nodeFuncs.h>
 #include <nodes/primnodes.h>
@@ -24,9 +25,16 @@
 #include <optimizer/paths.h>
 #include <optimizer/planmain.h>
 #include <optimizer/restrictinfo.h>
+#include <optimizer/tlist.h>
+#if PG_VERSION_NUM >= 120000
+#include <optimizer/optimizer.h>
+#else
+#include <optimizer/var.h>
+#endif
 #include <postgres_ext.h>
 #include <tcop/tcopprot.h>
 #include <utils/builtins.h>
+#include <utils/guc.h>
 #include <utils/lsyscache.h>
 #include <utils/memutils.h>
 #include <utils/rel.h>
@@ -42,6 +50,40 @@
 #include <access/htup_details.h>
 #endif
 
+/* Sampling routines used by analyze moved out of vacuum.h in 9.5 */
+#if PG_VERSION_NUM >= 90500
+#include <utils/sampling.h>
+#endif
+
+#if PG_VERSION_NUM >= 120000
+#include <access/table.h>
+#include <utils/float.h>
+#endif
+
+/* heap_open was renamed in 12 and the old name removed in 13 */
+#if PG_VERSION_NUM >= 130000
+#define heap_open(relid, lockmode) table_open(relid, lockmode)
+#define heap_close(rel, lockmode) table_close(rel, lockmode)
+#endif
+
+/* ArrayRef is generalized to SubscriptingRef since 12 */
+#if PG_VERSION_NUM >= 120000
+#define ArrayRef SubscriptingRef
+#define T_ArrayRef T_SubscriptingRef
+#endif
+
+/* Since 13 lists are arrays and lnext needs the list itself */
+#if PG_VERSION_NUM >= 130000
+#define listNext(list, cell) lnext(list, cell)
+#else
+#define listNext(list, cell) lnext(cell)
+#endif
+
+/* Since 11 attributes of TupleDesc are stored in array of structs */
+#ifndef TupleDescAttr
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
 #define HVAULT_TUPLES_PER_FILE (double)(2030*1354)
 
 typedef enum HvaultColumnType
@@ -234,7 +234,7 @@ deparseArrayRef(ArrayRef *node, HvaultDeparseContext *ctx)
         {
             hvaultDeparseSimple(lfirst(lowlist_item), ctx);
             appendStringInfoChar(&ctx->query, ':');
-            lowlist_item = lnext(lowlist_item);
+            lowlist_item = listNext(node->reflowerindexpr, lowlist_item);
         }
         hvaultDeparseSimple(lfirst(uplist_item), ctx);
         appendStringInfoChar(&ctx->query, ']');
@@ -16,8 +16,16 @@ typedef struct
                          List                    * options);
     void (* open      ) (HvaultFileDriver        * driver, 
                          HvaultCatalogItem const * products);
+    List * (* files   ) (HvaultFileDriver        * driver,
+                         HvaultCatalogItem const * products);
+    /* Reads geolocation of the next chunk and sets its size */
     void (* read      ) (HvaultFileDriver        * driver,
                          HvaultFileChunk         * chunk);
+    /* Reads data layers of the last read chunk in the window of samples */
+    void (* read_data ) (HvaultFileDriver        * driver,
+                         HvaultFileChunk         * chunk,
+                         size_t                    first_sample,
+                         size_t                    num_samples);
     void (* close     ) (HvaultFileDriver        * driver);
     void (* free      ) (HvaultFileDriver        * driver);
 } HvaultFileDriverMethods;
@@ -52,6 +60,8 @@ typedef struct HvaultFileLayer
     HvaultDataType src_type;
     size_t item_size;
     int hfactor, vfactor;
+    size_t line_size;       /* Number of items in a line of data buffer */
+    size_t sample_offset;   /* Item of the first sample in data buffer */
 } HvaultFileLayer;
 
 struct HvaultFileChunk 
@@ -66,12 +76,16 @@ struct HvaultFileChunk
     float * point_lon;
 
     size_t size, stride;
+    size_t offset;          /* Index of the first chunk pixel in file */
 };
 
 struct HvaultFileDriver
 {
     HvaultFileDriverMethods const * methods;
     HvaultGeolocationType geotype;
+    /* Box of lon/lat that selected pixels intersect, NULL if unknown.
+       Chunks that are surely outside of it may be skipped by read. */
+    GBOX const * region;
 };
 
 HvaultFileDriver * hvaultGetDriver (List *table_options, MemoryContext memctx);
@@ -2,6 +2,8 @@
 #include <gdal/ogr_srs_api.h>
 
 #include "../driver.h"
+#include "../geocache.h"
+#include "../localcache.h"
 #include "../options.h"
 
 #define FLAG_SHIFT_LONGITUDE 0x1
@@ -477,6 +479,7 @@ hvaultGDALOpen (HvaultFileDriver        * drv,
         {
             HvaultGDALLayer *layer = lfirst(l);
             HvaultCatalogItem const * filename;
+            char const * resolved;
             size_t num_rasters;
             size_t norm_lines, norm_samples;
             HvaultDataType cur_datatype;
@@ -496,9 +499,18 @@ hvaultGDALOpen (HvaultFileDriver        * drv,
                 continue;
             }
 
-            layer->dataset_name = makeDatasetName(filename->str, 
-                                                  layer->template);
+            resolved = hvaultLocalCacheResolve(filename->str);
+            layer->dataset_name = makeDatasetName(resolved, layer->template);
             layer->dataset = GDALOpen(layer->dataset_name, GA_ReadOnly);
+            if (layer->dataset == NULL && resolved != filename->str)
+            {
+                /* Cached copy may be evicted by other backend meanwhile */
+                elog(DEBUG1, "Can't open cached copy %s, loading %s",
+                     resolved, filename->str);
+                layer->dataset_name = makeDatasetName(filename->str, 
+                                                      layer->template);
+                layer->dataset = GDALOpen(layer->dataset_name, GA_ReadOnly);
+            }
             if (layer->dataset == NULL)
             {
                 elog(WARNING, "Can't open dataset %s, skipping", 
@@ -745,6 +757,28 @@ hvaultGDALOpen (HvaultFileDriver        * drv,
     PG_END_TRY();
 }
 
+static List *
+hvaultGDALFiles (HvaultFileDriver        * drv,
+                 HvaultCatalogItem const * products)
+{
+    HvaultGDALDriver * driver = (HvaultGDALDriver *) drv;
+    ListCell *l;
+    List * res = NIL;
+
+    Assert(driver->driver.methods == &hvaultGDALMethods);
+
+    foreach(l, driver->layers)
+    {
+        HvaultGDALLayer *layer = lfirst(l);
+        HvaultCatalogItem const * filename;
+
+        HASH_FIND_STR(products, layer->cat_name, filename);
+        if (filename != NULL && filename->str != NULL)
+            res = list_append_unique_ptr(res, filename->str);
+    }
+    return res;
+}
+
 
 static void
 geoTransform(OGRCoordinateTransformationH transform,
@@ -781,10 +815,66 @@ geoTransform(OGRCoordinateTransformationH transform,
     }
 }
 
+/* 
+ * Fills key of shared geolocation cache and returns source name of the key.
+ * Tiles with the same name may have different grids in other tables, so 
+ * geotransform is a part of the source.
+ */
+static char *
+geoCacheKey (HvaultGDALDriver * driver, 
+             char const       * tile, 
+             HvaultGeoCacheKey * key)
+{
+    char * source;
+
+    source = psprintf("%s %a %a %a %a %a %a", tile, 
+                      driver->aft[0], driver->aft[1], driver->aft[2], 
+                      driver->aft[3], driver->aft[4], driver->aft[5]);
+    memset(key, 0, sizeof(HvaultGeoCacheKey));
+    key->source = hvaultHashString(source);
+    key->lines = driver->num_lines;
+    key->samples = driver->num_samples;
+    key->factor = 1;
+    key->flags = driver->flags & 
+        (FLAG_SHIFT_LONGITUDE | FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT);
+    return source;
+}
+
+/* Returns geolocation arrays of bucket and their sizes in bytes */
+static int
+geoCacheArrays (HvaultGDALDriver      * driver, 
+                HvaultGDALGeolocation * geo,
+                float                ** arrays,
+                Size                  * sizes)
+{
+    int n = 0;
+
+    if (driver->flags & FLAG_HAS_FOOTPRINT)
+    {
+        sizes[n] = sizes[n + 1] = sizeof(float) * 
+            (driver->num_samples + 1) * (driver->num_lines + 1);
+        arrays[n++] = geo->fp_lat;
+        arrays[n++] = geo->fp_lon;
+    }
+    if (driver->flags & FLAG_HAS_POINT)
+    {
+        sizes[n] = sizes[n + 1] = sizeof(float) * 
+            driver->num_samples * driver->num_lines;
+        arrays[n++] = geo->point_lat;
+        arrays[n++] = geo->point_lon;
+    }
+    return n;
+}
+
 static HvaultGDALGeolocation * 
 getGeolocation (HvaultGDALDriver * driver,
                 char const * tile)
 {
+    HvaultGeoCacheKey key;
+    char * source = NULL;
+    float * arrays[4];
+    Size sizes[4];
+    int narrays = 0;
     size_t i, j, num_points;
     size_t cur_num = 0;
     HvaultGDALGeolocation *cur, *prev;
@@ -870,6 +960,17 @@ getGeolocation (HvaultGDALDriver * driver,
         if (cur->tile != NULL)
             pfree((void *) cur->tile);
         cur->tile = pstrdup(tile);
+
+        /* Other backends may have computed this tile already */
+        source = geoCacheKey(driver, tile, &key);
+        narrays = geoCacheArrays(driver, cur, arrays, sizes);
+        if (hvaultGeoCacheGet(&key, source, arrays, sizes, narrays))
+        {
+            elog(DEBUG1, "hvault: found geolocation in shared cache");
+            pfree(source);
+            MemoryContextSwitchTo(oldmemctx);
+            return cur;
+        }
     } 
     else
     {
@@ -926,6 +1027,12 @@ getGeolocation (HvaultGDALDriver * driver,
                      cur->point_lat, cur->point_lon);
     }
 
+    if (tile != NULL)
+    {
+        hvaultGeoCachePut(&key, source, arrays, sizes, narrays);
+        pfree(source);
+    }
+
     MemoryContextSwitchTo(oldmemctx);
     return cur;
 }
@@ -935,24 +1042,53 @@ static void
 readChunk (HvaultGDALDriver * driver,
            HvaultFileChunk  * chunk)
 {
-    ListCell *l;
-    
     chunk->const_layers = NIL;
     chunk->layers = NIL;
     chunk->stride = driver->num_samples;
     chunk->size = driver->num_samples * driver->num_lines;
+    chunk->offset = 0;
 
+    if (driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT))
+    {
+        HvaultGDALGeolocation * loc;
+        
+        loc = getGeolocation(driver, driver->tile);
+        chunk->lat = loc->fp_lat;
+        chunk->lon = loc->fp_lon;
+        chunk->point_lat = loc->point_lat;
+        chunk->point_lon = loc->point_lon;
+    }
+
+    driver->read_complete = true;
+}
+
+static void
+readChunkData (HvaultGDALDriver * driver,
+               HvaultFileChunk  * chunk,
+               size_t             first_sample,
+               size_t             num_samples)
+{
+    ListCell *l;
+    
+    chunk->layers = NIL;
     foreach(l, driver->layers)
     {
         HvaultGDALLayer *layer = lfirst(l);
         CPLErr res;
+        size_t first, end;
         if (layer->band == NULL)
             continue;
 
-        res = GDALRasterIO(layer->band, GF_Read, 0, 0, 
-                           layer->num_lines, layer->num_samples,
+        /* Read only window of samples */
+        first = first_sample / layer->layer.hfactor;
+        end = (first_sample + num_samples - 1) / layer->layer.hfactor + 1;
+        layer->layer.sample_offset = first;
+        layer->layer.line_size = end - first;
+
+        res = GDALRasterIO(layer->band, GF_Read, first, 0, 
+                           end - first, layer->num_samples,
                            layer->layer.data, 
-                           layer->num_lines, layer->num_samples,
+                           end - first, layer->num_samples,
                            layer->gdal_type, 0, 0);
         if (res != CE_None)
         {
@@ -964,19 +1100,6 @@ readChunk (HvaultGDALDriver * driver,
         if (layer->layer.colnum >= 0)
             chunk->layers = lappend(chunk->layers, layer);
     }
-    
-    if (driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT))
-    {
-        HvaultGDALGeolocation * loc;
-        
-        loc = getGeolocation(driver, driver->tile);
-        chunk->lat = loc->fp_lat;
-        chunk->lon = loc->fp_lon;
-        chunk->point_lat = loc->point_lat;
-        chunk->point_lon = loc->point_lon;
-    }
-
-    driver->read_complete = true;
 }
 
 static void 
@@ -1014,13 +1137,42 @@ hvaultGDALRead (HvaultFileDriver * drv,
     PG_END_TRY();
 }
 
+static void 
+hvaultGDALReadData (HvaultFileDriver * drv,
+                    HvaultFileChunk  * chunk,
+                    size_t             first_sample,
+                    size_t             num_samples)
+{
+    MemoryContext oldmemctx = NULL;
+    PG_TRY();
+    {
+        HvaultGDALDriver * driver = (HvaultGDALDriver *) drv;
+
+        Assert(driver->driver.methods == &hvaultGDALMethods);
+        oldmemctx = MemoryContextSwitchTo(driver->chunkmemctx);
+        readChunkData(driver, chunk, first_sample, num_samples);
+        MemoryContextSwitchTo(oldmemctx);
+    }
+    PG_CATCH();
+    {
+        if (oldmemctx != NULL)
+            MemoryContextSwitchTo(oldmemctx);
+
+        hvaultGDALFree(drv);
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+}
+
 
 const HvaultFileDriverMethods hvaultGDALMethods = 
 {
     hvaultGDALInit,
     hvaultGDALAddColumn,
     hvaultGDALOpen,
+    hvaultGDALFiles,
     hvaultGDALRead,
+    hvaultGDALReadData,
     hvaultGDALClose,
     hvaultGDALFree
 };
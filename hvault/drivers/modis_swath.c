@@ -1,6 +1,23 @@
+/* madvise is hidden by -D_POSIX_C_SOURCE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "../driver.h"
+#include "../geocache.h"
 #include "../interpolate.h"
+#include "../localcache.h"
 #include "../options.h"
+#include "../workers.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <access/xact.h>
+#include <storage/ipc.h>
 
 #define int8 hdf_int8
 #include <hdf/mfhdf.h>
@@ -12,22 +29,86 @@
 #define FLAG_HAS_POINT       0x4
 #define FLAG_INVERSE_SCALE   0x8
 
+/* SDgetdatainfo appeared in HDF 4.2.6 */
+#if LIBVER_MAJOR > 4 || (LIBVER_MAJOR == 4 && (LIBVER_MINOR > 2 || \
+    (LIBVER_MINOR == 2 && LIBVER_RELEASE >= 6)))
+#define HAVE_SDGETDATAINFO
+#endif
+
 const HvaultFileDriverMethods hvaultModisSwathMethods;
 
+/* 
+ * Metadata and open handles of HDF files are cached in backend memory 
+ * between queries. Entries are keyed by file name and invalidated by 
+ * modification time. Handles of files used by running scans are pinned.
+ */
+typedef struct
+{
+    char * name;
+    int32_t count;
+    double * values;
+
+    UT_hash_handle hh;
+} HvaultModisSwathAttrMeta;
+
+typedef struct
+{
+    char * name;
+    int32_t idx;                    /* FAIL if there is no such SDS */
+    bool has_info;
+    int32_t rank, type;
+    int32_t dims[H4_MAX_VAR_DIMS];
+    bool has_fill, has_range;
+    char fill[sizeof(double)];
+    char range[2 * sizeof(double)];
+    double scale, offset;
+    int32_t chunk_flags;            /* FAIL if chunk info is not available */
+    HDF_CHUNK_DEF chunk_def;
+    comp_coder_t comp;
+    bool has_comp;
+    int32_t data_blocks, data_offset, data_length;
+    HvaultModisSwathAttrMeta * attrs;
+    int32_t sds_id;                 /* Cached SDS handle or FAIL */
+
+    UT_hash_handle hh;
+} HvaultModisSwathSDSMeta;
+
+typedef struct
+{
+    char * filename;
+    time_t mtime;
+    MemoryContext memctx;
+    HvaultModisSwathSDSMeta * sds;
+    int32_t sd_id;                  /* Cached file handle or FAIL */
+    int refcount;                   /* Number of scans using handles */
+
+    UT_hash_handle hh;
+} HvaultModisSwathFileMeta;
+
+static void releaseFile (HvaultModisSwathFileMeta * meta);
+static void trimFileCache (void);
+
+static HvaultModisSwathFileMeta * metaCache = NULL;
+static MemoryContext metaCacheMemctx = NULL;
+static int numOpenFiles = 0;
+
 typedef struct 
 {
     char const * cat_name;
     char const * filename;
+    char const * origin;            /* File name from catalog */
     int32_t sd_id;
+    HvaultModisSwathFileMeta * meta;
 
     UT_hash_handle hh;
 } HvaultModisSwathFile;
 
-typedef struct
+typedef struct HvaultModisSwathLayer
 {
     HvaultFileLayer layer;
     HvaultModisSwathFile * file;
     char const * sds_name;
+    HvaultModisSwathSDSMeta * meta;
     int32_t sds_id;
     int32_t sds_type;
     Oid coltypid;
@@ -37,8 +118,60 @@ typedef struct
     char const * scale_att;
     char const * offset_att;
     uint32_t flags;
+    void * buffer;          /* Read buffer, layer.data points here or to map */
+    char * map;             /* Mapping of contiguous uncompressed SDS */
+    size_t map_size;
+    char * map_data;        /* Start of selected prefix inside map */
+    size_t map_line_size;   /* Bytes per line */
+    int map_elsize;         /* Size of byte swapped element, 0 if no swap */
+    /* 
+     * Layers that differ only in last prefix (band) of the same SDS are 
+     * read by one hyperslab into buffer of group leader.
+     */
+    struct HvaultModisSwathLayer * leader;  /* NULL if layer is read alone */
+    int32_t band_first, band_count;         /* Valid for leader only */
+    void * group_buffer;
+    size_t group_buffer_size;
 } HvaultModisSwathLayer;
 
+/* Interpolation of one geolocation layer, may run in worker thread */
+typedef struct
+{
+    float const * src;
+    float * dst;
+    size_t lines, samples;      /* Size of geolocation grid */
+    int factor;
+    float const * kernel;
+    bool footprint;
+} HvaultModisSwathInterp;
+
+typedef struct
+{
+    float *lat_data, *lon_data;             /* Footprint corners */
+    float *lat_point_data, *lon_point_data; /* Interpolated pixel centers */
+    float *point_lat, *point_lon;           /* Pixel centers of chunk */
+    float *lat_src, *lon_src;               /* Geolocation copy for workers */
+    HvaultModisSwathInterp tasks[4];
+    size_t line;                            /* First line of chunk */
+    bool store;         /* Computed geolocation is not in shared cache yet */
+} HvaultModisSwathGeolocation;
+
+#define SIDECAR_MAGIC "HVGEO02"
+
+/* 
+ * Geolocation sidecar file keeps interpolated geolocation of the whole 
+ * granule. Header is followed by geolocation arrays of each chunk in the 
+ * order of geolocationArrays.
+ */
+typedef struct
+{
+    char magic[8];
+    int64 mtime;            /* Modification time of geolocation file */
+    uint64 num_lines, num_samples, scanline_size;
+    uint32 factor, flags;
+    char source[MAXPGPATH]; /* Geolocation file, sidecar name may be hash */
+} HvaultModisSwathSidecarHeader;
+
 typedef struct 
 {
     HvaultFileDriver driver;
@@ -48,13 +181,45 @@ typedef struct
     List * layers;
     HvaultModisSwathLayer *lat_layer, *lon_layer;
     HvaultModisSwathFile * files;
-    float *lat_data, *lon_data, *lat_point_data, *lon_point_data;
+    /* 
+     * With worker threads geolocation is double buffered: next chunk is 
+     * interpolated in background while executor processes current one.
+     */
+    HvaultModisSwathGeolocation geo[2];
+    int cur_geo;
+    size_t next_line;   /* first line of chunk being prepared, -1 if none */
+    HvaultWorkers workers;
+    bool pipeline;
+    bool sidecar;       /* Geolocation is kept in sidecar files */
+    char * sidecar_map; /* Mapped sidecar of current granule or NULL */
+    size_t sidecar_size;
+    size_t sidecar_chunk;   /* Bytes of geolocation of one chunk */
+    int sidecar_fd;         /* Sidecar being written by scan or -1 */
+    char * sidecar_name;    /* Name it gets when all chunks are written */
+    char * sidecar_tmp;
+    size_t sidecar_line;    /* First line of the next chunk to write */
+    float *point_kernel, *footprint_kernel;
     size_t num_lines, num_samples;
     size_t scanline_size;
     size_t cur_line;
+    size_t chunk_line;
+    size_t geo_line;    /* first line of loaded geolocation */
+    char const * scan_bbox_col;
+    double * scan_bbox; /* lonmin, latmin, lonmax, latmax for each scan */
+    size_t num_scans, scan_bbox_size;
+    int chunk_cache;    /* chunks cached per SDS, 0 - HDF default, -1 - auto */
     uint32_t flags;
 } HvaultModisSwathDriver;
 
+static void openSidecar (HvaultModisSwathDriver * driver);
+static void writeSidecarChunk (HvaultModisSwathDriver      * driver,
+                               HvaultModisSwathGeolocation * geo);
+static void finishSidecar (HvaultModisSwathDriver * driver, bool publish);
+static void releaseFiles (HvaultModisSwathDriver * driver);
+#if PG_VERSION_NUM >= 90500
+static void releaseScanCallback (void * arg);
+#endif
+
 static HvaultModisSwathFile * 
 getFile (HvaultModisSwathDriver * driver, char const * cat_name)
 {
@@ -125,7 +290,32 @@ hvaultModisSwathInit (List * table_options, MemoryContext memctx)
 
     def = defFindByName(table_options, HVAULT_TABLE_OPTION_SCANLINE);
     driver->scanline_size = def != NULL ? defGetInt(def) : 0;
-                                        
+
+    def = defFindByName(table_options, HVAULT_TABLE_OPTION_SCAN_BBOX);
+    driver->scan_bbox_col = def != NULL ? defGetString(def) : NULL;
+
+    def = defFindByName(table_options, HVAULT_TABLE_OPTION_CHUNK_CACHE);
+    driver->chunk_cache = def != NULL ? defGetInt(def) : -1;
+
+    def = defFindByName(table_options, HVAULT_TABLE_OPTION_GEO_SIDECAR);
+    driver->sidecar = def != NULL && defGetBoolean(def);
+    driver->sidecar_fd = -1;
+
+    driver->next_line = (size_t) -1;
+#if PG_VERSION_NUM >= 90500
+    /* Threads are stopped by memory context callback on abort */
+    driver->pipeline = hvaultPipelineWorkers > 0;
+
+    {
+        MemoryContextCallback * cb;
+
+        cb = palloc(sizeof(MemoryContextCallback));
+        cb->func = releaseScanCallback;
+        cb->arg = driver;
+        MemoryContextRegisterResetCallback(newmemctx, cb);
+    }
+#endif
+
 
     driver->driver.methods = &hvaultModisSwathMethods;
     driver->driver.geotype = HvaultGeolocationCompact;
@@ -141,6 +331,8 @@ hvaultModisSwathFree (HvaultFileDriver * drv)
     
     Assert(driver->driver.methods == &hvaultModisSwathMethods);
     /* TODO: Close all opened files */
+    if (driver->workers != NULL)
+        hvaultWorkersFree(driver->workers);
     MemoryContextDelete(driver->memctx);
 }
 
@@ -400,65 +592,342 @@ hvaultModisSwathClose (HvaultFileDriver * drv)
 {
     HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) drv;
     ListCell *l;
-    HvaultModisSwathFile * file;
 
     Assert(driver->driver.methods == &hvaultModisSwathMethods);
 
+    /* Workers may still write geolocation of the next chunk */
+    if (driver->workers != NULL)
+        hvaultWorkersWait(driver->workers);
+    driver->next_line = (size_t) -1;
+
+    finishSidecar(driver, true);
+    if (driver->sidecar_map != NULL)
+    {
+        munmap(driver->sidecar_map, driver->sidecar_size);
+        driver->sidecar_map = NULL;
+    }
+
     foreach(l, driver->layers)
     {
         HvaultModisSwathLayer * layer = lfirst(l);
-        if (layer->sds_id == FAIL) 
-            continue;
-
-        if (SDendaccess(layer->sds_id) == FAIL)
+        if (layer->map != NULL)
         {
-            ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), 
-                            errmsg("Can't close SDS")));
+            munmap(layer->map, layer->map_size);
+            layer->map = NULL;
+            layer->map_data = NULL;
         }
-
+        layer->layer.data = layer->buffer;
+        layer->leader = NULL;
+        /* SDS handle is owned by file cache */
         layer->sds_id = FAIL;
     }
 
+    releaseFiles(driver);
+    trimFileCache();
+
+    driver->num_lines = 0;
+    driver->num_samples = 0;
+    driver->num_scans = 0;
+}
+
+/* Unpins files of the scan, may be called again after they are released */
+static void
+releaseFiles (HvaultModisSwathDriver * driver)
+{
+    HvaultModisSwathFile * file;
+
     for (file = driver->files; file != NULL; file = file->hh.next)
     {
-        if (file->sd_id == FAIL) 
+        if (file->sd_id != FAIL)
+            releaseFile(file->meta);
+        file->sd_id = FAIL;
+        file->filename = NULL;
+        file->origin = NULL;
+        file->meta = NULL;
+    }
+}
+
+#if PG_VERSION_NUM >= 90500
+/* 
+ * Scan aborted by error, including one caught by subtransaction, doesn't 
+ * close its files. Its pins are released and unfinished sidecar is removed
+ * when its memory context goes away.
+ */
+static void
+releaseScanCallback (void * arg)
+{
+    HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) arg;
+
+    finishSidecar(driver, false);
+    releaseFiles(driver);
+    trimFileCache();
+}
+#else
+/* Handles of aborted scans are not released by them */
+static void
+fileCacheXactCallback (XactEvent event, void * arg)
+{
+    HvaultModisSwathFileMeta * meta;
+
+    if (event != XACT_EVENT_ABORT)
+        return;
+    for (meta = metaCache; meta != NULL; meta = meta->hh.next)
+        meta->refcount = 0;
+    trimFileCache();
+}
+#endif
+
+static void
+closeFileHandles (HvaultModisSwathFileMeta * meta)
+{
+    HvaultModisSwathSDSMeta * sds;
+
+    if (meta->sd_id == FAIL)
+        return;
+
+    for (sds = meta->sds; sds != NULL; sds = sds->hh.next)
+    {
+        if (sds->sds_id != FAIL)
+            SDendaccess(sds->sds_id);
+        sds->sds_id = FAIL;
+    }
+    if (SDend(meta->sd_id) == FAIL)
+        elog(WARNING, "Can't close HDF file %s", meta->filename);
+    meta->sd_id = FAIL;
+    numOpenFiles--;
+}
+
+/* Closes handles of least recently used idle files over the limit */
+static void
+trimFileCache (void)
+{
+    HvaultModisSwathFileMeta * meta;
+
+    for (meta = metaCache; 
+         meta != NULL && numOpenFiles > hvaultFileCacheSize; 
+         meta = meta->hh.next)
+    {
+        if (meta->refcount == 0)
+            closeFileHandles(meta);
+    }
+}
+
+/* Evicts least recently used idle files until cache fits into its limit */
+static void
+trimMetaCache (void)
+{
+    HvaultModisSwathFileMeta * meta, * next;
+
+    for (meta = metaCache; 
+         meta != NULL && 
+            HASH_COUNT(metaCache) > (unsigned) hvaultMetadataCacheSize;
+         meta = next)
+    {
+        next = meta->hh.next;
+        if (meta->refcount > 0)
             continue;
-        if (SDend(file->sd_id) == FAIL)
+        closeFileHandles(meta);
+        HASH_DELETE(hh, metaCache, meta);
+        MemoryContextDelete(meta->memctx);
+    }
+}
+
+static void
+fileCacheExit (int code, Datum arg)
+{
+    HvaultModisSwathFileMeta * meta;
+
+    for (meta = metaCache; meta != NULL; meta = meta->hh.next)
+        closeFileHandles(meta);
+}
+
+/* Returns pinned handle of file, opening it if necessary */
+static int32_t
+openFile (HvaultModisSwathFileMeta * meta)
+{
+    if (meta->sd_id == FAIL)
+    {
+        meta->sd_id = SDstart(meta->filename, DFACC_READ);
+        if (meta->sd_id == FAIL)
+            return FAIL;
+        numOpenFiles++;
+    }
+    meta->refcount++;
+    return meta->sd_id;
+}
+
+static void
+releaseFile (HvaultModisSwathFileMeta * meta)
+{
+    if (meta->refcount > 0)
+        meta->refcount--;
+}
+
+static HvaultModisSwathFileMeta *
+getFileMeta (char const * filename)
+{
+    HvaultModisSwathFileMeta * meta;
+    MemoryContext memctx, oldmemctx;
+    struct stat st;
+
+    if (stat(filename, &st) != 0)
+        return NULL;
+
+    HASH_FIND_STR(metaCache, filename, meta);
+    if (meta != NULL)
+    {
+        HASH_DELETE(hh, metaCache, meta);
+        /* File changed under running scan is reopened by the next one */
+        if (meta->mtime == st.st_mtime || meta->refcount > 0)
         {
-            ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
-                            errmsg("Can't close HDF file")));
+            /* Move to the end of LRU list */
+            HASH_ADD_KEYPTR(hh, metaCache, meta->filename, 
+                            strlen(meta->filename), meta);
+            return meta;
         }
-        
-        file->sd_id = FAIL;
-        file->filename = NULL;
+        closeFileHandles(meta);
+        MemoryContextDelete(meta->memctx);
     }
 
-    driver->num_lines = 0;
-    driver->num_samples = 0;
+    if (metaCacheMemctx == NULL)
+    {
+        metaCacheMemctx = AllocSetContextCreate(TopMemoryContext,
+                                                "hvault modis metadata cache",
+                                                ALLOCSET_DEFAULT_MINSIZE,
+                                                ALLOCSET_DEFAULT_INITSIZE,
+                                                ALLOCSET_DEFAULT_MAXSIZE);
+#if PG_VERSION_NUM < 90500
+        RegisterXactCallback(fileCacheXactCallback, NULL);
+#endif
+        on_proc_exit(fileCacheExit, 0);
+    }
+    memctx = AllocSetContextCreate(metaCacheMemctx,
+                                   "hvault modis file metadata",
+                                   ALLOCSET_SMALL_MINSIZE,
+                                   ALLOCSET_SMALL_INITSIZE,
+                                   ALLOCSET_SMALL_MAXSIZE);
+    oldmemctx = MemoryContextSwitchTo(memctx);
+    meta = palloc0(sizeof(HvaultModisSwathFileMeta));
+    meta->filename = pstrdup(filename);
+    meta->mtime = st.st_mtime;
+    meta->memctx = memctx;
+    meta->sd_id = FAIL;
+    MemoryContextSwitchTo(oldmemctx);
+    HASH_ADD_KEYPTR(hh, metaCache, meta->filename, strlen(meta->filename), 
+                    meta);
+    return meta;
 }
 
-static int 
-readPrefixedAttr (HvaultModisSwathLayer const * layer, 
-                  char const * attname, 
-                  double * val)
+/* Reads metadata of SDS that doesn't depend on column definition */
+static void
+readSDSMeta (HvaultModisSwathSDSMeta * meta, int32_t sds_id)
 {
-    int i, index;   
+    double cal_err, offset_err;
+    int32_t sdtype, sdnattrs;
+    int elsize;
+
+    meta->has_info = SDgetinfo(sds_id, NULL, &meta->rank, meta->dims, 
+                               &meta->type, &sdnattrs) != FAIL;
+    if (!meta->has_info)
+        return;
+
+    elsize = DFKNTsize(meta->type);
+    if (elsize > 0 && elsize <= sizeof(double))
+    {
+        meta->has_fill = SDgetfillvalue(sds_id, meta->fill) == SUCCEED;
+        meta->has_range = SDgetrange(sds_id, meta->range + elsize, 
+                                     meta->range) == SUCCEED;
+    }
+
+    meta->scale = 1.;
+    meta->offset = 0;
+    SDgetcal(sds_id, &meta->scale, &cal_err, &meta->offset, &offset_err, 
+             &sdtype);
+
+    if (SDgetchunkinfo(sds_id, &meta->chunk_def, &meta->chunk_flags) == FAIL)
+        meta->chunk_flags = FAIL;
+    meta->has_comp = SDgetcomptype(sds_id, &meta->comp) != FAIL;
+#ifdef HAVE_SDGETDATAINFO
+    meta->data_blocks = SDgetdatainfo(sds_id, NULL, 0, 0, NULL, NULL);
+    if (meta->data_blocks == 1 && 
+        SDgetdatainfo(sds_id, NULL, 0, 1, &meta->data_offset, 
+                      &meta->data_length) != 1)
+        meta->data_blocks = FAIL;
+#else
+    meta->data_blocks = FAIL;
+#endif
+}
+
+/* Selects SDS of layer using cached metadata */
+static int32_t
+selectSDS (HvaultModisSwathLayer * layer)
+{
+    HvaultModisSwathFileMeta * fmeta = layer->file->meta;
+    HvaultModisSwathSDSMeta * meta;
+    MemoryContext oldmemctx;
+
+    HASH_FIND_STR(fmeta->sds, layer->sds_name, meta);
+    if (meta == NULL)
+    {
+        oldmemctx = MemoryContextSwitchTo(fmeta->memctx);
+        meta = palloc0(sizeof(HvaultModisSwathSDSMeta));
+        meta->name = pstrdup(layer->sds_name);
+        meta->idx = SDnametoindex(layer->file->sd_id, layer->sds_name);
+        meta->sds_id = FAIL;
+        HASH_ADD_KEYPTR(hh, fmeta->sds, meta->name, strlen(meta->name), meta);
+        MemoryContextSwitchTo(oldmemctx);
+    }
+
+    layer->meta = meta;
+    if (meta->idx == FAIL)
+    {
+        elog(WARNING, "Can't find dataset %s in file %s, skipping",
+             layer->sds_name, layer->file->filename);
+        return FAIL;
+    }
+
+    if (meta->sds_id == FAIL)
+        meta->sds_id = SDselect(layer->file->sd_id, meta->idx);
+    layer->sds_id = meta->sds_id;
+    if (layer->sds_id == FAIL)
+    {
+        elog(WARNING, "Can't open dataset %s in file %s, skipping",
+             layer->sds_name, layer->file->filename);
+        return FAIL;
+    }
+
+    if (!meta->has_info)
+        readSDSMeta(meta, layer->sds_id);
+    return SUCCEED;
+}
+
+/* Reads whole float attribute of SDS once per file */
+static HvaultModisSwathAttrMeta *
+getAttrMeta (HvaultModisSwathLayer const * layer, char const * attname)
+{
+    HvaultModisSwathAttrMeta * attr;
+    MemoryContext oldmemctx;
     int32_t att_id, att_type, count;
     char name[H4_MAX_NC_NAME];
     void * buf;
+    int i;
+
+    HASH_FIND_STR(layer->meta->attrs, attname, attr);
+    if (attr != NULL)
+        return attr;
 
     att_id = SDfindattr(layer->sds_id, attname);
     if (att_id == FAIL)
     {
         elog(WARNING, "Can't find %s attribute, will use no scaling. %s %s",
              attname, layer->sds_name, layer->file->filename);
-        return FAIL;
+        return NULL;
     }
     if (SDattrinfo(layer->sds_id, att_id, name, &att_type, &count) != SUCCEED)
     {
         elog(WARNING, "Can't read %s attribute info: %s %s",
              attname, layer->sds_name, layer->file->filename);
-        return FAIL;
+        return NULL;
     }
     if (att_type == DFNT_FLOAT32)
     {
@@ -472,14 +941,45 @@ readPrefixedAttr (HvaultModisSwathLayer const * layer,
     {
         elog(WARNING, "%s attribute must be float: %s %s",
              attname, layer->sds_name, layer->file->filename);
-        return FAIL;
+        return NULL;
     }
     if (SDreadattr(layer->sds_id, att_id, buf) != SUCCEED)
     {
         elog(WARNING, "Can't read %s attribute: %s %s",
              attname, layer->sds_name, layer->file->filename);
-        return FAIL;
+        pfree(buf);
+        return NULL;
+    }
+
+    oldmemctx = MemoryContextSwitchTo(layer->file->meta->memctx);
+    attr = palloc(sizeof(HvaultModisSwathAttrMeta));
+    attr->name = pstrdup(attname);
+    attr->count = count;
+    attr->values = palloc(sizeof(double) * Max(count, 1));
+    for (i = 0; i < count; i++)
+    {
+        attr->values[i] = att_type == DFNT_FLOAT32 ? 
+            ((float *) buf)[i] : ((double *) buf)[i];
     }
+    HASH_ADD_KEYPTR(hh, layer->meta->attrs, attr->name, strlen(attr->name), 
+                    attr);
+    MemoryContextSwitchTo(oldmemctx);
+    pfree(buf);
+    return attr;
+}
+
+static int 
+readPrefixedAttr (HvaultModisSwathLayer const * layer, 
+                  char const * attname, 
+                  double * val)
+{
+    HvaultModisSwathAttrMeta * attr;
+    int i, index;   
+
+    attr = getAttrMeta(layer, attname);
+    if (attr == NULL)
+        return FAIL;
+
     index = 0;
     if (layer->prefix_dims > 0)
     {
@@ -490,128 +990,437 @@ readPrefixedAttr (HvaultModisSwathLayer const * layer,
             index += layer->prefix[i+1];
         }
     }
-    if (index >= count)
+    if (index >= attr->count)
     {
         elog(WARNING, "Index for %s is out of range: %s %s",
              attname, layer->sds_name, layer->file->filename);
         return FAIL;
     }
-    if (att_type == DFNT_FLOAT32)
-    {
-        *val = ((float*) buf)[index];
-    }
-    else
-    {
-        *val = ((double*) buf)[index];   
-    }
-    pfree(buf);
+    *val = attr->values[index];
     return SUCCEED;
 }
 
-static void 
-hvaultModisSwathOpen (HvaultFileDriver        * drv,
-                      HvaultCatalogItem const * products)
+/*
+ * Loads per-scan bounding boxes from catalog. Boxes are stored by loader as
+ * flat float8 array with 4 elements per scan, box of each scan already 
+ * covers footprints of its pixels.
+ */
+static void
+loadScanBBoxes (HvaultModisSwathDriver  * driver,
+                HvaultCatalogItem const * products)
 {
-    HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) drv;
-    MemoryContext oldmemctx;
-    ListCell *l;
+    HvaultCatalogItem const * item;
+    ArrayType * arr;
+    size_t nitems;
 
-    Assert(driver->driver.methods == &hvaultModisSwathMethods);
+    HASH_FIND_STR(products, driver->scan_bbox_col, item);
+    if (item == NULL || item->str == NULL)
+        return;
 
-    hvaultModisSwathClose(drv);
-    driver->num_samples = 0;
-    driver->num_lines = 0;
-    driver->cur_line = 0;
+    if (get_element_type(item->typid) != FLOAT8OID)
+    {
+        ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
+                        errmsg("Catalog column %s must be of float8[] type",
+                               driver->scan_bbox_col),
+                        errhint("Check table and catalog definition")));
+        return; /* Will never reach this */
+    }
 
-    if (list_length(driver->layers) == 0)
+    arr = DatumGetArrayTypeP(item->val);
+    nitems = ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr));
+    if (ARR_NDIM(arr) != 1 || ARR_HASNULL(arr) || nitems == 0 || 
+        nitems % 4 != 0)
     {
-        elog(ERROR, "Query must contain at least one dataset or geolocation column");
+        elog(WARNING, "Invalid scan bounding boxes in %s, ignoring them",
+             driver->scan_bbox_col);
         return;
     }
 
-    oldmemctx = MemoryContextSwitchTo(driver->memctx);
+    if (driver->scan_bbox_size < nitems)
     {
-        HvaultModisSwathFile *file;
-        for (file = driver->files; file != NULL; file = file->hh.next)
-        {
-            HvaultCatalogItem const * filename;
-
-            HASH_FIND_STR(products, file->cat_name, filename);
-            if (filename == NULL)
-            {
-                elog(ERROR, "Can't find catalog column value for %s", 
-                     file->cat_name);
-                return; /*Will never reach this */
-            }
-
-            if (filename->str == NULL)
-                continue;
-
-            file->filename = filename->str;
-            elog(DEBUG1, "loading hdf file %s", file->filename);
-            file->sd_id = SDstart(file->filename, DFACC_READ);
-            if (file->sd_id == FAIL)
-            {
-                elog(WARNING, "Can't open HDF file %s, skipping file", 
-                     file->filename);
-            }
-        }
+        if (driver->scan_bbox != NULL)
+            pfree(driver->scan_bbox);
+        driver->scan_bbox = palloc(sizeof(double) * nitems);
+        driver->scan_bbox_size = nitems;
     }
+    memcpy(driver->scan_bbox, ARR_DATA_PTR(arr), sizeof(double) * nitems);
+    driver->num_scans = nitems / 4;
+}
 
-    if (driver->scanline_size == 0)
-        driver->scanline_size = DEFAULT_SCANLINE_SIZE;
+/*
+ * Sets size of HDF chunk cache of chunked SDS so that it holds all chunks 
+ * touched by reading of one scanline of given number of bands. Consecutive
+ * scanlines that fall into the same row of chunks then don't inflate
+ * compressed chunks again. 
+ * Scanline size itself is kept since it follows MODIS scan geometry.
+ */
+static void
+setupChunkCache (HvaultModisSwathDriver * driver, 
+                 HvaultModisSwathLayer  * layer, 
+                 int                      rank,
+                 int32_t                  bands)
+{
+    HvaultModisSwathSDSMeta const * meta = layer->meta;
+    int32_t maxcache;
+    size_t line_idx, lines;
+    int i;
 
-    //TODO: add support for sparse datasets
-    foreach(l, driver->layers)
-    {
-        HvaultModisSwathLayer *layer = lfirst(l);
-        int32_t sds_idx, rank, sdnattrs;
-        size_t norm_lines, norm_samples, layer_lines, layer_samples;
-        HvaultDataType cur_dataype;
-        int i;
+    if (driver->chunk_cache == 0)
+        return;
+    if (meta->chunk_flags == FAIL || !(meta->chunk_flags & HDF_CHUNK))
+        return;
 
-        elog(DEBUG2, "Opening SDS %s", layer->sds_name);
+    maxcache = driver->chunk_cache;
+    if (maxcache < 0)
+    {
+        line_idx = layer->prefix_dims;
+        if (layer->layer.src_type == HvaultPrefixBitmap)
+            line_idx += layer->bitmap_dims;
+        lines = driver->scanline_size / layer->layer.vfactor;
 
-        if (layer->file->sd_id == FAIL)
+        maxcache = 1;
+        if (bands > 1)
         {
-            elog(DEBUG2, "File is not opened, skipping dataset %s", 
-                 layer->sds_name);
-            continue;
+            /* Band range of grouped read */
+            size_t const len = Max(meta->chunk_def.chunk_lengths[
+                layer->prefix_dims - 1], 1);
+            maxcache *= (bands - 1) / len + 2;
         }
-
-        /* Find SDS */
-        sds_idx = SDnametoindex(layer->file->sd_id, layer->sds_name);
-        if (sds_idx == FAIL)
+        for (i = layer->prefix_dims; i < rank; i++)
         {
-            elog(WARNING, "Can't find dataset %s in file %s, skipping",
-                 layer->sds_name, layer->file->filename);
-            continue;
+            size_t const len = Max(meta->chunk_def.chunk_lengths[i], 1);
+            if (i != line_idx)
+                maxcache *= (layer->dims[i] + len - 1) / len;
+            else if (len % lines == 0)
+                maxcache *= 1;
+            else if (lines % len == 0)
+                maxcache *= lines / len;
+            else
+                maxcache *= (lines - 1) / len + 2; /* Unaligned read */
         }
-        /* Select SDS */
-        layer->sds_id = SDselect(layer->file->sd_id, sds_idx);
-        if (layer->sds_id == FAIL)
+    }
+
+    elog(DEBUG2, "Setting chunk cache of %s to %d chunks", 
+         layer->sds_name, maxcache);
+    if (SDsetchunkcache(layer->sds_id, maxcache, 0) == FAIL)
+    {
+        elog(DEBUG1, "Can't set chunk cache for dataset %s in file %s",
+             layer->sds_name, layer->file->filename);
+    }
+}
+
+/*
+ * Maps uncompressed SDS stored in one contiguous block directly from file, 
+ * so that reads don't go through HDF library. Data is used in place when 
+ * file byte order matches host one, otherwise it is swapped while copying.
+ */
+static void
+setupMapping (HvaultModisSwathLayer * layer, int rank)
+{
+#ifdef HAVE_SDGETDATAINFO
+    HvaultModisSwathSDSMeta const * meta = layer->meta;
+    int32_t const offset = meta->data_offset;
+    int32_t const length = meta->data_length;
+    size_t line_idx, expected, prefix_offset, pagesize, aligned;
+    bool litend;
+    int elsize, fd, i;
+
+    /* Prefix bitmap lines are not contiguous */
+    if (layer->layer.src_type == HvaultPrefixBitmap)
+        return;
+    if (meta->chunk_flags != HDF_NONE || 
+        !meta->has_comp || meta->comp != COMP_CODE_NONE ||
+        meta->data_blocks != 1)
+        return;
+
+    elsize = DFKNTsize(layer->sds_type);
+    line_idx = layer->prefix_dims;
+    expected = elsize;
+    for (i = 0; i < rank; i++)
+        expected *= layer->dims[i];
+    if (elsize <= 0 || length < 0 || (size_t) length != expected)
+        return;
+
+    layer->map_line_size = elsize;
+    for (i = line_idx + 1; i < rank; i++)
+        layer->map_line_size *= layer->dims[i];
+    prefix_offset = 0;
+    for (i = 0; i < layer->prefix_dims; i++)
+        prefix_offset = (prefix_offset + layer->prefix[i]) * layer->dims[i + 1];
+    prefix_offset *= layer->map_line_size;
+
+    fd = open(layer->file->filename, O_RDONLY);
+    if (fd < 0)
+        return;
+    pagesize = sysconf(_SC_PAGESIZE);
+    aligned = offset - offset % pagesize;
+    layer->map_size = length + (offset - aligned);
+    /* Private writable mapping allows in-place longitude shift */
+    layer->map = mmap(NULL, layer->map_size, PROT_READ | PROT_WRITE, 
+                      MAP_PRIVATE, fd, aligned);
+    close(fd);
+    if (layer->map == MAP_FAILED)
+    {
+        elog(DEBUG1, "Can't map dataset %s in file %s: %m",
+             layer->sds_name, layer->file->filename);
+        layer->map = NULL;
+        return;
+    }
+    madvise(layer->map, layer->map_size, MADV_SEQUENTIAL);
+    layer->map_data = layer->map + (offset - aligned) + prefix_offset;
+
+    litend = (layer->sds_type & DFNT_LITEND) != 0;
+#ifdef WORDS_BIGENDIAN
+    layer->map_elsize = (elsize > 1 && litend) ? elsize : 0;
+#else
+    layer->map_elsize = (elsize > 1 && !litend) ? elsize : 0;
+#endif
+    elog(DEBUG2, "Mapped dataset %s", layer->sds_name);
+#endif
+}
+
+static bool
+canGroupLayers (HvaultModisSwathLayer const * a, 
+                HvaultModisSwathLayer const * b)
+{
+    return a->file == b->file && strcmp(a->sds_name, b->sds_name) == 0 &&
+           a->prefix_dims == b->prefix_dims && 
+           memcmp(a->prefix, b->prefix, 
+                  sizeof(int32_t) * (a->prefix_dims - 1)) == 0 &&
+           a->layer.src_type == b->layer.src_type &&
+           a->layer.item_size == b->layer.item_size &&
+           a->layer.hfactor == b->layer.hfactor && 
+           a->layer.vfactor == b->layer.vfactor;
+}
+
+/* Groups opened layers that select different bands of the same SDS */
+static void
+groupLayers (HvaultModisSwathDriver * driver)
+{
+    List * leaders = NIL;
+    ListCell *l, *m;
+
+    foreach(l, driver->layers)
+    {
+        HvaultModisSwathLayer *layer = lfirst(l);
+        int32_t band;
+
+        layer->leader = NULL;
+        if (layer->sds_id == FAIL || layer->map_data != NULL || 
+            layer->prefix_dims == 0 || 
+            layer->layer.src_type == HvaultPrefixBitmap)
+            continue;
+
+        band = layer->prefix[layer->prefix_dims - 1];
+        foreach(m, leaders)
         {
-            elog(WARNING, "Can't open dataset %s in file %s, skipping",
-                 layer->sds_name, layer->file->filename);
+            HvaultModisSwathLayer *leader = lfirst(m);
+            if (canGroupLayers(leader, layer))
+            {
+                int32_t const end = Max(leader->band_first + 
+                                        leader->band_count, band + 1);
+                leader->band_first = Min(leader->band_first, band);
+                leader->band_count = end - leader->band_first;
+                layer->leader = leader;
+                break;
+            }
+        }
+        if (layer->leader == NULL)
+        {
+            layer->leader = layer;
+            layer->band_first = band;
+            layer->band_count = 1;
+            leaders = lappend(leaders, layer);
+        }
+    }
+
+    foreach(l, driver->layers)
+    {
+        HvaultModisSwathLayer *layer = lfirst(l);
+        if (layer->leader != NULL && layer->leader->band_count == 1)
+            layer->leader = NULL;
+    }
+    foreach(l, leaders)
+    {
+        HvaultModisSwathLayer *leader = lfirst(l);
+        if (leader->band_count > 1)
+            setupChunkCache(driver, leader, leader->meta->rank, 
+                            leader->band_count);
+    }
+    list_free(leaders);
+}
+
+/* Allocates geolocation buffers and interpolation kernels */
+static void
+allocGeolocation (HvaultModisSwathDriver * driver)
+{
+    int const geo_factor = driver->lat_layer->layer.vfactor;
+    size_t const point_size = sizeof(float) * driver->num_samples * 
+                              driver->scanline_size;
+    size_t const footprint_size = sizeof(float) * (driver->num_samples + 1) * 
+                                  (driver->scanline_size + 1);
+    int i;
+
+    if (driver->pipeline && driver->workers == NULL)
+    {
+        driver->workers = hvaultWorkersInit(hvaultPipelineWorkers, 
+                                            driver->memctx);
+        if (driver->workers == NULL)
+            driver->pipeline = false;
+    }
+
+    for (i = 0; i < (driver->workers != NULL ? 2 : 1); i++)
+    {
+        HvaultModisSwathGeolocation * geo = driver->geo + i;
+
+        /* Allocate point buffers if necessary, cache fills them always */
+        if (geo->lat_point_data == NULL &&
+            driver->flags & FLAG_HAS_POINT && 
+            (driver->lat_layer->layer.hfactor != 1 || 
+             hvaultGeoCacheEnabled() || driver->sidecar))
+        {
+            geo->lat_point_data = palloc(point_size);
+            geo->lon_point_data = palloc(point_size);
+        }
+        /* Allocate footprint buffers */
+        if (geo->lat_data == NULL &&
+            driver->flags & FLAG_HAS_FOOTPRINT)
+        {
+            geo->lat_data = palloc(footprint_size);
+            geo->lon_data = palloc(footprint_size);
+        }
+        /* Layer buffers are overwritten while workers interpolate */
+        if (geo->lat_src == NULL && driver->workers != NULL)
+        {
+            geo->lat_src = palloc(point_size / geo_factor / geo_factor);
+            geo->lon_src = palloc(point_size / geo_factor / geo_factor);
+        }
+    }
+
+    if (geo_factor == 1 || geo_factor == 2 || geo_factor == 4)
+        return;
+    if (driver->point_kernel == NULL && driver->flags & FLAG_HAS_POINT)
+    {
+        driver->point_kernel = palloc(sizeof(float) * 16 * 
+                                      geo_factor * geo_factor);
+        hvaultInterpolatePointKernel(geo_factor, driver->point_kernel);
+    }
+    if (driver->footprint_kernel == NULL && 
+        driver->flags & FLAG_HAS_FOOTPRINT)
+    {
+        driver->footprint_kernel = palloc(sizeof(float) * 4 * 
+                                          (2 * geo_factor + 1) * 
+                                          (2 * geo_factor + 1));
+        hvaultInterpolateFootprintKernel(geo_factor, 
+                                         driver->footprint_kernel);
+    }
+}
+
+static void 
+hvaultModisSwathOpen (HvaultFileDriver        * drv,
+                      HvaultCatalogItem const * products)
+{
+    HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) drv;
+    MemoryContext oldmemctx;
+    ListCell *l;
+
+    Assert(driver->driver.methods == &hvaultModisSwathMethods);
+
+    hvaultModisSwathClose(drv);
+    driver->num_samples = 0;
+    driver->num_lines = 0;
+    driver->cur_line = 0;
+    driver->geo_line = (size_t) -1;
+
+    if (list_length(driver->layers) == 0)
+    {
+        elog(ERROR, "Query must contain at least one dataset or geolocation column");
+        return;
+    }
+
+    trimMetaCache();
+    oldmemctx = MemoryContextSwitchTo(driver->memctx);
+    {
+        HvaultModisSwathFile *file;
+        for (file = driver->files; file != NULL; file = file->hh.next)
+        {
+            HvaultCatalogItem const * filename;
+
+            HASH_FIND_STR(products, file->cat_name, filename);
+            if (filename == NULL)
+            {
+                elog(ERROR, "Can't find catalog column value for %s", 
+                     file->cat_name);
+                return; /*Will never reach this */
+            }
+
+            if (filename->str == NULL)
+                continue;
+
+            file->origin = filename->str;
+            file->filename = hvaultLocalCacheResolve(filename->str);
+            elog(DEBUG1, "loading hdf file %s", file->filename);
+            file->meta = getFileMeta(file->filename);
+            file->sd_id = file->meta != NULL ? openFile(file->meta) : FAIL;
+            if (file->sd_id == FAIL && file->filename != file->origin)
+            {
+                /* Cached copy may be evicted by other backend meanwhile */
+                elog(DEBUG1, "Can't open cached copy %s, loading %s", 
+                     file->filename, file->origin);
+                file->filename = file->origin;
+                file->meta = getFileMeta(file->filename);
+                file->sd_id = file->meta != NULL ? openFile(file->meta) 
+                                                 : FAIL;
+            }
+            if (file->sd_id == FAIL)
+            {
+                elog(WARNING, "Can't open HDF file %s, skipping file", 
+                     file->filename);
+            }
+        }
+    }
+
+    if (driver->scanline_size == 0)
+        driver->scanline_size = DEFAULT_SCANLINE_SIZE;
+
+    //TODO: add support for sparse datasets
+    foreach(l, driver->layers)
+    {
+        HvaultModisSwathLayer *layer = lfirst(l);
+        int32_t rank;
+        size_t norm_lines, norm_samples, layer_lines, layer_samples;
+        HvaultDataType cur_dataype;
+        int i;
+
+        elog(DEBUG2, "Opening SDS %s", layer->sds_name);
+
+        if (layer->file->sd_id == FAIL)
+        {
+            elog(DEBUG2, "File is not opened, skipping dataset %s", 
+                 layer->sds_name);
             continue;
         }
+
+        /* Find and select SDS */
+        if (selectSDS(layer) == FAIL)
+            continue;
         /* Get dimension sizes */
-        if (SDgetinfo(layer->sds_id, NULL, &rank, layer->dims, &layer->sds_type, 
-                      &sdnattrs) == FAIL)
+        if (!layer->meta->has_info)
         {
             elog(WARNING, "Can't get info about %s in file %s, skipping",
                  layer->sds_name, layer->file->filename);
-            SDendaccess(layer->sds_id);
             layer->sds_id = FAIL;
             continue;
         }
+        rank = layer->meta->rank;
+        layer->sds_type = layer->meta->type;
+        memcpy(layer->dims, layer->meta->dims, sizeof(layer->dims));
         
         /* Check dimensions correctness */
         if (rank != 2 + layer->bitmap_dims + layer->prefix_dims)
         {
             elog(WARNING, "SDS %s in file %s has %dd dataset, skipping",
                  layer->sds_name, layer->file->filename, rank);
-            SDendaccess(layer->sds_id);
             layer->sds_id = FAIL;
             continue;
         }
@@ -622,7 +1431,6 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
                 elog(WARNING, 
                      "Prefix is out of range for SDS %s in file %s, skipping",
                      layer->sds_name, layer->file->filename);
-                SDendaccess(layer->sds_id);
                 layer->sds_id = FAIL;
                 continue;       
             }
@@ -646,7 +1454,6 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
         {
             elog(WARNING, "SDS %s in file %s has only %lu lines, skipping",
                  layer->sds_name, layer->file->filename, norm_samples);
-            SDendaccess(layer->sds_id);
             layer->sds_id = FAIL;
             continue;
         }
@@ -656,10 +1463,10 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
         } 
         else if (driver->num_lines != norm_lines)
         {
-            elog(WARNING, "SDS %s in file %s with %lu lines is incompatible with others (%lu), skipping",
+            elog(WARNING, "SDS %s in file %s with %lu lines is incompatible "
+                          "with others (%lu), skipping",
                  layer->sds_name, layer->file->filename, 
                  norm_lines, driver->num_lines);
-            SDendaccess(layer->sds_id);
             layer->sds_id = FAIL;
             continue;
         }
@@ -669,14 +1476,17 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
         } 
         else if (norm_samples != driver->num_samples)
         {
-            elog(WARNING, "SDS %s in file %s with %lu samples is incompatible with others (%lu), skipping",
+            elog(WARNING, "SDS %s in file %s with %lu samples is incompatible "
+                          "with others (%lu), skipping",
                  layer->sds_name, layer->file->filename, 
                  norm_samples, driver->num_samples);
-            SDendaccess(layer->sds_id);
             layer->sds_id = FAIL;
             continue;
         }
 
+        setupChunkCache(driver, layer, rank, 1);
+        setupMapping(layer, rank);
+
         /* Check SDS datatype */
         cur_dataype = mapHDFDatatype(layer->sds_type);
         /* Initialize src_type if unknown yet */
@@ -710,9 +1520,9 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
             }
             if (!res)
             {
-                elog(WARNING, "SDS %s in file %s has datatype incompatible with column type",
+                elog(WARNING, "SDS %s in file %s has datatype incompatible "
+                              "with column type",
                      layer->sds_name, layer->file->filename);
-                SDendaccess(layer->sds_id);
                 layer->sds_id = FAIL;
                 continue;
             }
@@ -734,9 +1544,9 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
             if (layer->layer.item_size != 
                 bit_layers_size * hvaultDatatypeSize[cur_dataype])
             {
-                elog(WARNING, "SDS %s in file %s has incompatible bitfield size",
+                elog(WARNING,
+                     "SDS %s in file %s has incompatible bitfield size",
                      layer->sds_name, layer->file->filename);
-                SDendaccess(layer->sds_id);
                 layer->sds_id = FAIL;
                 continue;
             }
@@ -745,10 +1555,10 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
         /* Check that type is equal to previous files */
         else if (layer->layer.src_type != cur_dataype)
         {
-            elog(WARNING, "SDS %s in file %s has datatype %d incompatible with previous files (%d)",
+            elog(WARNING, "SDS %s in file %s has datatype %d incompatible "
+                          "with previous files (%d)",
                  layer->sds_name, layer->file->filename, 
                  cur_dataype, layer->layer.src_type);
-            SDendaccess(layer->sds_id);
             layer->sds_id = FAIL;
             continue;
         }
@@ -757,9 +1567,14 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
         if (layer->layer.src_type != HvaultBitmap && 
             layer->layer.src_type != HvaultPrefixBitmap)
         {
-            if (layer->layer.fill_val == NULL)
-                layer->layer.fill_val = palloc(layer->layer.item_size);
-            if (SDgetfillvalue(layer->sds_id, layer->layer.fill_val) != SUCCEED)
+            if (layer->meta->has_fill)
+            {
+                if (layer->layer.fill_val == NULL)
+                    layer->layer.fill_val = palloc(layer->layer.item_size);
+                memcpy(layer->layer.fill_val, layer->meta->fill, 
+                       layer->layer.item_size);
+            }
+            else if (layer->layer.fill_val != NULL)
             {
                 pfree(layer->layer.fill_val);
                 layer->layer.fill_val = NULL;
@@ -779,10 +1594,8 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
                                  &layer->layer.offset);
             if (layer->scale_att == NULL && layer->offset_att == NULL)
             {
-                double cal_err, offset_err;
-                int32_t sdtype;
-                SDgetcal(layer->sds_id, &layer->layer.scale, &cal_err, 
-                         &layer->layer.offset, &offset_err, &sdtype);
+                layer->layer.scale = layer->meta->scale;
+                layer->layer.offset = layer->meta->offset;
             }
 
             if (layer->flags & FLAG_INVERSE_SCALE)
@@ -794,20 +1607,24 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
             }
 
             
-            if (layer->layer.range == NULL)
-                layer->layer.range = palloc(layer->layer.item_size * 2);
-            if (SDgetrange(layer->sds_id, 
-                    ((char*) layer->layer.range) + layer->layer.item_size,
-                    layer->layer.range) != SUCCEED)
+            if (layer->meta->has_range)
+            {
+                if (layer->layer.range == NULL)
+                    layer->layer.range = palloc(layer->layer.item_size * 2);
+                memcpy(layer->layer.range, layer->meta->range, 
+                       layer->layer.item_size * 2);
+            }
+            else if (layer->layer.range != NULL)
             {
                 pfree(layer->layer.range);
                 layer->layer.range = NULL;
             }
         } 
         /* Allocate data buffer */
-        if (layer->layer.data == NULL)
-            layer->layer.data = palloc(layer->layer.item_size * layer_samples * 
+        if (layer->buffer == NULL)
+            layer->buffer = palloc(layer->layer.item_size * layer_samples * 
                 (driver->scanline_size / layer->layer.vfactor));
+        layer->layer.data = layer->buffer;
     }
     /* Sanity check */
     if (driver->num_lines == 0 || driver->num_samples == 0)
@@ -827,252 +1644,1042 @@ hvaultModisSwathOpen (HvaultFileDriver        * drv,
         hvaultModisSwathClose(drv);
         return;
     }
-    /* Allocate point buffers if necessary */
-    if (driver->lat_point_data == NULL &&
-        driver->flags & FLAG_HAS_POINT && 
-        driver->lat_layer->layer.hfactor != 1)
+    groupLayers(driver);
+    /* Load scan bounding boxes */
+    if (driver->scan_bbox_col != NULL)
     {
-        driver->lat_point_data = palloc(sizeof(float) * driver->num_samples * 
-                                        driver->scanline_size);
-        driver->lon_point_data = palloc(sizeof(float) * driver->num_samples * 
-                                        driver->scanline_size);
+        loadScanBBoxes(driver, products);
+        if (driver->num_scans != 0 && driver->num_lines % driver->num_scans)
+        {
+            elog(WARNING, "Number of scan bounding boxes %lu doesn't match "
+                 "number of lines %lu, ignoring them", 
+                 driver->num_scans, driver->num_lines);
+            driver->num_scans = 0;
+        }
     }
-    /* Allocate footprint buffers */
-    if (driver->lat_data == NULL &&
-        driver->flags & FLAG_HAS_FOOTPRINT)
+    if (driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT))
     {
-        driver->lat_data = palloc(sizeof(float) * (driver->num_samples + 1) *
-                                  (driver->scanline_size + 1));
-        driver->lon_data = palloc(sizeof(float) * (driver->num_samples + 1) *
-                                  (driver->scanline_size + 1));
+        allocGeolocation(driver);
+        if (driver->sidecar)
+            openSidecar(driver);
     }
 
     MemoryContextSwitchTo(oldmemctx);
 }
 
-static void 
-hvaultModisSwathRead (HvaultFileDriver * drv,
-                      HvaultFileChunk  * chunk)
+static List *
+hvaultModisSwathFiles (HvaultFileDriver        * drv,
+                       HvaultCatalogItem const * products)
 {
     HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) drv;
-    MemoryContext oldmemctx;
-    ListCell *l;
-    size_t geo_lines, geo_samples;
-    int geo_factor;
+    HvaultModisSwathFile * file;
+    List * res = NIL;
 
     Assert(driver->driver.methods == &hvaultModisSwathMethods);
-    MemoryContextReset(driver->chunkmemctx);
-    oldmemctx = MemoryContextSwitchTo(driver->chunkmemctx);
 
-    if (driver->cur_line >= driver->num_lines)
+    for (file = driver->files; file != NULL; file = file->hh.next)
     {
-        chunk->size = 0;
-        MemoryContextSwitchTo(oldmemctx);
+        HvaultCatalogItem const * filename;
+
+        HASH_FIND_STR(products, file->cat_name, filename);
+        if (filename != NULL && filename->str != NULL)
+            res = lappend(res, filename->str);
+    }
+    return res;
+}
+
+/* Copies n elements of size elsize reversing their byte order */
+static void
+swapCopy (char * dst, char const * src, size_t n, int elsize)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < n; i++, dst += elsize, src += elsize)
+        for (j = 0; j < elsize; j++)
+            dst[j] = src[elsize - 1 - j];
+}
+
+static void
+readMappedLayer (HvaultModisSwathDriver * driver, 
+                 HvaultModisSwathLayer  * layer,
+                 size_t                   first,
+                 size_t                   end)
+{
+    size_t const lines = driver->scanline_size / layer->layer.vfactor;
+    size_t const samples = layer->map_line_size / layer->layer.item_size;
+    char const * src = layer->map_data + 
+        driver->chunk_line / layer->layer.vfactor * layer->map_line_size;
+    size_t i;
+
+    if (layer->map_elsize == 0)
+    {
+        /* Zero-copy */
+        layer->layer.data = (void *) src;
+        layer->layer.sample_offset = 0;
+        layer->layer.line_size = samples;
         return;
     }
 
-    chunk->const_layers = NIL;
-    chunk->layers = NIL;
-    chunk->lat = driver->lat_data;
-    chunk->lon = driver->lon_data;
-    chunk->point_lat = driver->lat_point_data;
-    chunk->point_lon = driver->lon_point_data;
-    chunk->stride = driver->num_samples;
-    chunk->size = driver->num_samples * driver->scanline_size;
+    layer->layer.data = layer->buffer;
+    layer->layer.sample_offset = first;
+    layer->layer.line_size = end - first;
+    for (i = 0; i < lines; i++)
+    {
+        swapCopy((char *) layer->buffer + i * layer->layer.line_size * 
+                     layer->layer.item_size,
+                 src + i * layer->map_line_size + 
+                     first * layer->layer.item_size,
+                 layer->layer.line_size * layer->layer.item_size / 
+                     layer->map_elsize,
+                 layer->map_elsize);
+    }
+}
 
-    /* Read data from file */
-    foreach(l, driver->layers)
+/* Reads hyperslab of chunk lines in the window of samples and bands */
+static void
+readSlab (HvaultModisSwathDriver * driver, 
+          HvaultModisSwathLayer  * layer,
+          int32_t                  band_first,
+          int32_t                  band_count,
+          size_t                   first,
+          size_t                   end,
+          void                   * buf)
+{
+    int32_t start[H4_MAX_VAR_DIMS], stride[H4_MAX_VAR_DIMS], 
+            edge[H4_MAX_VAR_DIMS];
+    int i;
+    size_t line_idx;
+
+    for (i = 0; i < H4_MAX_VAR_DIMS; i++)
     {
-        HvaultModisSwathLayer *layer = lfirst(l);
-        int32_t start[H4_MAX_VAR_DIMS], stride[H4_MAX_VAR_DIMS], 
-                edge[H4_MAX_VAR_DIMS];
-        int i;
-        size_t line_idx;
+        start[i] = 0;
+        stride[i] = 1;
+        edge[i] = layer->dims[i];
+    }
 
-        if (layer->sds_id == FAIL)
-            continue;
+    for (i = 0; i < layer->prefix_dims; i++)
+    {
+        start[i] = layer->prefix[i];
+        edge[i] = 1;
+    }
+    if (layer->prefix_dims > 0)
+    {
+        start[layer->prefix_dims - 1] = band_first;
+        edge[layer->prefix_dims - 1] = band_count;
+    }
 
-        for (i = 0; i < H4_MAX_VAR_DIMS; i++)
-        {
-            start[i] = 0;
-            stride[i] = 1;
-            edge[i] = layer->dims[i];
-        }
+    if (layer->layer.src_type == HvaultPrefixBitmap)
+    {
+        line_idx = layer->bitmap_dims + layer->prefix_dims;
+    }
+    else 
+    {
+        line_idx = layer->prefix_dims;
+    }
+    start[line_idx] = driver->chunk_line / layer->layer.vfactor;
+    edge[line_idx] = driver->scanline_size / layer->layer.vfactor;
 
-        for (i = 0; i < layer->prefix_dims; i++)
-        {
-            start[i] = layer->prefix[i];
-            edge[i] = 1;
-        }
+    start[line_idx + 1] = first;
+    edge[line_idx + 1] = end - first;
 
-        if (layer->layer.src_type == HvaultPrefixBitmap)
-        {
-            line_idx = layer->bitmap_dims + layer->prefix_dims;
-        }
-        else 
-        {
-            line_idx = layer->prefix_dims;
-        }
-        start[line_idx] = driver->cur_line / layer->layer.vfactor;
-        edge[line_idx] = driver->scanline_size / layer->layer.vfactor;
+    if (SDreaddata(layer->sds_id, start, stride, edge, buf) == FAIL)
+    {
+        elog(ERROR, "Can't read data from %s dataset %s", 
+             layer->file->filename, layer->sds_name);
+        return; /* will never reach here */
+    }
+}
+
+static void
+readLayer (HvaultModisSwathDriver * driver, 
+           HvaultModisSwathLayer  * layer,
+           size_t                   first_sample,
+           size_t                   num_samples)
+{
+    size_t first, end;
 
-        if (SDreaddata(layer->sds_id, start, stride, edge, 
-                       layer->layer.data) == FAIL)
+    if (layer->sds_id == FAIL)
+        return;
+
+    /* Read only window of samples */
+    first = first_sample / layer->layer.hfactor;
+    end = (first_sample + num_samples - 1) / layer->layer.hfactor + 1;
+    if (layer->map_data != NULL)
+    {
+        readMappedLayer(driver, layer, first, end);
+        return;
+    }
+
+    layer->layer.data = layer->buffer;
+    layer->layer.sample_offset = first;
+    layer->layer.line_size = end - first;
+    readSlab(driver, layer, 
+             layer->prefix_dims > 0 ? layer->prefix[layer->prefix_dims-1] : 0,
+             1, first, end, layer->layer.data);
+}
+
+/* 
+ * Reads band range of layer group into leader's buffer. Band is the 
+ * outermost dimension of the slab, so data of each band is contiguous.
+ */
+static void
+readGroup (HvaultModisSwathDriver * driver, 
+           HvaultModisSwathLayer  * leader,
+           size_t                   first_sample,
+           size_t                   num_samples)
+{
+    size_t first, end, size;
+
+    first = first_sample / leader->layer.hfactor;
+    end = (first_sample + num_samples - 1) / leader->layer.hfactor + 1;
+    size = leader->band_count * leader->layer.item_size * (end - first) * 
+           (driver->scanline_size / leader->layer.vfactor);
+    if (leader->group_buffer_size < size)
+    {
+        if (leader->group_buffer != NULL)
+            pfree(leader->group_buffer);
+        leader->group_buffer = MemoryContextAlloc(driver->memctx, size);
+        leader->group_buffer_size = size;
+    }
+
+    leader->layer.sample_offset = first;
+    leader->layer.line_size = end - first;
+    readSlab(driver, leader, leader->band_first, leader->band_count, 
+             first, end, leader->group_buffer);
+}
+
+/* Points layer data to its band in group buffer */
+static void
+setGroupView (HvaultModisSwathDriver * driver, HvaultModisSwathLayer * layer)
+{
+    HvaultModisSwathLayer const * leader = layer->leader;
+    size_t const band_size = leader->layer.item_size * leader->layer.line_size *
+                             (driver->scanline_size / leader->layer.vfactor);
+    int32_t const band = layer->prefix[layer->prefix_dims - 1];
+
+    layer->layer.sample_offset = leader->layer.sample_offset;
+    layer->layer.line_size = leader->layer.line_size;
+    layer->layer.data = (char *) leader->group_buffer + 
+                        (band - leader->band_first) * band_size;
+}
+
+/* Reads geolocation layers of chunk starting at chunk_line */
+static void
+readGeolocation (HvaultModisSwathDriver * driver)
+{
+    if (driver->geo_line == driver->chunk_line)
+        return;
+
+    readLayer(driver, driver->lat_layer, 0, driver->num_samples);
+    readLayer(driver, driver->lon_layer, 0, driver->num_samples);
+    driver->geo_line = driver->chunk_line;
+
+    /* Shift longitude */
+    if (driver->flags & FLAG_SHIFT_LONGITUDE)
+    {
+        size_t i;
+        int const geo_factor = driver->lon_layer->layer.vfactor;
+        size_t const size = driver->scanline_size / geo_factor * 
+                            driver->num_samples / geo_factor;
+        float * const buf = driver->lon_layer->layer.data;
+        for (i = 0; i < size; i++)
         {
-            elog(ERROR, "Can't read data from %s dataset %s", 
-                 layer->file->filename, layer->sds_name);
-            return; /* will never reach here */
+            buf[i] += (float)(360 * (buf[i] < 0));
         }
-        
-        /* We don't need to pass geolocation data as layers */
-        if (layer->layer.colnum >= 0)
-            chunk->layers = lappend(chunk->layers, layer);
     }
+}
 
-    if (driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT))
+/*
+ * Checks whether pixels around points of geolocation grid may intersect 
+ * region. Interpolated pixels don't go further from geolocation points than 
+ * one step of geolocation grid.
+ */
+static bool
+gridInRegion (GBOX const  * region,
+              float const * lat, 
+              float const * lon, 
+              size_t        lines, 
+              size_t        samples)
+{
+    float latmin, latmax, lonmin, lonmax, step;
+    size_t i, j;
+
+    latmin = lonmin = INFINITY;
+    latmax = lonmax = -INFINITY;
+    step = 0;
+    for (i = 0; i < lines; i++)
     {
-        geo_factor = driver->lat_layer->layer.vfactor;
-        Assert(driver->lat_layer);
-        Assert(driver->lon_layer);
-        Assert(driver->lat_layer->layer.hfactor == geo_factor);
-        Assert(driver->lat_layer->layer.vfactor == geo_factor);
-        Assert(driver->lon_layer->layer.hfactor == geo_factor);
-        Assert(driver->lon_layer->layer.vfactor == geo_factor);
-        geo_lines = driver->scanline_size / geo_factor;
-        geo_samples = driver->num_samples / geo_factor;
-
-        /* Shift longitude */
-        if (driver->flags & FLAG_SHIFT_LONGITUDE)
+        for (j = 0; j < samples; j++)
         {
-            size_t i;
-            const size_t size = geo_lines * geo_samples;
-            float * const buf = driver->lon_layer->layer.data;
-            for (i = 0; i < size; i++)
+            size_t const idx = i * samples + j;
+
+            /* Invalid points make interpolation unpredictable */
+            if (!(lat[idx] >= -90 && lat[idx] <= 90 && 
+                  lon[idx] >= -180 && lon[idx] <= 360))
+                return true;
+
+            latmin = Min(latmin, lat[idx]);
+            latmax = Max(latmax, lat[idx]);
+            lonmin = Min(lonmin, lon[idx]);
+            lonmax = Max(lonmax, lon[idx]);
+            if (j > 0)
             {
-                buf[i] += (float)(360 * (buf[i] < 0));
+                step = Max(step, fabsf(lat[idx] - lat[idx - 1]));
+                step = Max(step, fabsf(lon[idx] - lon[idx - 1]));
+            }
+            if (i > 0)
+            {
+                step = Max(step, fabsf(lat[idx] - lat[idx - samples]));
+                step = Max(step, fabsf(lon[idx] - lon[idx - samples]));
             }
         }
+    }
+
+    return latmin - step <= region->ymax && latmax + step >= region->ymin &&
+           lonmin - step <= region->xmax && lonmax + step >= region->xmin;
+}
+
+/*
+ * Checks whether pixels of chunk starting at chunk_line may intersect 
+ * region. Grid from sidecar is used if it is available.
+ */
+static bool
+chunkInRegion (HvaultModisSwathDriver * driver)
+{
+    int const geo_factor = driver->lat_layer->layer.vfactor;
+    float const * lat;
+
+    if (driver->sidecar_map != NULL)
+    {
+        /* First arrays of chunk are footprint or points if there is none */
+        size_t const lines = driver->scanline_size + 
+                             (driver->flags & FLAG_HAS_FOOTPRINT ? 1 : 0);
+        size_t const samples = driver->num_samples + 
+                               (driver->flags & FLAG_HAS_FOOTPRINT ? 1 : 0);
+
+        lat = (float const *) (driver->sidecar_map + 
+            sizeof(HvaultModisSwathSidecarHeader) + 
+            driver->chunk_line / driver->scanline_size * 
+            driver->sidecar_chunk);
+        return gridInRegion(driver->driver.region, lat, lat + lines * samples,
+                            lines, samples);
+    }
+
+    readGeolocation(driver);
+    return gridInRegion(driver->driver.region, 
+                        driver->lat_layer->layer.data, 
+                        driver->lon_layer->layer.data,
+                        driver->scanline_size / geo_factor,
+                        driver->num_samples / geo_factor);
+}
 
-        /* Calc point geolocation */
-        if (driver->flags & FLAG_HAS_POINT)
+/*
+ * Checks catalog bounding boxes of scans covered by chunk starting at 
+ * chunk_line. Unlike chunkInRegion it doesn't touch HDF file.
+ */
+static bool
+scansInRegion (HvaultModisSwathDriver * driver)
+{
+    GBOX const * const region = driver->driver.region;
+    size_t scan_lines, first, last, i;
+
+    /* Scan boxes are not configured or don't match the granule */
+    if (driver->num_scans == 0)
+        return true;
+
+    scan_lines = driver->num_lines / driver->num_scans;
+    first = driver->chunk_line / scan_lines;
+    last = Min(driver->chunk_line + driver->scanline_size - 1, 
+               driver->num_lines - 1) / scan_lines;
+    for (i = first; i <= last; i++)
+    {
+        double const * box = driver->scan_bbox + 4 * i;
+        double lonmin = box[0], lonmax = box[2];
+
+        if (driver->flags & FLAG_SHIFT_LONGITUDE)
         {
-            if (driver->lat_point_data != NULL)
+            if (lonmax < 0)
             {
-                memset(driver->lat_point_data, 0, sizeof(float) * 
-                       driver->num_samples * driver->scanline_size);
+                lonmin += 360;
+                lonmax += 360;
             }
-            if (driver->lon_point_data != NULL)
+            else if (lonmin < 0)
             {
-                memset(driver->lon_point_data, 0, sizeof(float) * 
-                       driver->num_samples * driver->scanline_size);
+                /* Box is split by shift */
+                lonmin = 0;
+                lonmax = 360;
             }
+        }
 
-            switch (geo_factor)
-            {
-                case 1:
-                    chunk->point_lat = driver->lat_layer->layer.data;
-                    chunk->point_lon = driver->lon_layer->layer.data;
-                    break;
-                case 2:
-                    hvaultInterpolatePoints2x(driver->lat_layer->layer.data, 
-                                              driver->lat_point_data, 
-                                              geo_lines, geo_samples);
-                    hvaultInterpolatePoints2x(driver->lon_layer->layer.data, 
-                                              driver->lon_point_data, 
-                                              geo_lines, geo_samples);
-                    break;
-                case 4:
-                    hvaultInterpolatePoints4x(driver->lat_layer->layer.data, 
-                                              driver->lat_point_data, 
-                                              geo_lines, geo_samples);
-                    hvaultInterpolatePoints4x(driver->lon_layer->layer.data, 
-                                              driver->lon_point_data, 
-                                              geo_lines, geo_samples);
-                    break;
-                default:
-                {
-                    /* TODO: move kernel generation to initialization stage */
-                    float * kernel = palloc(sizeof(float) * 16 * 
-                                            geo_factor * geo_factor);
-                    hvaultInterpolatePointKernel(geo_factor, kernel);
-                    hvaultInterpolatePoints(driver->lat_layer->layer.data, 
-                                            driver->lat_point_data, 
-                                            geo_lines, geo_samples, 
-                                            kernel, geo_factor);
-                    hvaultInterpolatePoints(driver->lon_layer->layer.data, 
-                                            driver->lon_point_data, 
-                                            geo_lines, geo_samples, 
-                                            kernel, geo_factor);
-                    pfree(kernel);
-                }
-                    break;
-            }
+        if (box[1] <= region->ymax && box[3] >= region->ymin &&
+            lonmin <= region->xmax && lonmax >= region->xmin)
+            return true;
+    }
+    return false;
+}
+
+/* Interpolates point or footprint geolocation of chunk */
+static void
+interpolateGeolocation (void * arg)
+{
+    HvaultModisSwathInterp const * task = arg;
+    size_t const lines = task->lines, samples = task->samples;
+
+    if (task->footprint)
+    {
+        memset(task->dst, 0, sizeof(float) * (samples * task->factor + 1) * 
+               (lines * task->factor + 1));
+        switch (task->factor)
+        {
+            case 1:
+                hvaultInterpolateFootprint1x(task->src, task->dst, 
+                                             lines, samples);
+                break;
+            case 2:
+                hvaultInterpolateFootprint2x(task->src, task->dst, 
+                                             lines, samples);
+                break;
+            case 4:
+                hvaultInterpolateFootprint4x(task->src, task->dst, 
+                                             lines, samples);
+                break;
+            default:
+                hvaultInterpolateFootprint(task->src, task->dst, 
+                                           lines, samples, 
+                                           task->kernel, task->factor);
+                break;
+        }
+    }
+    else
+    {
+        memset(task->dst, 0, sizeof(float) * samples * lines * 
+               task->factor * task->factor);
+        switch (task->factor)
+        {
+            case 2:
+                hvaultInterpolatePoints2x(task->src, task->dst, 
+                                          lines, samples);
+                break;
+            case 4:
+                hvaultInterpolatePoints4x(task->src, task->dst, 
+                                          lines, samples);
+                break;
+            default:
+                hvaultInterpolatePoints(task->src, task->dst, 
+                                        lines, samples, 
+                                        task->kernel, task->factor);
+                break;
         }
+    }
+}
 
-        /* Calc footprint geolocation */
-        if (driver->flags & FLAG_HAS_FOOTPRINT)
+/* 
+ * Fills key of shared geolocation cache for chunk starting at line. Returns 
+ * false if geolocation can't be cached.
+ */
+static bool
+geoCacheKey (HvaultModisSwathDriver * driver, 
+             size_t                   line, 
+             HvaultGeoCacheKey      * key)
+{
+    HvaultModisSwathFile * file = driver->lat_layer->file;
+
+    /* Latitude and Longitude are datasets of the same file */
+    if (!hvaultGeoCacheEnabled() || file->meta == NULL)
+        return false;
+
+    memset(key, 0, sizeof(HvaultGeoCacheKey));
+    key->source = hvaultHashString(file->filename);
+    key->mtime = file->meta->mtime;
+    key->line = line;
+    key->lines = driver->scanline_size;
+    key->samples = driver->num_samples;
+    key->factor = driver->lat_layer->layer.vfactor;
+    key->flags = driver->flags & 
+        (FLAG_SHIFT_LONGITUDE | FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT);
+    return true;
+}
+
+/* 
+ * Returns number of geolocation arrays of chunk, their sizes in bytes and 
+ * buffers. Output buffers are filled from caches, input ones hold computed
+ * geolocation.
+ */
+static int
+geolocationArrays (HvaultModisSwathDriver      * driver,
+                   HvaultModisSwathGeolocation * geo,
+                   bool                          output,
+                   float                      ** arrays,
+                   Size                        * sizes)
+{
+    int n = 0;
+
+    if (driver->flags & FLAG_HAS_FOOTPRINT)
+    {
+        sizes[n] = sizes[n + 1] = sizeof(float) * 
+            (driver->num_samples + 1) * (driver->scanline_size + 1);
+        arrays[n++] = geo->lat_data;
+        arrays[n++] = geo->lon_data;
+    }
+    if (driver->flags & FLAG_HAS_POINT)
+    {
+        sizes[n] = sizes[n + 1] = sizeof(float) * 
+            driver->num_samples * driver->scanline_size;
+        arrays[n++] = output ? geo->lat_point_data : geo->point_lat;
+        arrays[n++] = output ? geo->lon_point_data : geo->point_lon;
+    }
+    return n;
+}
+
+/* Fills geo buffers from shared cache, returns false on cache miss */
+static bool
+lookupGeolocation (HvaultModisSwathDriver      * driver,
+                   HvaultModisSwathGeolocation * geo)
+{
+    HvaultGeoCacheKey key;
+    float * arrays[4];
+    Size sizes[4];
+    int n;
+
+    if (!geoCacheKey(driver, geo->line, &key))
+        return false;
+
+    n = geolocationArrays(driver, geo, true, arrays, sizes);
+    if (!hvaultGeoCacheGet(&key, driver->lat_layer->file->filename, 
+                           arrays, sizes, n))
+        return false;
+
+    geo->point_lat = geo->lat_point_data;
+    geo->point_lon = geo->lon_point_data;
+    return true;
+}
+
+/* Puts interpolated geolocation to shared cache, must be complete */
+static void
+storeGeolocation (HvaultModisSwathDriver      * driver,
+                  HvaultModisSwathGeolocation * geo)
+{
+    HvaultGeoCacheKey key;
+    float * arrays[4];
+    Size sizes[4];
+    int n;
+
+    if (!geo->store)
+        return;
+    geo->store = false;
+    if (!geoCacheKey(driver, geo->line, &key))
+        return;
+
+    n = geolocationArrays(driver, geo, false, arrays, sizes);
+    hvaultGeoCachePut(&key, driver->lat_layer->file->filename, 
+                      arrays, sizes, n);
+}
+
+/* Returns size of all geolocation arrays of one chunk in sidecar */
+static Size
+sidecarChunkSize (HvaultModisSwathDriver * driver)
+{
+    float * arrays[4];
+    Size sizes[4], res = 0;
+    int n, i;
+
+    n = geolocationArrays(driver, driver->geo, false, arrays, sizes);
+    for (i = 0; i < n; i++)
+        res += sizes[i];
+    return res;
+}
+
+/* Fills geo buffers from mapped sidecar, returns false if it is not open */
+static bool
+readSidecar (HvaultModisSwathDriver      * driver,
+             HvaultModisSwathGeolocation * geo)
+{
+    float * arrays[4];
+    Size sizes[4];
+    char const * data;
+    int n, i;
+
+    if (driver->sidecar_map == NULL)
+        return false;
+
+    data = driver->sidecar_map + sizeof(HvaultModisSwathSidecarHeader) + 
+        geo->line / driver->scanline_size * driver->sidecar_chunk;
+    n = geolocationArrays(driver, geo, true, arrays, sizes);
+    for (i = 0; i < n; i++)
+    {
+        memcpy(arrays[i], data, sizes[i]);
+        data += sizes[i];
+    }
+
+    geo->point_lat = geo->lat_point_data;
+    geo->point_lon = geo->lon_point_data;
+    return true;
+}
+
+/*
+ * Reads geolocation of chunk starting at chunk_line and interpolates it into
+ * geo buffers. With async interpolation runs in worker threads and buffers
+ * are valid after hvaultWorkersWait.
+ */
+static void
+prepareGeolocation (HvaultModisSwathDriver      * driver,
+                    HvaultModisSwathGeolocation * geo,
+                    bool                          async)
+{
+    int const geo_factor = driver->lat_layer->layer.vfactor;
+    size_t const geo_lines = driver->scanline_size / geo_factor;
+    size_t const geo_samples = driver->num_samples / geo_factor;
+    float *lat, *lon;
+    int ntasks = 0, i;
+
+    Assert(driver->lat_layer);
+    Assert(driver->lon_layer);
+    Assert(driver->lat_layer->layer.hfactor == geo_factor);
+    Assert(driver->lat_layer->layer.vfactor == geo_factor);
+    Assert(driver->lon_layer->layer.hfactor == geo_factor);
+    Assert(driver->lon_layer->layer.vfactor == geo_factor);
+
+    /* Other backends may have interpolated this chunk already */
+    geo->line = driver->chunk_line;
+    geo->store = false;
+    if (lookupGeolocation(driver, geo) || readSidecar(driver, geo))
+        return;
+    geo->store = hvaultGeoCacheEnabled();
+
+    readGeolocation(driver);
+    lat = driver->lat_layer->layer.data;
+    lon = driver->lon_layer->layer.data;
+    if (driver->workers != NULL)
+    {
+        /* 
+         * Layer buffers are reused for reading of the other chunk while this
+         * one is interpolated or, without interpolation, returned as is
+         */
+        memcpy(geo->lat_src, lat, sizeof(float) * geo_lines * geo_samples);
+        memcpy(geo->lon_src, lon, sizeof(float) * geo_lines * geo_samples);
+        lat = geo->lat_src;
+        lon = geo->lon_src;
+    }
+
+    /* Calc point geolocation */
+    geo->point_lat = geo->lat_point_data;
+    geo->point_lon = geo->lon_point_data;
+    if (driver->flags & FLAG_HAS_POINT)
+    {
+        if (geo_factor == 1)
         {
-            if (driver->lat_data != NULL) 
-            {
-                memset(driver->lat_data, 0, sizeof(float) * 
-                       (driver->num_samples + 1) * (driver->scanline_size + 1));
-            }
-            if (driver->lon_data != NULL) 
+            geo->point_lat = lat;
+            geo->point_lon = lon;
+        }
+        else
+        {
+            geo->tasks[ntasks].src = lat;
+            geo->tasks[ntasks].dst = geo->lat_point_data;
+            geo->tasks[ntasks + 1].src = lon;
+            geo->tasks[ntasks + 1].dst = geo->lon_point_data;
+            for (i = ntasks; i < ntasks + 2; i++)
             {
-                memset(driver->lon_data, 0, sizeof(float) * 
-                       (driver->num_samples + 1) * (driver->scanline_size + 1));
+                geo->tasks[i].kernel = driver->point_kernel;
+                geo->tasks[i].footprint = false;
             }
+            ntasks += 2;
+        }
+    }
 
+    /* Calc footprint geolocation */
+    if (driver->flags & FLAG_HAS_FOOTPRINT)
+    {
+        geo->tasks[ntasks].src = lat;
+        geo->tasks[ntasks].dst = geo->lat_data;
+        geo->tasks[ntasks + 1].src = lon;
+        geo->tasks[ntasks + 1].dst = geo->lon_data;
+        for (i = ntasks; i < ntasks + 2; i++)
+        {
+            geo->tasks[i].kernel = driver->footprint_kernel;
+            geo->tasks[i].footprint = true;
+        }
+        ntasks += 2;
+    }
 
-            switch (geo_factor)
-            {
-                case 1:
-                    hvaultInterpolateFootprint1x(driver->lat_layer->layer.data, 
-                                                 driver->lat_data, 
-                                                 geo_lines, geo_samples);
-                    hvaultInterpolateFootprint1x(driver->lon_layer->layer.data, 
-                                                 driver->lon_data, 
-                                                 geo_lines, geo_samples);
-                    break;
-                case 2:
-                    hvaultInterpolateFootprint2x(driver->lat_layer->layer.data, 
-                                                 driver->lat_data, 
-                                                 geo_lines, geo_samples);
-                    hvaultInterpolateFootprint2x(driver->lon_layer->layer.data, 
-                                                 driver->lon_data, 
-                                                 geo_lines, geo_samples);
-                    break;
-                case 4:
-                    hvaultInterpolateFootprint4x(driver->lat_layer->layer.data, 
-                                                 driver->lat_data, 
-                                                 geo_lines, geo_samples);
-                    hvaultInterpolateFootprint4x(driver->lon_layer->layer.data, 
-                                                 driver->lon_data, 
-                                                 geo_lines, geo_samples);
-                    break;
-                default:
-                {
-                    /* TODO: move kernel generation to initialization stage */
-                    float * kernel = palloc(sizeof(float) * 4 * 
-                                            (2 * geo_factor + 1) * 
-                                            (2 * geo_factor + 1));
-                    hvaultInterpolateFootprintKernel(geo_factor, kernel);
-                    hvaultInterpolateFootprint(driver->lat_layer->layer.data, 
-                                               driver->lat_data, 
-                                               geo_lines, geo_samples, 
-                                               kernel, geo_factor);
-                    hvaultInterpolateFootprint(driver->lon_layer->layer.data, 
-                                               driver->lon_data, 
-                                               geo_lines, geo_samples, 
-                                               kernel, geo_factor);
-                    pfree(kernel);
-                }
-                    break;
-            }
+    for (i = 0; i < ntasks; i++)
+    {
+        geo->tasks[i].lines = geo_lines;
+        geo->tasks[i].samples = geo_samples;
+        geo->tasks[i].factor = geo_factor;
+        if (async)
+            hvaultWorkersSubmit(driver->workers, interpolateGeolocation, 
+                                geo->tasks + i);
+        else
+            interpolateGeolocation(geo->tasks + i);
+    }
+}
+
+/* Returns sidecar file name of current granule or NULL */
+static char *
+sidecarName (HvaultModisSwathDriver * driver, time_t * mtime)
+{
+    HvaultModisSwathFile * file = driver->lat_layer->file;
+    struct stat st;
+
+    /* Copy in local cache is named after catalog file too */
+    if (file->origin == NULL || strlen(file->origin) >= MAXPGPATH ||
+        stat(file->origin, &st) != 0)
+        return NULL;
+    *mtime = st.st_mtime;
+
+    if (hvaultGeoSidecarDir != NULL && hvaultGeoSidecarDir[0] != '\0')
+    {
+        return psprintf("%s/%016llx.hvgeo", hvaultGeoSidecarDir, 
+                        (unsigned long long) hvaultHashString(file->origin));
+    }
+    return psprintf("%s.hvgeo", file->origin);
+}
+
+static void
+sidecarHeader (HvaultModisSwathDriver        * driver, 
+               time_t                          mtime,
+               HvaultModisSwathSidecarHeader * header)
+{
+    memset(header, 0, sizeof(HvaultModisSwathSidecarHeader));
+    memcpy(header->magic, SIDECAR_MAGIC, sizeof(header->magic));
+    header->mtime = mtime;
+    header->num_lines = driver->num_lines;
+    header->num_samples = driver->num_samples;
+    header->scanline_size = driver->scanline_size;
+    header->factor = driver->lat_layer->layer.vfactor;
+    header->flags = driver->flags & 
+        (FLAG_SHIFT_LONGITUDE | FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT);
+    strlcpy(header->source, driver->lat_layer->file->origin, MAXPGPATH);
+}
+
+/* 
+ * Maps sidecar if it matches current granule and driver settings. Source
+ * name is compared too, hashed names of sidecars may collide.
+ */
+static bool
+mapSidecar (HvaultModisSwathDriver              * driver, 
+            char const                          * name,
+            HvaultModisSwathSidecarHeader const * header)
+{
+    size_t const num_chunks = (driver->num_lines + driver->scanline_size - 1)
+                              / driver->scanline_size;
+    size_t const chunk = sidecarChunkSize(driver);
+    size_t const size = sizeof(HvaultModisSwathSidecarHeader) + 
+                        num_chunks * chunk;
+    struct stat st;
+    void * map;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != size)
+    {
+        close(fd);
+        return false;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    if (memcmp(map, header, sizeof(HvaultModisSwathSidecarHeader)) != 0)
+    {
+        munmap(map, size);
+        return false;
+    }
+
+    elog(DEBUG1, "using geolocation sidecar %s", name);
+    driver->sidecar_map = map;
+    driver->sidecar_size = size;
+    driver->sidecar_chunk = chunk;
+    return true;
+}
+
+static bool
+writeAll (int fd, void const * buf, size_t size)
+{
+    char const * ptr = buf;
+
+    while (size > 0)
+    {
+        ssize_t res = write(fd, ptr, size);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        ptr += res;
+        size -= res;
+    }
+    return true;
+}
+
+/*
+ * Starts writing sidecar of current granule. File is written under
+ * temporary name, so concurrent scans never see partial one.
+ */
+static void
+startSidecar (HvaultModisSwathDriver              * driver,
+              char const                          * name,
+              HvaultModisSwathSidecarHeader const * header)
+{
+    char * tmp;
+    int fd;
+
+    tmp = psprintf("%s.%d.tmp", name, MyProcPid);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC,
+              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0)
+    {
+        elog(DEBUG1, "Can't create geolocation sidecar %s: %m", tmp);
+        pfree(tmp);
+        return;
+    }
+    if (!writeAll(fd, header, sizeof(HvaultModisSwathSidecarHeader)))
+    {
+        elog(DEBUG1, "Can't write geolocation sidecar %s: %m", tmp);
+        close(fd);
+        unlink(tmp);
+        pfree(tmp);
+        return;
+    }
+
+    driver->sidecar_fd = fd;
+    driver->sidecar_tmp = tmp;
+    driver->sidecar_name = pstrdup(name);
+    driver->sidecar_line = 0;
+}
+
+/*
+ * Appends geolocation of current chunk to sidecar being written. Chunks
+ * must come in order, so sidecar is dropped if scan skips some of them.
+ */
+static void
+writeSidecarChunk (HvaultModisSwathDriver      * driver,
+                   HvaultModisSwathGeolocation * geo)
+{
+    float * arrays[4];
+    Size sizes[4];
+    int n, i;
+    bool ok = true;
+
+    if (driver->sidecar_fd < 0)
+        return;
+    if (driver->chunk_line != driver->sidecar_line)
+    {
+        finishSidecar(driver, false);
+        return;
+    }
+
+    n = geolocationArrays(driver, geo, false, arrays, sizes);
+    for (i = 0; ok && i < n; i++)
+        ok = writeAll(driver->sidecar_fd, arrays[i], sizes[i]);
+    if (!ok)
+    {
+        elog(DEBUG1, "Can't write geolocation sidecar %s: %m",
+             driver->sidecar_tmp);
+        finishSidecar(driver, false);
+        return;
+    }
+    driver->sidecar_line += driver->scanline_size;
+}
+
+/*
+ * Closes sidecar being written. It gets its name if publish is requested
+ * and all chunks are written, otherwise it is removed.
+ */
+static void
+finishSidecar (HvaultModisSwathDriver * driver, bool publish)
+{
+    bool ok;
+
+    if (driver->sidecar_fd < 0)
+        return;
+
+    ok = publish && driver->sidecar_line >= driver->num_lines;
+    if (close(driver->sidecar_fd) != 0)
+        ok = false;
+    if (!ok || rename(driver->sidecar_tmp, driver->sidecar_name) != 0)
+    {
+        if (ok)
+            elog(DEBUG1, "Can't write geolocation sidecar %s: %m",
+                 driver->sidecar_name);
+        unlink(driver->sidecar_tmp);
+    }
+
+    pfree(driver->sidecar_tmp);
+    pfree(driver->sidecar_name);
+    driver->sidecar_tmp = NULL;
+    driver->sidecar_name = NULL;
+    driver->sidecar_fd = -1;
+}
+
+/*
+ * Maps geolocation sidecar of current granule. If there is no valid one,
+ * scan writes it from geolocation of chunks it reads anyway, so that later
+ * scans don't read and interpolate geolocation layers.
+ */
+static void
+openSidecar (HvaultModisSwathDriver * driver)
+{
+    HvaultModisSwathSidecarHeader header;
+    time_t mtime;
+    char * name;
+
+    name = sidecarName(driver, &mtime);
+    if (name == NULL)
+        return;
+
+    sidecarHeader(driver, mtime, &header);
+    if (!mapSidecar(driver, name, &header))
+        startSidecar(driver, name, &header);
+    pfree(name);
+}
+
+/* Advances cur_line to the next chunk that may intersect region */
+static void
+skipChunks (HvaultModisSwathDriver * driver)
+{
+    if (driver->driver.region == NULL || 
+        !(driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT)))
+        return;
+
+    for ( ; driver->cur_line < driver->num_lines; 
+          driver->cur_line += driver->scanline_size)
+    {
+        driver->chunk_line = driver->cur_line;
+        if (scansInRegion(driver) && chunkInRegion(driver))
+            break;
+    }
+}
+
+/*
+ * Starts interpolation of the next chunk in worker threads, so that it 
+ * overlaps with processing of current chunk by executor. HDF is accessed 
+ * from backend thread only.
+ */
+static void
+prefetchGeolocation (HvaultModisSwathDriver * driver)
+{
+    size_t const chunk_line = driver->chunk_line;
+
+    skipChunks(driver);
+    if (driver->cur_line < driver->num_lines)
+    {
+        driver->chunk_line = driver->cur_line;
+        prepareGeolocation(driver, driver->geo + (driver->cur_geo ^ 1), true);
+        driver->next_line = driver->cur_line;
+    }
+    /* Data layers are read for current chunk */
+    driver->chunk_line = chunk_line;
+}
+
+static void 
+hvaultModisSwathRead (HvaultFileDriver * drv,
+                      HvaultFileChunk  * chunk)
+{
+    HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) drv;
+    MemoryContext oldmemctx;
+    HvaultModisSwathGeolocation * geo;
+
+    Assert(driver->driver.methods == &hvaultModisSwathMethods);
+    MemoryContextReset(driver->chunkmemctx);
+    oldmemctx = MemoryContextSwitchTo(driver->chunkmemctx);
+
+    if (driver->next_line != (size_t) -1)
+    {
+        /* Geolocation was prepared while previous chunk was processed */
+        Assert(driver->next_line == driver->cur_line);
+        hvaultWorkersWait(driver->workers);
+        driver->cur_geo ^= 1;
+        driver->next_line = (size_t) -1;
+        driver->chunk_line = driver->cur_line;
+        storeGeolocation(driver, driver->geo + driver->cur_geo);
+        writeSidecarChunk(driver, driver->geo + driver->cur_geo);
+    }
+    else
+    {
+        /* Skip chunks that are far from region of interest */
+        skipChunks(driver);
+
+        if (driver->cur_line >= driver->num_lines)
+        {
+            chunk->size = 0;
+            MemoryContextSwitchTo(oldmemctx);
+            return;
+        }
+
+        /* 
+         * Only geolocation is read here, data layers are read by 
+         * hvaultModisSwathReadData if any pixel of the chunk passes 
+         * predicates
+         */
+        driver->chunk_line = driver->cur_line;
+        if (driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT))
+        {
+            prepareGeolocation(driver, driver->geo + driver->cur_geo, false);
+            storeGeolocation(driver, driver->geo + driver->cur_geo);
+            writeSidecarChunk(driver, driver->geo + driver->cur_geo);
         }
     }
 
+    geo = driver->geo + driver->cur_geo;
+    chunk->const_layers = NIL;
+    chunk->layers = NIL;
+    chunk->lat = geo->lat_data;
+    chunk->lon = geo->lon_data;
+    chunk->point_lat = geo->point_lat;
+    chunk->point_lon = geo->point_lon;
+    chunk->stride = driver->num_samples;
+    chunk->size = driver->num_samples * driver->scanline_size;
+    chunk->offset = driver->cur_line * driver->num_samples;
+
     driver->cur_line += driver->scanline_size;    
+    if (driver->workers != NULL && 
+        (driver->flags & (FLAG_HAS_FOOTPRINT | FLAG_HAS_POINT)))
+    {
+        prefetchGeolocation(driver);
+    }
+    MemoryContextSwitchTo(oldmemctx);
+}
+
+static void 
+hvaultModisSwathReadData (HvaultFileDriver * drv,
+                          HvaultFileChunk  * chunk,
+                          size_t             first_sample,
+                          size_t             num_samples)
+{
+    HvaultModisSwathDriver * driver = (HvaultModisSwathDriver *) drv;
+    MemoryContext oldmemctx;
+    ListCell *l;
+
+    Assert(driver->driver.methods == &hvaultModisSwathMethods);
+    oldmemctx = MemoryContextSwitchTo(driver->chunkmemctx);
+
+    chunk->layers = NIL;
+    foreach(l, driver->layers)
+    {
+        HvaultModisSwathLayer *layer = lfirst(l);
+
+        /* We don't need to pass geolocation data as layers */
+        if (layer == driver->lat_layer || layer == driver->lon_layer)
+            continue;
+
+        if (layer->leader == NULL)
+        {
+            readLayer(driver, layer, first_sample, num_samples);
+        }
+        else
+        {
+            if (layer->leader == layer)
+                readGroup(driver, layer, first_sample, num_samples);
+            setGroupView(driver, layer);
+        }
+        if (layer->sds_id != FAIL && layer->layer.colnum >= 0)
+            chunk->layers = lappend(chunk->layers, layer);
+    }
+
     MemoryContextSwitchTo(oldmemctx);
 }
 
@@ -1081,7 +2688,9 @@ const HvaultFileDriverMethods hvaultModisSwathMethods =
     hvaultModisSwathInit,
     hvaultModisSwathAddColumn,
     hvaultModisSwathOpen,
+    hvaultModisSwathFiles,
     hvaultModisSwathRead,
+    hvaultModisSwathReadData,
     hvaultModisSwathClose,
     hvaultModisSwathFree
 };
@@ -1,12 +1,44 @@
 #include "common.h"
+#include <access/hash.h>
 #include "catalog.h"
 #include "driver.h"
+#include "iosched.h"
+#include "locality.h"
 #include "predicates.h"
 #include "options.h"
+#include "readahead.h"
+#include "shmem.h"
+#include "syncscan.h"
+
+#if PG_VERSION_NUM >= 90600
+#include <access/parallel.h>
+#include <port/atomics.h>
+#endif
+#if PG_VERSION_NUM >= 140000
+#include <executor/execAsync.h>
+#include <storage/latch.h>
+#endif
+
+/* Expressions are compiled since 10, and qual is a single ExprState */
+#if PG_VERSION_NUM >= 100000
+#define evalExpr(expr, econtext, isnull) ExecEvalExpr(expr, econtext, isnull)
+#define checkQual(qual, econtext) ExecQual(qual, econtext)
+#else
+#define evalExpr(expr, econtext, isnull) \
+    ExecEvalExpr(expr, econtext, isnull, NULL)
+#define checkQual(qual, econtext) ExecQual(qual, econtext, false)
+#endif
+
+#if PG_VERSION_NUM >= 110000
+#define get_relid_attribute_name(relid, attnum) \
+    get_attname(relid, attnum, false)
+#endif
 
 typedef struct 
 {
-    HvaultPredicate pred;
+    HvaultColumnType coltype;
+    HvaultGeomOperator op;
+    bool isneg;
     AttrNumber argno;
 } Predicate;
 
@@ -17,6 +49,29 @@ typedef struct
     AttrNumber attno;
 } CatalogColumn;
 
+typedef struct
+{
+    double dist;
+    HeapTuple tuple;
+} NearestItem;
+
+#if PG_VERSION_NUM >= 90600
+/* 
+ * Shared state of parallel scan. Every participant runs the same catalog 
+ * query ordered by catalog key and processes only records it has claimed.
+ */
+typedef struct
+{
+    pg_atomic_uint32 next_record;   /* Number of claimed records */
+} ParallelScanState;
+#endif
+
+/* Since PostGIS 2.2 <-> returns true distance instead of centroid one */
+#if LIBLWGEOM_VERSION_MAJOR_INT > 2 || \
+    (LIBLWGEOM_VERSION_MAJOR_INT == 2 && LIBLWGEOM_VERSION_MINOR_INT >= 2)
+#define NEAREST_TRUE_DISTANCE
+#endif
+
 typedef struct 
 {
     MemoryContext memctx;
@@ -28,14 +83,53 @@ typedef struct
     HvaultGeolocationType geotype;
     HvaultFileChunk chunk;
     AttrNumber col_indices[HvaultColumnNumTypes];
+    List * copy_columns;   /* pairs of (from, to) duplicate special columns */
     List * catalog_columns;
 
-    Predicate * predicates; /* NULL-terminated array of Predicates */
+    Predicate * predicates;
+    size_t num_predicates;
+    HvaultPredicates engine;    /* Predicates with evaluated arguments */
+    bool predicates_ready;      /* Arguments are evaluated for this scan */
     size_t * sel;
     size_t sel_size, sel_bufsize, cur_pos, chunk_start;
+    GBOX region;                /* Region of interest passed to driver */
 
     size_t nattr;
 
+    /* ORDER BY point <-> arg LIMIT k */
+    AttrNumber nearest_argno;   /* -1 if scan is not ordered */
+    size_t nearest_limit;
+    NearestItem * nearest;      /* max-heap of k nearest tuples */
+    size_t nearest_size, nearest_pos;
+    bool nearest_ready;         /* heap is filled and sorted */
+    GBOX nearest_box;           /* lower bound box for distance */
+    LWGEOM * nearest_geom;      /* argument for exact distance or NULL */
+    bool nearest_argnull;
+    MemoryContext nearest_memctx;  /* per candidate tuple context */
+    ExprContext * nearest_expr_ctx; /* context for qual evaluation */
+
+    /* Asynchronous execution and prefetch */
+    HvaultReadahead readahead;  /* NULL if scan doesn't load files ahead */
+    bool async;                 /* Scan gives way to other Append branches */
+    int prefetch;               /* Number of records loaded in advance */
+    bool file_pending;          /* Files of fetched catalog record are loading */
+    bool async_waiting;         /* Scan stopped until files are loaded */
+    HvaultIOTicket io_ticket;   /* Admission to devices of current files */
+
+    /* Synchronized scan */
+    bool sync_scan;             /* Scan starts where others of query are */
+    uint32 sync_key;            /* Hash of catalog query and parameters */
+    uint32 sync_start;          /* Record the scan started from */
+    uint32 sync_record;         /* Number of records fetched in this pass */
+    bool sync_wrapped;          /* Cursor was restarted from first record */
+
+#if PG_VERSION_NUM >= 90600
+    /* Parallel scan */
+    ParallelScanState * pscan;  /* NULL if granules are not shared */
+    uint32 record;              /* Number of fetched catalog records */
+    uint32 claimed;             /* Number of last claimed record */
+#endif
+
     /* tuple values */
     Datum *values;       /* Tuple values */
     bool *nulls;         /* Tuple null flags */
@@ -56,6 +150,7 @@ makeExecState ()
     {
         state->col_indices[i] = -1;
     }
+    state->nearest_argno = -1;
 
     state->point = lwpoint_make2d(SRID_UNKNOWN, 0, 0);
     state->ptarray = ptarray_construct(false, false, 5);
@@ -66,13 +161,11 @@ makeExecState ()
 }
 
 static void 
-addCatalogColumn (ExecState * state, Relation rel, int i) 
+addCatalogColumn (ExecState * state, List * options, Oid typid, int i) 
 {
-    List * options;
     CatalogColumn * coldata;
     DefElem * name;
 
-    options = GetForeignColumnOptions(RelationGetRelid(rel), i + 1);
     name = defFindByName(options, HVAULT_COLUMN_OPTION_CATNAME);
     if (name == NULL) 
     {
@@ -83,21 +176,32 @@ addCatalogColumn (ExecState * state, Relation rel, int i)
     coldata = palloc(sizeof(CatalogColumn));
     coldata->attno = i;
     coldata->cat_name = defGetString(name);
-    coldata->typid = RelationGetDescr(rel)->attrs[i]->atttypid;
+    coldata->typid = typid;
     state->catalog_columns = lappend(state->catalog_columns, coldata);
 }
 
+/* Sort key of catalog record for locality ordering */
+static void *
+localityKey (HvaultCatalogItem const * item, void * arg)
+{
+    HvaultFileDriver * driver = arg;
+
+    return hvaultGetLocality(driver->methods->files(driver, item));
+}
+
 void 
 hvaultBegin (ForeignScanState * node, int eflags)
 {
     ExecState * state;
     ForeignScan * const plan = (ForeignScan *) node->ss.ps.plan;
-    Relation const rel = node->ss.ss_currentRelation;
+    TupleDesc const tupdesc = node->ss.ss_ScanTupleSlot->tts_tupleDescriptor;
     ListCell *l;
-    List *packed_query, *packed_predicates, *coltypes;
+    List *packed_query, *packed_predicates, *coltypes, *ordering;
+    List *join_reloids, *join_attnos;
     int i;
     Oid foreigntableid;
     ForeignTable *foreigntable;
+    DefElem *def;
 
     if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
         return;
@@ -117,10 +221,18 @@ hvaultBegin (ForeignScanState * node, int eflags)
                                   ExecInitExpr(expr, &node->ss.ps));
     }
 
-    Assert(list_length(plan->fdw_private) == 3);
+    Assert(list_length(plan->fdw_private) == 6);
     packed_query = linitial(plan->fdw_private);
     packed_predicates = lsecond(plan->fdw_private);
     coltypes = lthird(plan->fdw_private);
+    ordering = lfourth(plan->fdw_private);
+    join_reloids = join_attnos = NIL;
+    if (list_nth(plan->fdw_private, 4) != NIL)
+    {
+        /* Pushed down join, columns come from different tables */
+        join_reloids = linitial(list_nth(plan->fdw_private, 4));
+        join_attnos = lsecond(list_nth(plan->fdw_private, 4));
+    }
 
     state->nattr = list_length(coltypes);
     state->values = palloc(sizeof(Datum) * state->nattr);
@@ -128,69 +240,219 @@ hvaultBegin (ForeignScanState * node, int eflags)
 
     state->cursor = hvaultCatalogInitCursor(packed_query, state->memctx);
     
-    foreigntableid = RelationGetRelid(rel);
+    if (join_reloids != NIL)
+        foreigntableid = linitial_oid(join_reloids);
+    else
+        foreigntableid = RelationGetRelid(node->ss.ss_currentRelation);
     foreigntable = GetForeignTable(foreigntableid);
     state->driver = hvaultGetDriver(foreigntable->options, state->memctx);
     state->geotype = state->driver->geotype;
 
+    def = defFindByName(foreigntable->options, HVAULT_TABLE_OPTION_PREFETCH);
+    state->prefetch = def != NULL ? defGetInt(def) : 0;
+#if PG_VERSION_NUM >= 90600
+    /* Next records may be claimed by other participants */
+    if (plan->scan.plan.parallel_aware)
+        state->prefetch = 0;
+#endif
+#if PG_VERSION_NUM < 90500
+    /* Read-ahead thread can't be stopped on abort */
+    state->prefetch = 0;
+#endif
+    hvaultCatalogSetLookahead(state->cursor, state->prefetch);
+
+    /* Several instances may share granules of the catalog */
+    {
+        char const * key, * queue;
+
+        def = defFindByName(foreigntable->options, 
+                            HVAULT_TABLE_OPTION_CATALOG_KEY);
+        key = def != NULL ? defGetString(def) : HVAULT_DEFAULT_CATALOG_KEY;
+        /* GUCs may be set in any order, so they are checked together here */
+        if (hvaultShardIndex >= hvaultShardCount)
+        {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("hvault.shard_index %d is out of range "
+                                   "for hvault.shard_count %d", 
+                                   hvaultShardIndex, hvaultShardCount),
+                            errhint("Shard index must be less than shard "
+                                    "count")));
+        }
+        if (hvaultShardCount > 1)
+        {
+            hvaultCatalogSetShard(state->cursor, key, 
+                                  hvaultShardIndex, hvaultShardCount);
+        }
+        def = defFindByName(foreigntable->options, 
+                            HVAULT_TABLE_OPTION_WORK_QUEUE);
+        queue = def != NULL ? defGetString(def) : NULL;
+        if (queue != NULL)
+            hvaultCatalogSetWorkQueue(state->cursor, key, queue);
+    }
+
     i = 0;
     foreach(l, coltypes)
     {
         HvaultColumnType type = lfirst_int(l);
+        List * options;
+
+        if (join_reloids != NIL)
+        {
+            options = GetForeignColumnOptions(list_nth_oid(join_reloids, i),
+                                              list_nth_int(join_attnos, i));
+        }
+        else
+        {
+            options = GetForeignColumnOptions(foreigntableid, i+1);
+        }
+
         if (type >= HvaultColumnIndex && type <= HvaultColumnPoint)
         {
-            if (state->col_indices[type] != -1)
+            if (state->col_indices[type] == -1)
+            {
+                state->col_indices[type] = i;
+            }
+            else if (join_reloids != NIL)
+            {
+                /* Both joined tables have this column */
+                state->copy_columns = lappend_int(state->copy_columns, 
+                                                  state->col_indices[type]);
+                state->copy_columns = lappend_int(state->copy_columns, i);
+            }
+            else
             {
                 /* TODO: better message */
                 ereport(ERROR, (errcode(ERRCODE_FDW_ERROR), 
                                 errmsg("Duplicate special column"),
                                 errhint("Check hvault table definition")));
             }
-            state->col_indices[type] = i;
         }
 
         if (type == HvaultColumnCatalog)
-            addCatalogColumn(state, rel, i);
+            addCatalogColumn(state, options,
+                             TupleDescAttr(tupdesc, i)->atttypid, i);
 
         if (type >= HvaultColumnFootprint && type <= HvaultColumnDataset)
         {
-            Form_pg_attribute attr = RelationGetDescr(rel)->attrs[i];
-            state->driver->methods->add_column(state->driver, attr,
-                GetForeignColumnOptions(foreigntableid, i+1));
+            Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+            state->driver->methods->add_column(state->driver, attr, options);
         }
 
         i++;
     }
 
     /* Predicate initialization */
-    state->predicates = palloc(sizeof(Predicate) * 
-                               (list_length(packed_predicates) + 1));
+    state->engine = hvaultPredicatesInit(state->geotype, state->memctx);
+    state->num_predicates = list_length(packed_predicates);
+    state->predicates = palloc(sizeof(Predicate) * state->num_predicates);
     i = 0;
     foreach(l, packed_predicates)
     {
-        List * pred = lfirst(l);
-        HvaultColumnType coltype;
-        HvaultGeomOperator op;
-        AttrNumber argno;
-        bool isneg;
+        Predicate * pred = state->predicates + i;
 
-        hvaultUnpackPredicate(pred, &coltype, &op, &argno, &isneg);
-        state->predicates[i].argno = argno;
-        state->predicates[i].pred = hvaultGetPredicate(op, isneg, coltype, 
-                                                       state->geotype);
-        if (pred == NULL)
+        hvaultUnpackPredicate(lfirst(l), &pred->coltype, &pred->op, 
+                              &pred->argno, &pred->isneg);
+        if (!hvaultPredicatesSupported(state->engine, pred->coltype))
         {
-            elog(ERROR, "Unknown predicate type: %d %d %d %d", op, isneg, 
-                 coltype, state->geotype);
+            elog(ERROR, "Unknown predicate type: %d %d %d %d", pred->op, 
+                 pred->isneg, pred->coltype, state->geotype);
             return; /* Will never reach this */
         }
         i++;
     }
-    state->predicates[i].pred = NULL;
+
+    if (ordering != NIL)
+    {
+        state->nearest_argno = linitial_int(ordering);
+        state->nearest_limit = lsecond_int(ordering);
+        state->nearest = MemoryContextAlloc(state->memctx, 
+            sizeof(NearestItem) * state->nearest_limit);
+        state->nearest_memctx = AllocSetContextCreate(state->memctx,
+                                                      "hvault nearest context",
+                                                      ALLOCSET_SMALL_MINSIZE,
+                                                      ALLOCSET_SMALL_INITSIZE,
+                                                      ALLOCSET_SMALL_MAXSIZE);
+        state->nearest_expr_ctx = CreateExprContext(node->ss.ps.state);
+    }
+
+#if PG_VERSION_NUM >= 140000
+    /* 
+     * Async scan under Append loads granule files in background and gives 
+     * way to other branches meanwhile.
+     */
+    state->async = node->ss.ps.async_capable && state->nearest_argno < 0 &&
+                   !plan->scan.plan.parallel_aware;
+#endif
+#if PG_VERSION_NUM >= 90500
+    /* 
+     * Files of the next records are loaded while current one is processed.
+     * Thread is stopped by memory context callback on abort.
+     */
+    if (state->async || state->prefetch > 0)
+        state->readahead = hvaultReadaheadInit(state->memctx);
+#endif
+    state->async = state->async && state->readahead != NULL;
+
+    /* 
+     * Records are skipped by position, so the query must be ordered by 
+     * catalog key. Parallel participants must see records in the same order.
+     */
+    state->sync_scan = hvaultSynchronizeScans && hvaultShmemReady() &&
+                       intVal(list_nth(plan->fdw_private, 5)) &&
+                       state->nearest_argno < 0;
+#if PG_VERSION_NUM >= 90600
+    state->sync_scan = state->sync_scan && !plan->scan.plan.parallel_aware;
+#endif
+
+    /* 
+     * Catalog order is arbitrary unless parallel participants share it, so 
+     * cached granules may go first and others follow their disk location.
+     */
+    def = defFindByName(foreigntable->options, 
+                        HVAULT_TABLE_OPTION_LOCALITY_ORDER);
+    if (def != NULL && defGetBoolean(def))
+    {
+#if PG_VERSION_NUM >= 90600
+        if (!plan->scan.plan.parallel_aware)
+#endif
+        {
+            hvaultCatalogSetReorder(state->cursor, localityKey, 
+                                    hvaultCompareLocality, state->driver);
+            /* Scan position depends on page cache state of this backend */
+            state->sync_scan = false;
+        }
+    }
 
     node->fdw_state = state;
 }
 
+static void
+resetNearest (ExecState *state)
+{
+    size_t i;
+    
+    for (i = 0; i < state->nearest_size; i++)
+        heap_freetuple(state->nearest[i].tuple);
+
+    if (state->nearest_geom != NULL)
+    {
+        lwgeom_free(state->nearest_geom);
+        state->nearest_geom = NULL;
+    }
+
+    state->nearest_size = 0;
+    state->nearest_pos = 0;
+    state->nearest_ready = false;
+}
+
+/* Lets other backends read devices of current files */
+static void
+releaseIO (ExecState *state)
+{
+    hvaultIORelease(state->io_ticket);
+    state->io_ticket = NULL;
+}
+
 void 
 hvaultReScan(ForeignScanState *node)
 {
@@ -206,6 +468,25 @@ hvaultReScan(ForeignScanState *node)
     if (state->cursor)
         hvaultCatlogResetCursor(state->cursor);
 
+    if (state->readahead)
+        hvaultReadaheadCancel(state->readahead);
+    state->file_pending = false;
+    releaseIO(state);
+
+    if (state->nearest_argno >= 0)
+        resetNearest(state);
+
+    state->sync_start = 0;
+    state->sync_record = 0;
+    state->sync_wrapped = false;
+
+#if PG_VERSION_NUM >= 90600
+    state->record = 0;
+    state->claimed = 0;
+#endif
+
+    /* Parameters may change, so predicate arguments need reevaluation */
+    state->predicates_ready = false;
     state->sel_size = 0;
     state->cur_pos = 0;
 }
@@ -219,20 +500,61 @@ hvaultEnd(ForeignScanState *node)
     if (state == NULL)
         return;
 
+    if (state->readahead)
+        hvaultReadaheadFree(state->readahead);
+
+    releaseIO(state);
+
     if (state->driver) 
         state->driver->methods->free(state->driver);
 
     if (state->cursor)
         hvaultCatalogFreeCursor(state->cursor);
 
+    if (state->nearest_expr_ctx)
+        FreeExprContext(state->nearest_expr_ctx, true);
+
     MemoryContextDelete(state->memctx);
 }
 
+/* Hashes catalog query and its parameters to identify concurrent scans */
+static uint32
+syncScanKey (ExecState *state, 
+             int        nargs, 
+             Oid *      argtypes, 
+             Datum *    argvals, 
+             char *     argnulls)
+{
+    StringInfoData buf;
+    uint32 key;
+    int i;
+
+    initStringInfo(&buf);
+    appendStringInfo(&buf, "%u %s", MyDatabaseId, 
+                     hvaultCatalogGetQuery(state->cursor));
+    for (i = 0; i < nargs; i++)
+    {
+        Oid typoutput;
+        bool typisvarlena;
+
+        if (argnulls[i] == 'n')
+        {
+            appendStringInfoString(&buf, " NULL");
+            continue;
+        }
+        getTypeOutputInfo(argtypes[i], &typoutput, &typisvarlena);
+        appendStringInfo(&buf, " '%s'", 
+                         OidOutputFunctionCall(typoutput, argvals[i]));
+    }
+    key = DatumGetUInt32(hash_any((unsigned char *) buf.data, buf.len));
+    pfree(buf.data);
+    return key;
+}
+
 static bool 
-fetchNextFile (ExecState *state)
+nextCatalogRecord (ExecState *state)
 {
     HvaultCatalogCursorResult res;
-    HvaultCatalogItem const * products;
 
     Assert(state->cursor);
     res = hvaultCatalogNext(state->cursor);
@@ -251,7 +573,9 @@ fetchNextFile (ExecState *state)
 
         Assert(list_length(state->fdw_expr) >= nargs);
         fdw_expr = list_head(state->fdw_expr);
-        for (pos = 0; pos < nargs; pos++, fdw_expr = lnext(fdw_expr)) 
+        for (pos = 0;
+             pos < nargs;
+             pos++, fdw_expr = listNext(state->fdw_expr, fdw_expr))
         {
             ExprState *expr;
             bool isnull;   
@@ -259,12 +583,18 @@ fetchNextFile (ExecState *state)
             Assert(fdw_expr);
             expr = (ExprState *) lfirst(fdw_expr);
             Assert(IsA(expr, ExprState));
-            argvals[pos] = ExecEvalExpr(expr, state->expr_ctx, &isnull, NULL);
+            argvals[pos] = evalExpr(expr, state->expr_ctx, &isnull);
             argnulls[pos] = isnull ? 'n' : ' ';
             argtypes[pos] = exprType((Node *) expr->expr);
         }
 
         hvaultCatalogStartCursor(state->cursor, argtypes, argvals, argnulls);
+        if (state->sync_scan && !state->sync_wrapped)
+        {
+            state->sync_key = syncScanKey(state, nargs, argtypes, argvals, 
+                                          argnulls);
+            state->sync_start = hvaultSyncScanGetLocation(state->sync_key);
+        }
 
         pfree(argtypes);
         pfree(argvals);
@@ -286,9 +616,135 @@ fetchNextFile (ExecState *state)
                             errmsg("Unexpected cursor retval %d", res)));
             return false; /* Will never reach this */                
     }
+    return true;
+}
+
+/* 
+ * Synchronized scan starts from the record read by concurrent scan of the 
+ * same query and continues from the first record after the last one.
+ */
+static bool
+nextSyncRecord (ExecState *state)
+{
+    if (!state->sync_scan)
+        return nextCatalogRecord(state);
+
+    for (;;)
+    {
+        if (!nextCatalogRecord(state))
+        {
+            if (state->sync_wrapped || state->sync_start == 0)
+                return false;
+
+            /* Catalog may be shorter than reported location */
+            state->sync_start = Min(state->sync_start, state->sync_record);
+            state->sync_record = 0;
+            state->sync_wrapped = true;
+            hvaultCatlogResetCursor(state->cursor);
+            continue;
+        }
+
+        state->sync_record++;
+        if (state->sync_wrapped)
+        {
+            if (state->sync_record > state->sync_start)
+                return false;
+        }
+        else if (state->sync_record <= state->sync_start)
+        {
+            continue;
+        }
+        hvaultSyncScanReport(state->sync_key, state->sync_record - 1);
+        return true;
+    }
+}
+
+#if PG_VERSION_NUM >= 90600
+/* Checks whether current catalog record is claimed by this participant */
+static bool
+claimRecord (ExecState *state)
+{
+    state->record++;
+    if (state->claimed < state->record)
+    {
+        state->claimed = 
+            pg_atomic_fetch_add_u32(&state->pscan->next_record, 1) + 1;
+    }
+    return state->claimed == state->record;
+}
+#endif
+
+static bool 
+fetchNextRecord (ExecState *state)
+{
+    while (nextSyncRecord(state))
+    {
+        if (!hvaultCatalogClaimRecord(state->cursor))
+            continue;
+#if PG_VERSION_NUM >= 90600
+        if (state->pscan != NULL && !claimRecord(state))
+            continue;
+#endif
+        return true;
+    }
+    return false;
+}
+
+/* 
+ * Opens files of the next catalog record. In async mode returns false with
+ * async_waiting set if the files are still being loaded.
+ */
+static bool 
+fetchNextFile (ExecState *state)
+{
+    HvaultCatalogItem const * products;
+
+    if (!state->file_pending)
+    {
+        releaseIO(state);
+        if (!fetchNextRecord(state))
+            return false;
+
+        if (state->async)
+        {
+            products = hvaultCatalogGetValues(state->cursor);
+            hvaultReadaheadStart(state->readahead, 
+                state->driver->methods->files(state->driver, products));
+            state->file_pending = true;
+        }
+    }
+
+    if (state->file_pending)
+    {
+        if (!hvaultReadaheadReady(state->readahead))
+        {
+            state->async_waiting = true;
+            return false;
+        }
+        state->file_pending = false;
+    }
+
     products = hvaultCatalogGetValues(state->cursor);
+    releaseIO(state);
+    {
+        MemoryContext oldmemctx = MemoryContextSwitchTo(state->memctx);
+        state->io_ticket = hvaultIOAcquire(
+            state->driver->methods->files(state->driver, products));
+        MemoryContextSwitchTo(oldmemctx);
+    }
     state->driver->methods->open(state->driver, products);
     state->chunk_start = 0;
+
+    if (state->readahead && state->prefetch > 0)
+    {
+        List * files = NIL;
+        ListCell * l;
+
+        foreach(l, hvaultCatalogGetLookahead(state->cursor))
+            files = list_concat(files, 
+                state->driver->methods->files(state->driver, lfirst(l)));
+        hvaultReadaheadStart(state->readahead, files);
+    }
     return true;
 }
 
@@ -340,35 +796,16 @@ nextChunkNeeded (ExecState *state)
     return state->cur_pos == state->sel_size;
 }
 
-static bool
-fetchNextChunk (ExecState *state)
-{
-    state->chunk_start += state->chunk.size;
-    state->driver->methods->read(state->driver, &state->chunk);
-    state->sel_size = state->chunk.size;
-    state->cur_pos = 0;
-    return state->chunk.size != 0;
-}
-
+/* Evaluates predicate arguments once per scan */
 static void
-calculatePredicates (ExecState *state)
+preparePredicates (ExecState *state)
 {
-    Predicate *pred;
-    /*Allocate buffer if necessary */
-    if (state->sel_bufsize < state->chunk.size) 
-    {
-        MemoryContext oldmemctx = MemoryContextSwitchTo(state->memctx);
-        if (state->sel != NULL)
-            pfree(state->sel);
-        state->sel = palloc(state->chunk.size * sizeof(size_t));
-        MemoryContextSwitchTo(oldmemctx);
-    }
+    size_t i;
 
-    state->sel_size = state->chunk.size;
-    /*Call predicates one by one */
-    pred = state->predicates;
-    while (pred->pred != NULL)
+    hvaultPredicatesReset(state->engine);
+    for (i = 0; i < state->num_predicates; i++)
     {
+        Predicate * const pred = state->predicates + i;
         ExprState *expr;
         bool isnull;
         Datum argdatum;
@@ -376,11 +813,12 @@ calculatePredicates (ExecState *state)
         GBOX arg;
 
         expr = list_nth(state->fdw_expr, pred->argno);
-        argdatum = ExecEvalExpr(expr, state->expr_ctx, &isnull, NULL);
+        argdatum = evalExpr(expr, state->expr_ctx, &isnull);
         if (isnull) 
         {
-            state->sel_size = 0;
-            break;
+            hvaultPredicatesAdd(state->engine, pred->coltype, pred->op, 
+                                pred->isneg, NULL);
+            continue;
         }
         arggeom = (GSERIALIZED*) PG_DETOAST_DATUM(argdatum);
         if (gserialized_get_gbox_p(arggeom, &arg) == LW_FAILURE)
@@ -390,13 +828,50 @@ calculatePredicates (ExecState *state)
             return; /* Will never reach here */
         }
 
-        state->sel_size = pred->pred(state->sel, state->sel_size, 
-                                     &state->chunk, &arg);
-        if (state->sel_size == 0)
-            break;
+        hvaultPredicatesAdd(state->engine, pred->coltype, pred->op, 
+                            pred->isneg, &arg);
+    }
+
+    if (hvaultPredicatesGetRegion(state->engine, &state->region))
+        state->driver->region = &state->region;
+    else
+        state->driver->region = NULL;
+    state->predicates_ready = true;
+}
+
+static bool
+fetchNextChunk (ExecState *state)
+{
+    /* Driver skips chunks outside of the region of predicates */
+    if (state->engine != NULL && !state->predicates_ready)
+        preparePredicates(state);
+
+    state->driver->methods->read(state->driver, &state->chunk);
+    state->chunk_start = state->chunk.offset;
+    state->sel_size = state->chunk.size;
+    state->cur_pos = 0;
+    return state->chunk.size != 0;
+}
 
-        pred++;
+static void
+calculatePredicates (ExecState *state)
+{
+    /*Allocate buffer if necessary */
+    if (state->sel_bufsize < state->chunk.size) 
+    {
+        MemoryContext oldmemctx = MemoryContextSwitchTo(state->memctx);
+        if (state->sel != NULL)
+            pfree(state->sel);
+        state->sel = palloc(state->chunk.size * sizeof(size_t));
+        state->sel_bufsize = state->chunk.size;
+        MemoryContextSwitchTo(oldmemctx);
     }
+
+    if (!state->predicates_ready)
+        preparePredicates(state);
+
+    state->sel_size = hvaultPredicatesEval(state->engine, &state->chunk, 
+                                           state->sel);
 }
 
 static inline void 
@@ -501,11 +976,50 @@ fillOneColumn (ExecState * state, HvaultFileLayer const * layer, size_t idx)
 #undef typedFill
 }
 
+/* Finds range of samples containing all selected pixels */
+static void
+selectedSamples (ExecState *state, size_t *first_sample, size_t *num_samples)
+{
+    size_t const line = state->chunk.stride;
+    size_t i, lo, hi;
+
+    if (state->sel_size == state->chunk.size)
+    {
+        *first_sample = 0;
+        *num_samples = line;
+        return;
+    }
+
+    Assert(state->sel_size > 0);
+    lo = line - 1;
+    hi = 0;
+    for (i = 0; i < state->sel_size && (lo > 0 || hi < line - 1); i++)
+    {
+        size_t const sample = state->sel[i] % line;
+        if (sample < lo)
+            lo = sample;
+        if (sample > hi)
+            hi = sample;
+    }
+    *first_sample = lo;
+    *num_samples = hi - lo + 1;
+}
+
 static void
 fillChunkColumns (ExecState *state)
 {
-    /* Calculate const dataset values */
     ListCell * l;
+    size_t first_sample, num_samples;
+
+    /* 
+     * Data layers are read only for chunks with selected pixels and only in
+     * the window of samples covering selection
+     */
+    selectedSamples(state, &first_sample, &num_samples);
+    state->driver->methods->read_data(state->driver, &state->chunk,
+                                      first_sample, num_samples);
+
+    /* Calculate const dataset values */
     foreach(l, state->chunk.const_layers)
     {
         HvaultFileLayer * layer = lfirst(l);
@@ -518,7 +1032,7 @@ static void
 fillPixelColumns (ExecState *state)
 {
     ListCell *l;
-    size_t cur_idx;
+    size_t cur_idx, line, sample;
 
     if (state->sel_size != state->chunk.size)
         cur_idx = state->sel[state->cur_pos];
@@ -634,6 +1148,9 @@ fillPixelColumns (ExecState *state)
         }
     }
 
+    /* Layers contain only window of samples */
+    line = cur_idx / state->chunk.stride;
+    sample = cur_idx % state->chunk.stride;
     foreach(l, state->chunk.layers)
     {
         HvaultFileLayer * layer = lfirst(l);
@@ -641,16 +1158,11 @@ fillPixelColumns (ExecState *state)
         switch (layer->type)
         {
             case HvaultLayerSimple:
-                idx = cur_idx;
+                idx = line * layer->line_size + sample - layer->sample_offset;
                 break;
             case HvaultLayerChunked:
-            {
-                size_t line = state->chunk.stride;
-                size_t vfactor = layer->vfactor;
-                size_t hfactor = layer->hfactor;
-                idx = cur_idx;
-                idx = ((idx / line) / vfactor * line + idx % line ) / hfactor;
-            }
+                idx = line / layer->vfactor * layer->line_size 
+                    + sample / layer->hfactor - layer->sample_offset;
                 break;
             default:
                 elog(ERROR, "Layer type is not supported");
@@ -658,6 +1170,17 @@ fillPixelColumns (ExecState *state)
         }
         fillOneColumn(state, layer, idx);
     }
+
+    /* Duplicate special columns of pushed down join */
+    for (l = list_head(state->copy_columns);
+         l != NULL;
+         l = listNext(state->copy_columns, listNext(state->copy_columns, l)))
+    {
+        int from = lfirst_int(l);
+        int to = lfirst_int(listNext(state->copy_columns, l));
+        state->values[to] = state->values[from];
+        state->nulls[to] = state->nulls[from];
+    }
 }
 
 static void 
@@ -666,13 +1189,296 @@ incrementPosition (ExecState *state)
     state->cur_pos++;
 }
 
+/* Evaluates ordering argument and prepares distance lower bound box */
+static void
+prepareNearest (ExecState *state)
+{
+    ExprState *expr;
+    bool isnull;
+    Datum argdatum;
+    GSERIALIZED * arggeom;
+    MemoryContext oldmemctx;
+
+    expr = list_nth(state->fdw_expr, state->nearest_argno);
+    argdatum = evalExpr(expr, state->expr_ctx, &isnull);
+    /* NULL distance is ordered after all others, so all tuples are equal */
+    state->nearest_argnull = isnull;
+    if (isnull)
+        return;
+
+    oldmemctx = MemoryContextSwitchTo(state->memctx);
+    arggeom = (GSERIALIZED*) PG_DETOAST_DATUM(argdatum);
+    if (gserialized_get_gbox_p(arggeom, &state->nearest_box) == LW_FAILURE)
+    {
+        /* Distance to empty geometry is NULL too */
+        state->nearest_argnull = true;
+        MemoryContextSwitchTo(oldmemctx);
+        return;
+    }
+
+#ifdef NEAREST_TRUE_DISTANCE
+    if (gserialized_get_type(arggeom) != POINTTYPE)
+    {
+        /* Distance to argument bbox is a lower bound for true distance */
+        state->nearest_geom = lwgeom_from_gserialized(arggeom);
+    }
+    else
+#endif
+    {
+        /* Distance between point and bbox centroid */
+        state->nearest_box.xmin = state->nearest_box.xmax = 
+            (state->nearest_box.xmin + state->nearest_box.xmax) / 2;
+        state->nearest_box.ymin = state->nearest_box.ymax = 
+            (state->nearest_box.ymin + state->nearest_box.ymax) / 2;
+    }
+    MemoryContextSwitchTo(oldmemctx);
+}
+
+static inline double
+boxDistance (GBOX const *box, 
+             double latmin, double latmax, double lonmin, double lonmax)
+{
+    double dx = 0, dy = 0;
+
+    if (lonmax < box->xmin) 
+        dx = box->xmin - lonmax;
+    else if (lonmin > box->xmax)
+        dx = lonmin - box->xmax;
+
+    if (latmax < box->ymin)
+        dy = box->ymin - latmax;
+    else if (latmin > box->ymax)
+        dy = latmin - box->ymax;
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+static inline bool
+isValidPoint (float lat, float lon)
+{
+    return !(lon > 360.0 || lon < -180.0 || lat > 90.0  || lat < -90.0);
+}
+
+/* Lower bound of the distance to any point in current chunk */
+static double
+chunkNearestDistance (ExecState const *state)
+{
+    float const * const lat = state->chunk.point_lat;
+    float const * const lon = state->chunk.point_lon;
+    float latmin = 90, latmax = -90, lonmin = 360, lonmax = -180;
+    bool found = false;
+    size_t i;
+
+    for (i = 0; i < state->chunk.size; i++)
+    {
+        if (!isValidPoint(lat[i], lon[i]))
+            continue;
+
+        found = true;
+        if (lat[i] < latmin) latmin = lat[i];
+        if (lat[i] > latmax) latmax = lat[i];
+        if (lon[i] < lonmin) lonmin = lon[i];
+        if (lon[i] > lonmax) lonmax = lon[i];
+    }
+
+    if (!found)
+        return get_float8_infinity();
+    
+    return boxDistance(&state->nearest_box, latmin, latmax, lonmin, lonmax);
+}
+
+static inline bool
+nearestFull (ExecState const *state)
+{
+    return state->nearest_size == state->nearest_limit;
+}
+
+/* Pushes tuple to the max-heap of nearest tuples. If heap is full, then 
+ * dist is expected to be less than current maximum */
+static void
+pushNearest (ExecState *state, double dist, HeapTuple tuple)
+{
+    NearestItem * const heap = state->nearest;
+    size_t const size = state->nearest_size;
+    size_t i;
+
+    if (!nearestFull(state))
+    {
+        /* sift up */
+        i = state->nearest_size++;
+        while (i > 0 && heap[(i-1)/2].dist < dist)
+        {
+            heap[i] = heap[(i-1)/2];
+            i = (i-1)/2;
+        }
+    }
+    else
+    {
+        /* replace root and sift down */
+        heap_freetuple(heap[0].tuple);
+        i = 0;
+        while (2*i + 1 < size)
+        {
+            size_t child = 2*i + 1;
+            if (child + 1 < size && heap[child + 1].dist > heap[child].dist)
+                child++;
+            if (heap[child].dist <= dist)
+                break;
+            heap[i] = heap[child];
+            i = child;
+        }
+    }
+    heap[i].dist = dist;
+    heap[i].tuple = tuple;
+}
+
+static int
+compareNearest (void const *a, void const *b)
+{
+    double const da = ((NearestItem const *) a)->dist;
+    double const db = ((NearestItem const *) b)->dist;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/* Adds selected pixels of current chunk to the heap of nearest tuples */
+static void
+processNearestChunk (ForeignScanState *node, ExecState *state)
+{
+    TupleTableSlot * const slot = node->ss.ss_ScanTupleSlot;
+    ExprContext * const econtext = state->nearest_expr_ctx;
+    float const * const lat = state->chunk.point_lat;
+    float const * const lon = state->chunk.point_lon;
+    bool const full_chunk = state->sel_size == state->chunk.size;
+    double const inf = get_float8_infinity();
+
+    for (state->cur_pos = 0; state->cur_pos < state->sel_size; 
+         state->cur_pos++)
+    {
+        size_t idx = full_chunk ? state->cur_pos : state->sel[state->cur_pos];
+        double dist;
+        MemoryContext oldmemctx;
+
+        if (state->nearest_argnull || !isValidPoint(lat[idx], lon[idx]))
+            dist = inf;
+        else
+            dist = boxDistance(&state->nearest_box, lat[idx], lat[idx], 
+                               lon[idx], lon[idx]);
+        
+        if (nearestFull(state) && dist >= state->nearest[0].dist)
+            continue;
+
+        oldmemctx = MemoryContextSwitchTo(state->nearest_memctx);
+        fillPixelColumns(state);
+
+        if (state->nearest_geom != NULL && dist != inf)
+        {
+            dist = lwgeom_mindistance2d((LWGEOM *) state->point, 
+                                        state->nearest_geom);
+            if (nearestFull(state) && dist >= state->nearest[0].dist)
+            {
+                MemoryContextSwitchTo(oldmemctx);
+                MemoryContextReset(state->nearest_memctx);
+                continue;
+            }
+        }
+
+        /* Check rest of the quals before adding tuple to the heap */
+        ExecClearTuple(slot);
+        slot->tts_isnull = state->nulls;
+        slot->tts_values = state->values;
+        ExecStoreVirtualTuple(slot);
+        ResetExprContext(econtext);
+        econtext->ecxt_scantuple = slot;
+        if (checkQual(node->ss.ps.qual, econtext))
+        {
+            HeapTuple tuple;
+
+            MemoryContextSwitchTo(state->memctx);
+            tuple = heap_form_tuple(slot->tts_tupleDescriptor, 
+                                    state->values, state->nulls);
+            pushNearest(state, dist, tuple);
+        }
+
+        MemoryContextSwitchTo(oldmemctx);
+        MemoryContextReset(state->nearest_memctx);
+    }
+}
+
+/* Returns tuples of ORDER BY point <-> arg LIMIT k scan */
+static TupleTableSlot *
+iterateNearest (ForeignScanState *node, ExecState *state)
+{
+    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+    if (!state->nearest_ready)
+    {
+        prepareNearest(state);
+        for (;;)
+        {
+            while (!fetchNextChunk(state))
+            {
+                if (!fetchNextFile(state))
+                    break;
+
+                fillAllColumnsWithNull(state);
+                fillCatalogColumns(state);
+            }
+            if (state->chunk.size == 0)
+                break;
+        
+            calculatePredicates(state);
+            if (state->sel_size == 0)
+                continue;
+
+            if (!state->nearest_argnull && nearestFull(state) && 
+                chunkNearestDistance(state) >= state->nearest[0].dist)
+            {
+                /* 
+                 * Chunk can't contain anything nearer than we already have,
+                 * so its data is not even read
+                 */
+                continue;
+            }
+
+            fillChunkColumns(state);
+            processNearestChunk(node, state);
+        }
+        /* Mark chunk as processed */
+        state->cur_pos = state->sel_size = 0;
+
+        qsort(state->nearest, state->nearest_size, sizeof(NearestItem), 
+              compareNearest);
+        state->nearest_ready = true;
+        state->nearest_pos = 0;
+        elog(DEBUG1, "Nearest scan collected %lu tuples", 
+             state->nearest_size);
+    }
+
+    ExecClearTuple(slot);
+    if (state->nearest_pos < state->nearest_size)
+    {
+#if PG_VERSION_NUM >= 120000
+        ExecStoreHeapTuple(state->nearest[state->nearest_pos++].tuple, slot,
+                           false);
+#else
+        ExecStoreTuple(state->nearest[state->nearest_pos++].tuple, slot, 
+                       InvalidBuffer, false);
+#endif
+    }
+    return slot;
+}
+
 TupleTableSlot *
 hvaultIterate (ForeignScanState *node) 
 {
     TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
     ExecState *state = node->fdw_state;
 
+    if (state->nearest_argno >= 0)
+        return iterateNearest(node, state);
+
     ExecClearTuple(slot);
+    state->async_waiting = false;
 
     while (nextChunkNeeded(state))
     {
@@ -685,8 +1491,9 @@ hvaultIterate (ForeignScanState *node)
             }
             else
             {
-                /* End of scan, return empty tuple*/
-                elog(DEBUG1, "End of scan: no more files");
+                /* End of scan or files are not loaded yet */
+                if (!state->async_waiting)
+                    elog(DEBUG1, "End of scan: no more files");
                 return slot;
             }
         }
@@ -709,11 +1516,106 @@ hvaultIterate (ForeignScanState *node)
     return slot;
 }
 
+#if PG_VERSION_NUM >= 140000
+/* Returns next tuple to Append or postpones request until files are loaded */
+static void
+produceTupleAsync (AsyncRequest *areq)
+{
+    ExecState *state = ((ForeignScanState *) areq->requestee)->fdw_state;
+    TupleTableSlot *result;
+
+    result = areq->requestee->ExecProcNodeReal(areq->requestee);
+    if (TupIsNull(result) && state->async_waiting)
+        ExecAsyncRequestPending(areq);
+    else
+        ExecAsyncRequestDone(areq, result);
+}
+
+void
+hvaultAsyncRequest (AsyncRequest *areq)
+{
+    produceTupleAsync(areq);
+}
+
+void
+hvaultAsyncConfigureWait (AsyncRequest *areq)
+{
+    ExecState *state = ((ForeignScanState *) areq->requestee)->fdw_state;
+    AppendState *requestor = (AppendState *) areq->requestor;
+
+    Assert(areq->callback_pending && state->async);
+    AddWaitEventToSet(requestor->as_eventset, WL_SOCKET_READABLE,
+                      hvaultReadaheadGetFd(state->readahead), NULL, areq);
+}
+
+void
+hvaultAsyncNotify (AsyncRequest *areq)
+{
+    produceTupleAsync(areq);
+}
+#endif
+
+#if PG_VERSION_NUM >= 90600
+/* 
+ * Parallel scan. Granules are distributed one by one, so that participants 
+ * finish at about the same time in spite of different granule sizes.
+ */
+bool
+hvaultIsParallelSafe (PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+{
+    /* Work queue is modified while granules are claimed */
+    return hvaultGetTableOption(rte->relid, 
+                                HVAULT_TABLE_OPTION_WORK_QUEUE) == NULL;
+}
+
+Size
+hvaultEstimateDSM (ForeignScanState *node, ParallelContext *pcxt)
+{
+    return sizeof(ParallelScanState);
+}
+
+void
+hvaultInitializeDSM (ForeignScanState *node, 
+                     ParallelContext  *pcxt, 
+                     void             *coordinate)
+{
+    ExecState *state = (ExecState *) node->fdw_state;
+    ParallelScanState *pscan = coordinate;
+
+    pg_atomic_init_u32(&pscan->next_record, 0);
+    if (state != NULL)
+        state->pscan = pscan;
+}
+
+#if PG_VERSION_NUM >= 100000
+void
+hvaultReInitializeDSM (ForeignScanState *node, 
+                       ParallelContext  *pcxt, 
+                       void             *coordinate)
+{
+    ParallelScanState *pscan = coordinate;
+
+    pg_atomic_write_u32(&pscan->next_record, 0);
+}
+#endif
+
+void
+hvaultInitializeWorker (ForeignScanState *node, 
+                        shm_toc          *toc, 
+                        void             *coordinate)
+{
+    ExecState *state = (ExecState *) node->fdw_state;
+
+    if (state != NULL)
+        state->pscan = coordinate;
+}
+#endif
+
 void 
 hvaultExplain(ForeignScanState *node, ExplainState *es)
 {
     ForeignScan *plan;
-    List *packed_query, *packed_predicates, *coltypes;
+    List *packed_query, *packed_predicates, *coltypes, *ordering;
     HvaultCatalogCursor cursor;
     List * active_columns;
     char const * query_str;
@@ -725,12 +1627,28 @@ hvaultExplain(ForeignScanState *node, ExplainState *es)
 
     plan = (ForeignScan *) node->ss.ps.plan;
 
-    Assert(list_length(plan->fdw_private) == 3);
+    Assert(list_length(plan->fdw_private) == 6);
     packed_query = linitial(plan->fdw_private);
     packed_predicates = lsecond(plan->fdw_private);
     coltypes = lthird(plan->fdw_private);
+    ordering = lfourth(plan->fdw_private);
+
+    if (list_nth(plan->fdw_private, 4) != NIL)
+    {
+        List * reloids = linitial(list_nth(plan->fdw_private, 4));
+        List * seen = NIL, * relnames = NIL;
+
+        foreach(l, reloids)
+        {
+            if (list_member_oid(seen, lfirst_oid(l)))
+                continue;
+            seen = lappend_oid(seen, lfirst_oid(l));
+            relnames = lappend(relnames, get_rel_name(lfirst_oid(l)));
+        }
+        ExplainPropertyList("Joined tables", relnames, es);
+    }
 
-    tupdesc = RelationGetDescr(node->ss.ss_currentRelation);
+    tupdesc = node->ss.ss_ScanTupleSlot->tts_tupleDescriptor;
     active_columns = NIL;
     i = 0;
     foreach(l, coltypes)
@@ -738,8 +1656,15 @@ hvaultExplain(ForeignScanState *node, ExplainState *es)
         HvaultColumnType coltype = lfirst_int(l);
         if (coltype != HvaultColumnNull)
         {
-            active_columns = lappend(active_columns, 
-                                     tupdesc->attrs[i]->attname.data);
+            char * name = NameStr(TupleDescAttr(tupdesc, i)->attname);
+            if (list_nth(plan->fdw_private, 4) != NIL)
+            {
+                List * source = list_nth(plan->fdw_private, 4);
+                name = get_relid_attribute_name(
+                    list_nth_oid(linitial(source), i), 
+                    list_nth_int(lsecond(source), i));
+            }
+            active_columns = lappend(active_columns, name);
         }
         i++;
     }
@@ -790,14 +1715,37 @@ hvaultExplain(ForeignScanState *node, ExplainState *es)
             appendStringInfo(&str, "$%d %s %s", 
                              argno+1, hvaultGeomopstr[op], colname);
         }
+
+        if (es->analyze && node->fdw_state != NULL)
+        {
+            ExecState *state = node->fdw_state;
+            uint64 tested, passed;
+
+            hvaultPredicatesGetStats(state->engine, list_length(pred_str), 
+                                     &tested, &passed);
+            appendStringInfo(&str, " (passed " UINT64_FORMAT " of " 
+                             UINT64_FORMAT ")", passed, tested);
+        }
         pred_str = lappend(pred_str, str.data);
     }
     
     if (list_length(pred_str) > 0)
         ExplainPropertyList("Geometry predicates", pred_str, es);
 
+    if (ordering != NIL)
+    {
+        StringInfoData str;
+
+        initStringInfo(&str);
+        appendStringInfo(&str, "point <-> $%d limit %d", 
+                         linitial_int(ordering) + 1, lsecond_int(ordering));
+        ExplainPropertyText("Nearest pixels", str.data, es);
+    }
+
     i = 1;
-#if PG_VERSION_NUM >= 90300
+#if PG_VERSION_NUM >= 130000
+    dpcontext = set_deparse_context_plan(es->deparse_cxt, (Plan *) plan, NIL);
+#elif PG_VERSION_NUM >= 90300
     dpcontext = deparse_context_for_planstate((Node*) node, 
                                               NIL, 
                                               es->rtable,
@@ -880,11 +1828,12 @@ aquireSampleRows(Relation relation,
         state->col_indices[type] = i;
 
         if (type == HvaultColumnCatalog)
-            addCatalogColumn(state, relation, i);
+            addCatalogColumn(state, options,
+                             TupleDescAttr(tupdesc, i)->atttypid, i);
 
         if (type >= HvaultColumnFootprint && type <= HvaultColumnDataset)
         {
-            Form_pg_attribute attr = tupdesc->attrs[i];
+            Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
             state->driver->methods->add_column(state->driver, attr,
                 GetForeignColumnOptions(foreigntableid, i+1));
         }
@@ -979,7 +1928,7 @@ hvaultAnalyze(Relation relation,
             != SPI_OK_SELECT ||
         SPI_processed != 1 ||
         SPI_tuptable->tupdesc->natts != 1 ||
-        SPI_tuptable->tupdesc->attrs[0]->atttypid != FLOAT8OID)
+        TupleDescAttr(SPI_tuptable->tupdesc, 0)->atttypid != FLOAT8OID)
     {
         ereport(ERROR, (errcode(ERRCODE_FDW_ERROR),
                         errmsg("Can't select from catalog %s", catalog)));
@@ -0,0 +1,336 @@
+#include "geocache.h"
+
+#include <access/hash.h>
+
+#include "options.h"
+#include "shmem.h"
+
+#define GEOCACHE_BLOCK_SIZE (64*1024)
+#define GEOCACHE_MAX_USAGE 5
+#define GEOCACHE_NONE (-1)
+
+/* 
+ * Entry data starts with source name, so that entries of sources with equal
+ * hashes are told apart, and is followed by arrays.
+ */
+typedef struct
+{
+    HvaultGeoCacheKey key;
+    int32 hash_next;        /* Next slot of hash bucket */
+    int32 first_block;      /* GEOCACHE_NONE if slot is free */
+    int32 nblocks;
+    Size nbytes;            /* Size of arrays */
+    Size namelen;           /* Size of source name with terminating zero */
+    uint8 usage;            /* Decremented by clock sweep */
+} GeoCacheSlot;
+
+typedef struct
+{
+    int32 nslots;
+    int32 nblocks;
+    int32 free_block;       /* Head of free block list */
+    int32 nfree;
+    int32 hand;             /* Clock sweep position */
+} GeoCacheHeader;
+
+/* Arena layout: header, buckets, slots, block links, blocks */
+static GeoCacheHeader * header = NULL;
+static int32 * buckets;
+static GeoCacheSlot * slots;
+static int32 * blockNext;
+static char * blocks;
+
+static int32
+numBlocks (void)
+{
+    return (int32) Min((int64) hvaultGeoCacheSize * 1024 * 1024 /
+                       GEOCACHE_BLOCK_SIZE, INT_MAX / 2);
+}
+
+Size
+hvaultGeoCacheShmemSize (void)
+{
+    int32 nblocks = numBlocks();
+    Size size = MAXALIGN(sizeof(GeoCacheHeader));
+
+    /* Every entry takes at least one block */
+    size = add_size(size, MAXALIGN(mul_size(nblocks, sizeof(int32))));
+    size = add_size(size, MAXALIGN(mul_size(nblocks, sizeof(GeoCacheSlot))));
+    size = add_size(size, MAXALIGN(mul_size(nblocks, sizeof(int32))));
+    size = add_size(size, mul_size(nblocks, GEOCACHE_BLOCK_SIZE));
+    return size;
+}
+
+void
+hvaultGeoCacheShmemInit (void)
+{
+    int32 nblocks = numBlocks();
+    char * ptr;
+    bool found;
+    int32 i;
+
+    ptr = ShmemInitStruct("hvault geolocation cache",
+                          hvaultGeoCacheShmemSize(), &found);
+    header = (GeoCacheHeader *) ptr;
+    ptr += MAXALIGN(sizeof(GeoCacheHeader));
+    buckets = (int32 *) ptr;
+    ptr += MAXALIGN(sizeof(int32) * nblocks);
+    slots = (GeoCacheSlot *) ptr;
+    ptr += MAXALIGN(sizeof(GeoCacheSlot) * nblocks);
+    blockNext = (int32 *) ptr;
+    ptr += MAXALIGN(sizeof(int32) * nblocks);
+    blocks = ptr;
+
+    if (found)
+        return;
+
+    header->nslots = nblocks;
+    header->nblocks = nblocks;
+    header->free_block = nblocks > 0 ? 0 : GEOCACHE_NONE;
+    header->nfree = nblocks;
+    header->hand = 0;
+    for (i = 0; i < nblocks; i++)
+    {
+        buckets[i] = GEOCACHE_NONE;
+        slots[i].first_block = GEOCACHE_NONE;
+        slots[i].hash_next = GEOCACHE_NONE;
+        blockNext[i] = i + 1 < nblocks ? i + 1 : GEOCACHE_NONE;
+    }
+}
+
+bool
+hvaultGeoCacheEnabled (void)
+{
+    return header != NULL && header->nblocks > 0;
+}
+
+static int32 *
+bucketOf (HvaultGeoCacheKey const * key)
+{
+    uint32 hash = DatumGetUInt32(hash_any((unsigned char const *) key,
+                                          sizeof(HvaultGeoCacheKey)));
+    return buckets + hash % header->nslots;
+}
+
+/* Returns slot index of key and source or GEOCACHE_NONE. Lock must be held */
+static int32
+findSlot (HvaultGeoCacheKey const * key, char const * name)
+{
+    Size namelen = strlen(name) + 1;
+    int32 idx;
+
+    for (idx = *bucketOf(key); idx != GEOCACHE_NONE;
+         idx = slots[idx].hash_next)
+    {
+        GeoCacheSlot * slot = slots + idx;
+
+        /* Name fits into the first block */
+        if (memcmp(&slot->key, key, sizeof(HvaultGeoCacheKey)) == 0 &&
+            slot->namelen == namelen &&
+            memcmp(blocks + (Size) slot->first_block * GEOCACHE_BLOCK_SIZE,
+                   name, namelen) == 0)
+            return idx;
+    }
+    return GEOCACHE_NONE;
+}
+
+/* Returns blocks of slot to free list. Exclusive lock must be held */
+static void
+evictSlot (int32 idx)
+{
+    GeoCacheSlot * slot = slots + idx;
+    int32 * link, block, next;
+
+    for (link = bucketOf(&slot->key); *link != idx;
+         link = &slots[*link].hash_next);
+    *link = slot->hash_next;
+
+    for (block = slot->first_block; block != GEOCACHE_NONE; block = next)
+    {
+        next = blockNext[block];
+        blockNext[block] = header->free_block;
+        header->free_block = block;
+        header->nfree++;
+    }
+    slot->first_block = GEOCACHE_NONE;
+    slot->hash_next = GEOCACHE_NONE;
+}
+
+/*
+ * Finds free slot and frees nblocks blocks evicting unused entries.
+ * Returns GEOCACHE_NONE if space can't be found. Exclusive lock must be held.
+ */
+static int32
+reserveSlot (int32 nblocks)
+{
+    int32 res = GEOCACHE_NONE;
+    int32 steps;
+
+    for (steps = 0; steps < header->nslots * (GEOCACHE_MAX_USAGE + 1); steps++)
+    {
+        int32 idx = header->hand;
+        GeoCacheSlot * slot = slots + idx;
+
+        if (res != GEOCACHE_NONE && header->nfree >= nblocks)
+            break;
+
+        header->hand = (header->hand + 1) % header->nslots;
+        if (slot->first_block != GEOCACHE_NONE)
+        {
+            if (slot->usage > 0)
+            {
+                slot->usage--;
+                continue;
+            }
+            evictSlot(idx);
+        }
+        if (res == GEOCACHE_NONE)
+            res = idx;
+    }
+
+    return header->nfree >= nblocks ? res : GEOCACHE_NONE;
+}
+
+/* 
+ * Copies arrays between backend buffers and chain of blocks starting at 
+ * offset inside the first block
+ */
+static void
+copyBlocks (int32 block, Size offset, float ** arrays, Size const * sizes, 
+            int narrays, bool store)
+{
+    int i;
+
+    for (i = 0; i < narrays; i++)
+    {
+        char * buf = (char *) arrays[i];
+        Size left = sizes[i];
+
+        while (left > 0)
+        {
+            char * data = blocks + (Size) block * GEOCACHE_BLOCK_SIZE + offset;
+            Size len = Min(left, GEOCACHE_BLOCK_SIZE - offset);
+
+            if (store)
+                memcpy(data, buf, len);
+            else
+                memcpy(buf, data, len);
+            buf += len;
+            left -= len;
+            offset += len;
+            if (offset == GEOCACHE_BLOCK_SIZE)
+            {
+                block = blockNext[block];
+                offset = 0;
+            }
+        }
+    }
+}
+
+static Size
+totalSize (Size const * sizes, int narrays)
+{
+    Size res = 0;
+    int i;
+
+    for (i = 0; i < narrays; i++)
+        res += sizes[i];
+    return res;
+}
+
+/*
+ * Copies cached arrays into buffers of specified sizes in bytes. Returns
+ * false if there is no entry with such key, source and sizes.
+ */
+bool
+hvaultGeoCacheGet (HvaultGeoCacheKey const * key,
+                   char const *              name,
+                   float **                  arrays,
+                   Size const *              sizes,
+                   int                       narrays)
+{
+    int32 idx;
+    bool res = false;
+
+    if (!hvaultGeoCacheEnabled())
+        return false;
+
+    LWLockAcquire(hvaultShmemLock(HvaultGeoCacheLock), LW_SHARED);
+    idx = findSlot(key, name);
+    if (idx != GEOCACHE_NONE &&
+        slots[idx].nbytes == totalSize(sizes, narrays))
+    {
+        copyBlocks(slots[idx].first_block, slots[idx].namelen, 
+                   arrays, sizes, narrays, false);
+        /* Lost increment under shared lock only makes entry look colder */
+        if (slots[idx].usage < GEOCACHE_MAX_USAGE)
+            slots[idx].usage++;
+        res = true;
+    }
+    LWLockRelease(hvaultShmemLock(HvaultGeoCacheLock));
+
+    return res;
+}
+
+/* Stores copy of arrays, least used entries are evicted to get space */
+void
+hvaultGeoCachePut (HvaultGeoCacheKey const * key,
+                   char const *              name,
+                   float * const *           arrays,
+                   Size const *              sizes,
+                   int                       narrays)
+{
+    Size nbytes = totalSize(sizes, narrays);
+    Size namelen = strlen(name) + 1;
+    int32 nblocks, idx, i, * bucket;
+    GeoCacheSlot * slot;
+
+    if (!hvaultGeoCacheEnabled() || nbytes == 0 || 
+        namelen > GEOCACHE_BLOCK_SIZE)
+        return;
+    nblocks = (namelen + nbytes + GEOCACHE_BLOCK_SIZE - 1) / 
+        GEOCACHE_BLOCK_SIZE;
+    if (nblocks > header->nblocks)
+        return;
+
+    /* Concurrent backends may compute the same chunk */
+    LWLockAcquire(hvaultShmemLock(HvaultGeoCacheLock), LW_EXCLUSIVE);
+    if (findSlot(key, name) != GEOCACHE_NONE)
+    {
+        LWLockRelease(hvaultShmemLock(HvaultGeoCacheLock));
+        return;
+    }
+
+    idx = reserveSlot(nblocks);
+    if (idx == GEOCACHE_NONE)
+    {
+        LWLockRelease(hvaultShmemLock(HvaultGeoCacheLock));
+        return;
+    }
+
+    slot = slots + idx;
+    slot->key = *key;
+    slot->nbytes = nbytes;
+    slot->namelen = namelen;
+    slot->nblocks = nblocks;
+    slot->usage = 1;
+    slot->first_block = header->free_block;
+    for (i = 0; i < nblocks; i++)
+    {
+        int32 block = header->free_block;
+
+        header->free_block = blockNext[block];
+        header->nfree--;
+        if (i == nblocks - 1)
+            blockNext[block] = GEOCACHE_NONE;
+    }
+    memcpy(blocks + (Size) slot->first_block * GEOCACHE_BLOCK_SIZE, 
+           name, namelen);
+    copyBlocks(slot->first_block, namelen, (float **) arrays, sizes, narrays, 
+               true);
+
+    bucket = bucketOf(key);
+    slot->hash_next = *bucket;
+    *bucket = idx;
+    LWLockRelease(hvaultShmemLock(HvaultGeoCacheLock));
+}
@@ -0,0 +1,51 @@
+#ifndef _GEOCACHE_H_
+#define _GEOCACHE_H_
+
+#include "common.h"
+
+/*
+ * Cache of interpolated geolocation shared by all backends. Entries are
+ * keyed by geolocation source and chunk position. Key holds only hash of
+ * the source, so its full name is passed separately. Entries are stored in
+ * fixed size blocks of shared memory arena and evicted by clock sweep when
+ * arena is full. Arena size is set by hvault.geo_cache_size, the cache
+ * works only if hvault is loaded by shared_preload_libraries.
+ */
+typedef struct
+{
+    uint64 source;      /* Hash of geolocation files and datasets */
+    int64 mtime;        /* Latest modification time of geolocation files */
+    uint64 line;        /* First line of chunk */
+    uint32 lines;       /* Chunk size */
+    uint32 samples;
+    uint32 factor;      /* Interpolation factor */
+    uint32 flags;       /* Driver flags that affect geolocation */
+} HvaultGeoCacheKey;
+
+/* Shared memory needed by cache */
+Size hvaultGeoCacheShmemSize (void);
+
+/* Initializes cache arena, called from shmem startup hook */
+void hvaultGeoCacheShmemInit (void);
+
+/* Returns true if cache is available in this backend */
+bool hvaultGeoCacheEnabled (void);
+
+/* 
+ * Copies cached arrays into buffers of specified sizes in bytes. Returns 
+ * false if there is no entry with such key, source name and sizes.
+ */
+bool hvaultGeoCacheGet (HvaultGeoCacheKey const * key,
+                        char const *              name,
+                        float **                  arrays,
+                        Size const *              sizes,
+                        int                       narrays);
+
+/* Stores copy of arrays, least used entries are evicted to get space */
+void hvaultGeoCachePut (HvaultGeoCacheKey const * key,
+                        char const *              name,
+                        float * const *           arrays,
+                        Size const *              sizes,
+                        int                       narrays);
+
+#endif /* _GEOCACHE_H_ */
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "options.h"
+#include "shmem.h"
 
 #define int8 hdf_int8
 #include <hdf/mfhdf.h>
@@ -11,13 +13,27 @@ extern void             hvaultGetRelSize (PlannerInfo * root,
 extern void             hvaultGetPaths   (PlannerInfo * root, 
                                           RelOptInfo *  baserel,
                                           Oid           foreigntableid);
+
+#if PG_VERSION_NUM >= 90600
+extern void             hvaultGetJoinPaths (PlannerInfo *        root,
+                                            RelOptInfo *         joinrel,
+                                            RelOptInfo *         outerrel,
+                                            RelOptInfo *         innerrel,
+                                            JoinType             jointype,
+                                            JoinPathExtraData *  extra);
+#endif
  
 extern ForeignScan *    hvaultGetPlan    (PlannerInfo * root, 
                                           RelOptInfo *  baserel,
                                           Oid           foreigntableid, 
                                           ForeignPath * best_path,
                                           List *        tlist, 
+#if PG_VERSION_NUM >= 90500
+                                          List *        scan_clauses,
+                                          Plan *        outer_plan);
+#else
                                           List *        scan_clauses);
+#endif
  
 extern void             hvaultExplain    (ForeignScanState * node, 
                                           ExplainState *     es);
@@ -30,6 +46,32 @@ extern bool             hvaultAnalyze    (Relation                relation,
                                           AcquireSampleRowsFunc * func,
                                           BlockNumber *           totalpages);
 
+#if PG_VERSION_NUM >= 90600
+extern bool             hvaultIsParallelSafe   (PlannerInfo *   root,
+                                                RelOptInfo *    rel,
+                                                RangeTblEntry * rte);
+extern Size             hvaultEstimateDSM      (ForeignScanState * node,
+                                                ParallelContext *  pcxt);
+extern void             hvaultInitializeDSM    (ForeignScanState * node,
+                                                ParallelContext *  pcxt,
+                                                void *             coordinate);
+#if PG_VERSION_NUM >= 100000
+extern void             hvaultReInitializeDSM  (ForeignScanState * node,
+                                                ParallelContext *  pcxt,
+                                                void *             coordinate);
+#endif
+extern void             hvaultInitializeWorker (ForeignScanState * node,
+                                                shm_toc *          toc,
+                                                void *             coordinate);
+#endif
+
+#if PG_VERSION_NUM >= 140000
+extern bool             hvaultIsAsyncCapable     (ForeignPath *path);
+extern void             hvaultAsyncRequest       (AsyncRequest *areq);
+extern void             hvaultAsyncConfigureWait (AsyncRequest *areq);
+extern void             hvaultAsyncNotify        (AsyncRequest *areq);
+#endif
+
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
 #endif
@@ -74,12 +116,115 @@ init_lwgeom_handlers()
 
 #endif
 
+int hvaultMetadataCacheSize = 1000;
+int hvaultFileCacheSize = 16;
+int hvaultPipelineWorkers = 0;
+int hvaultShardIndex = 0;
+int hvaultShardCount = 1;
+bool hvaultSynchronizeScans = false;
+int hvaultMaxDeviceReaders = 0;
+char * hvaultCacheDir = NULL;
+int hvaultCacheSize = 1024;
+int hvaultGeoCacheSize = 0;
+char * hvaultGeoSidecarDir = NULL;
+
 void
 _PG_init(void)
 {
     init_lwgeom_handlers();
     HDdont_atexit();
     GDALAllRegister();
+
+    DefineCustomIntVariable("hvault.metadata_cache_size",
+                            "Number of HDF files whose metadata is cached.",
+                            NULL,
+                            &hvaultMetadataCacheSize,
+                            1000, 0, INT_MAX,
+                            PGC_USERSET, 0,
+                            NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.file_cache_size",
+                            "Number of HDF files kept open between scans.",
+                            NULL,
+                            &hvaultFileCacheSize,
+                            16, 0, INT_MAX,
+                            PGC_USERSET, 0,
+                            NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.pipeline_workers",
+                            "Number of threads that interpolate geolocation "
+                            "of the next chunk in background.",
+                            NULL,
+                            &hvaultPipelineWorkers,
+                            0, 0, 64,
+                            PGC_USERSET, 0,
+                            NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.shard_index",
+                            "Index of granule shard processed by this "
+                            "instance.",
+                            "Scans process only granules with catalog key "
+                            "modulo hvault.shard_count equal to this value.",
+                            &hvaultShardIndex,
+                            0, 0, INT_MAX,
+                            PGC_USERSET, 0,
+                            NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.shard_count",
+                            "Number of granule shards.",
+                            NULL,
+                            &hvaultShardCount,
+                            1, 1, INT_MAX,
+                            PGC_USERSET, 0,
+                            NULL, NULL, NULL);
+    DefineCustomBoolVariable("hvault.synchronize_scans",
+                             "Start scans where concurrent scans of the same "
+                             "catalog query are.",
+                             "Requires hvault in shared_preload_libraries.",
+                             &hvaultSynchronizeScans,
+                             false,
+                             PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.max_device_readers",
+                            "Maximum number of backends reading granules "
+                            "from the same device, 0 means unlimited.",
+                            "Requires hvault in shared_preload_libraries.",
+                            &hvaultMaxDeviceReaders,
+                            0, 0, INT_MAX,
+                            PGC_SIGHUP, 0,
+                            NULL, NULL, NULL);
+    DefineCustomStringVariable("hvault.cache_dir",
+                               "Directory on fast local storage where copies "
+                               "of granule files are cached.",
+                               "Empty string disables the cache. Requires "
+                               "hvault in shared_preload_libraries.",
+                               &hvaultCacheDir,
+                               "",
+                               PGC_SIGHUP, 0,
+                               NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.cache_size",
+                            "Maximum size of cached granule files in "
+                            "megabytes.",
+                            NULL,
+                            &hvaultCacheSize,
+                            1024, 0, INT_MAX,
+                            PGC_SIGHUP, 0,
+                            NULL, NULL, NULL);
+    DefineCustomIntVariable("hvault.geo_cache_size",
+                            "Size of interpolated geolocation cache shared "
+                            "by backends in megabytes.",
+                            "Requires hvault in shared_preload_libraries.",
+                            &hvaultGeoCacheSize,
+                            0, 0, INT_MAX / 2,
+                            PGC_POSTMASTER, 0,
+                            NULL, NULL, NULL);
+    DefineCustomStringVariable("hvault.geo_sidecar_dir",
+                               "Directory of geolocation sidecar files.",
+                               "Empty string places sidecars next to "
+                               "geolocation files of the catalog.",
+                               &hvaultGeoSidecarDir,
+                               "",
+                               PGC_SUSET, 0,
+                               NULL, NULL, NULL);
+    EmitWarningsOnPlaceholders("hvault");
+
+    hvaultShmemRequest();
 }
 
 const int hvaultDatatypeSize[HvaultNumDatatypes] = 
@@ -104,8 +249,24 @@ hvault_fdw_handler(PG_FUNCTION_ARGS)
     fdwroutine->ReScanForeignScan   = hvaultReScan;
     fdwroutine->EndForeignScan      = hvaultEnd;
     fdwroutine->AnalyzeForeignTable = hvaultAnalyze;
+#if PG_VERSION_NUM >= 90600
+    fdwroutine->GetForeignJoinPaths = hvaultGetJoinPaths;
+    fdwroutine->IsForeignScanParallelSafe    = hvaultIsParallelSafe;
+    fdwroutine->EstimateDSMForeignScan       = hvaultEstimateDSM;
+    fdwroutine->InitializeDSMForeignScan     = hvaultInitializeDSM;
+    fdwroutine->InitializeWorkerForeignScan  = hvaultInitializeWorker;
+#endif
+#if PG_VERSION_NUM >= 100000
+    fdwroutine->ReInitializeDSMForeignScan   = hvaultReInitializeDSM;
+#endif
+#if PG_VERSION_NUM >= 140000
+    fdwroutine->IsForeignPathAsyncCapable = hvaultIsAsyncCapable;
+    fdwroutine->ForeignAsyncRequest       = hvaultAsyncRequest;
+    fdwroutine->ForeignAsyncConfigureWait = hvaultAsyncConfigureWait;
+    fdwroutine->ForeignAsyncNotify        = hvaultAsyncNotify;
+#endif
 
-#ifdef USE_ASSERT_CHECKING
+#if defined(USE_ASSERT_CHECKING) && PG_VERSION_NUM < 90500
     assert_enabled = true;
 #endif
 
@@ -0,0 +1,402 @@
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <access/xact.h>
+#if PG_VERSION_NUM >= 100000
+#include <pgstat.h>
+#endif
+#include <storage/proc.h>
+
+#include "iosched.h"
+#include "options.h"
+#include "shmem.h"
+
+#define IOSCHED_NDEVICES 32
+#define IOSCHED_NABANDONED 64
+#define IOSCHED_NWAITERS 64
+#define IOSCHED_WAIT_TIMEOUT 100        /* Milliseconds between checks */
+
+#if PG_VERSION_NUM < 90500
+#define MyLatch (&MyProc->procLatch)
+#endif
+
+#if PG_VERSION_NUM >= 120000
+#define waitLatch(timeout) \
+    WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, \
+              (timeout), PG_WAIT_EXTENSION)
+#elif PG_VERSION_NUM >= 100000
+#define waitLatch(timeout) \
+    WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, \
+              (timeout), PG_WAIT_EXTENSION)
+#else
+#define waitLatch(timeout) \
+    WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, \
+              (timeout))
+#endif
+
+typedef struct
+{
+    dev_t dev;
+    int active;                 /* Backends reading the device */
+    uint64 next_ticket;         /* Ticket of the next waiter */
+    uint64 serving;             /* Ticket admitted next */
+    int nabandoned;
+    uint64 abandoned[IOSCHED_NABANDONED];  /* Tickets of cancelled waits */
+    int nwaiters;
+    int waiters[IOSCHED_NWAITERS];  /* pgprocno of waiting backends */
+} IODevice;
+
+typedef struct
+{
+    int ndevices;
+    IODevice devices[IOSCHED_NDEVICES];
+} IOScheduler;
+
+struct HvaultIOTicketData
+{
+    uint64 generation;
+    int ndevices;
+    int devices[IOSCHED_NDEVICES];
+};
+
+static IOScheduler * scheduler = NULL;
+
+/* Backend local state */
+static int localHolds[IOSCHED_NDEVICES];  /* Tickets holding each device */
+static int waitDevice = -1;               /* Device being waited for */
+static uint64 waitTicket;
+static uint64 generation = 0;             /* Incremented at transaction end */
+static bool callbacksRegistered = false;
+
+Size
+hvaultIOSchedShmemSize (void)
+{
+    return MAXALIGN(sizeof(IOScheduler));
+}
+
+void
+hvaultIOSchedShmemInit (bool found)
+{
+    scheduler = ShmemInitStruct("hvault io scheduler",
+                                sizeof(IOScheduler), &found);
+    if (!found)
+        memset(scheduler, 0, sizeof(IOScheduler));
+}
+
+/* Returns index of device entry, must be called with lock held */
+static int
+findDevice (dev_t dev)
+{
+    int i;
+
+    for (i = 0; i < scheduler->ndevices; i++)
+    {
+        if (scheduler->devices[i].dev == dev)
+            return i;
+    }
+    if (scheduler->ndevices == IOSCHED_NDEVICES)
+        return -1;
+
+    i = scheduler->ndevices++;
+    memset(scheduler->devices + i, 0, sizeof(IODevice));
+    scheduler->devices[i].dev = dev;
+    return i;
+}
+
+/* Moves queue head past cancelled waits, must be called with lock held */
+static void
+skipAbandoned (IODevice * dev)
+{
+    int i;
+
+    for (i = 0; i < dev->nabandoned; i++)
+    {
+        if (dev->abandoned[i] == dev->serving)
+        {
+            dev->abandoned[i] = dev->abandoned[--dev->nabandoned];
+            dev->serving++;
+            i = -1;
+        }
+    }
+}
+
+/* 
+ * Wakes backends waiting for the device, must be called with lock held.
+ * Waiters that didn't fit into the list recheck it on timeout.
+ */
+static void
+wakeWaiters (IODevice * dev)
+{
+    int i;
+
+    for (i = 0; i < dev->nwaiters; i++)
+        SetLatch(&ProcGlobal->allProcs[dev->waiters[i]].procLatch);
+}
+
+/* Removes this backend from waiters, must be called with lock held */
+static void
+removeWaiter (IODevice * dev)
+{
+    int i;
+
+    for (i = 0; i < dev->nwaiters; i++)
+    {
+        if (dev->waiters[i] == MyProc->pgprocno)
+        {
+            dev->waiters[i] = dev->waiters[--dev->nwaiters];
+            return;
+        }
+    }
+}
+
+static void
+abandonWait (void)
+{
+    IODevice * dev;
+
+    if (waitDevice < 0)
+        return;
+
+    dev = scheduler->devices + waitDevice;
+    LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+    removeWaiter(dev);
+    if (waitTicket == dev->serving)
+    {
+        dev->serving++;
+        skipAbandoned(dev);
+        wakeWaiters(dev);
+    }
+    else if (waitTicket > dev->serving)
+    {
+        if (dev->nabandoned < IOSCHED_NABANDONED)
+        {
+            dev->abandoned[dev->nabandoned++] = waitTicket;
+        }
+        else
+        {
+            /* Too many cancelled waits, admit all waiters in turn */
+            dev->serving = dev->next_ticket;
+            dev->nabandoned = 0;
+        }
+    }
+    LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+    waitDevice = -1;
+}
+
+/* Releases devices held by this backend, tickets become invalid */
+static void
+releaseAll (void)
+{
+    int i;
+
+    abandonWait();
+
+    LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+    for (i = 0; i < IOSCHED_NDEVICES; i++)
+    {
+        if (localHolds[i] > 0)
+        {
+            scheduler->devices[i].active--;
+            wakeWaiters(scheduler->devices + i);
+        }
+        localHolds[i] = 0;
+    }
+    LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+    generation++;
+}
+
+/* Scans are finished at transaction end even if they were not closed */
+static void
+ioSchedXactCallback (XactEvent event, void * arg)
+{
+    switch (event)
+    {
+        case XACT_EVENT_COMMIT:
+        case XACT_EVENT_ABORT:
+#if PG_VERSION_NUM >= 90500
+        case XACT_EVENT_PARALLEL_COMMIT:
+        case XACT_EVENT_PARALLEL_ABORT:
+#endif
+            releaseAll();
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+ioSchedExit (int code, Datum arg)
+{
+    releaseAll();
+}
+
+/* 
+ * Waits for device in ticket order. Releasing backends set latches of the 
+ * waiters, so the state is rechecked only when it may have changed.
+ */
+static void
+waitForDevice (int idx)
+{
+    IODevice * dev = scheduler->devices + idx;
+    bool admitted = false;
+
+    LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+    waitTicket = dev->next_ticket++;
+    waitDevice = idx;
+    if (dev->nwaiters < IOSCHED_NWAITERS)
+        dev->waiters[dev->nwaiters++] = MyProc->pgprocno;
+    LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+
+    for (;;)
+    {
+        LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+        skipAbandoned(dev);
+        if (waitTicket <= dev->serving &&
+            dev->active < hvaultMaxDeviceReaders)
+        {
+            if (waitTicket == dev->serving)
+                dev->serving++;
+            dev->active++;
+            removeWaiter(dev);
+            /* Next waiter may fit under the limit too */
+            wakeWaiters(dev);
+            admitted = true;
+        }
+        LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+
+        if (admitted)
+            break;
+        if (waitLatch(IOSCHED_WAIT_TIMEOUT) & WL_POSTMASTER_DEATH)
+            proc_exit(1);
+        ResetLatch(MyLatch);
+        CHECK_FOR_INTERRUPTS();
+    }
+    waitDevice = -1;
+}
+
+/* Takes device without queueing, limit of readers may be exceeded */
+static void
+enterDevice (int idx)
+{
+    LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+    scheduler->devices[idx].active++;
+    LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+}
+
+/* Returns true if this backend holds some device through earlier ticket */
+static bool
+holdsDevices (void)
+{
+    int i;
+
+    for (i = 0; i < IOSCHED_NDEVICES; i++)
+    {
+        if (localHolds[i] > 0)
+            return true;
+    }
+    return false;
+}
+
+static int
+compareDevices (void const * a, void const * b)
+{
+    return *(int const *) a - *(int const *) b;
+}
+
+HvaultIOTicket
+hvaultIOAcquire (List * filenames)
+{
+    HvaultIOTicket ticket;
+    dev_t devs[IOSCHED_NDEVICES];
+    int ndevs = 0, i, j;
+    ListCell * l;
+    bool holding;
+
+    if (scheduler == NULL || hvaultMaxDeviceReaders <= 0)
+        return NULL;
+
+    if (!callbacksRegistered)
+    {
+        RegisterXactCallback(ioSchedXactCallback, NULL);
+#if PG_VERSION_NUM >= 90400
+        before_shmem_exit(ioSchedExit, 0);
+#else
+        on_shmem_exit(ioSchedExit, 0);
+#endif
+        callbacksRegistered = true;
+    }
+
+    foreach(l, filenames)
+    {
+        struct stat st;
+
+        /* Driver will report missing file when opening it */
+        if (stat(lfirst(l), &st) != 0)
+            continue;
+        for (i = 0; i < ndevs && devs[i] != st.st_dev; i++);
+        if (i == ndevs && ndevs < IOSCHED_NDEVICES)
+            devs[ndevs++] = st.st_dev;
+    }
+
+    ticket = palloc(sizeof(struct HvaultIOTicketData));
+    ticket->generation = generation;
+    ticket->ndevices = 0;
+    LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+    for (i = 0; i < ndevs; i++)
+    {
+        int idx = findDevice(devs[i]);
+        if (idx >= 0)
+            ticket->devices[ticket->ndevices++] = idx;
+    }
+    LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+
+    /* 
+     * Devices are taken in the same order by all backends to avoid deadlock.
+     * Devices held through earlier tickets break the order, so backend that
+     * holds any of them is admitted without waiting. Otherwise it could wait
+     * for a device whose readers wait for the one it holds.
+     */
+    qsort(ticket->devices, ticket->ndevices, sizeof(int), compareDevices);
+    holding = holdsDevices();
+    for (j = 0; j < ticket->ndevices; j++)
+    {
+        int idx = ticket->devices[j];
+
+        if (localHolds[idx] == 0)
+        {
+            if (holding)
+                enterDevice(idx);
+            else
+                waitForDevice(idx);
+        }
+        localHolds[idx]++;
+    }
+
+    return ticket;
+}
+
+void
+hvaultIORelease (HvaultIOTicket ticket)
+{
+    int i;
+
+    if (ticket == NULL)
+        return;
+
+    if (ticket->generation == generation)
+    {
+        LWLockAcquire(hvaultShmemLock(HvaultIOSchedLock), LW_EXCLUSIVE);
+        for (i = 0; i < ticket->ndevices; i++)
+        {
+            int idx = ticket->devices[i];
+
+            if (--localHolds[idx] == 0)
+            {
+                scheduler->devices[idx].active--;
+                wakeWaiters(scheduler->devices + idx);
+            }
+        }
+        LWLockRelease(hvaultShmemLock(HvaultIOSchedLock));
+    }
+    pfree(ticket);
+}
@@ -0,0 +1,29 @@
+#ifndef _IOSCHED_H_
+#define _IOSCHED_H_
+
+#include "common.h"
+
+/*
+ * I/O admission control. Number of backends reading granules from the same
+ * device is limited by hvault.max_device_readers, others wait in FIFO
+ * order. Device accesses then stay close to sequential under heavy load.
+ * Works only if hvault is loaded by shared_preload_libraries.
+ */
+typedef struct HvaultIOTicketData * HvaultIOTicket;
+
+/* Shared memory needed by scheduler */
+Size hvaultIOSchedShmemSize (void);
+
+/* Initializes scheduler, called from shmem startup hook */
+void hvaultIOSchedShmemInit (bool found);
+
+/*
+ * Waits until granule files may be read. Returns NULL if admission control
+ * is disabled. Ticket is allocated in current memory context.
+ */
+HvaultIOTicket hvaultIOAcquire (List * filenames);
+
+/* Lets other backends read devices of the ticket */
+void hvaultIORelease (HvaultIOTicket ticket);
+
+#endif /* _IOSCHED_H_ */
@@ -0,0 +1,605 @@
+/* pthread_sigmask is hidden by -D_POSIX_C_SOURCE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "localcache.h"
+#include "options.h"
+#include "shmem.h"
+
+#define LOCALCACHE_NENTRIES 4096
+#define LOCALCACHE_BLOCK_SIZE (1024*1024)
+#define LOCALCACHE_COPY_TIMEOUT 3600    /* Seconds before copy is retried */
+#define LOCALCACHE_QUEUE_SIZE 8         /* Copies queued in one backend */
+
+typedef enum
+{
+    LocalCacheFree = 0,
+    LocalCacheCopying,
+    LocalCacheReady
+} LocalCacheState;
+
+typedef struct
+{
+    uint64 key;             /* Hash of source file name */
+    char path[MAXPGPATH];   /* Source file name, hash may collide */
+    off_t size;             /* Size of source file */
+    time_t mtime;           /* Modification time of source file */
+    time_t started;         /* Start time of copying */
+    uint64 stamp;           /* Time of last access */
+    LocalCacheState state;
+} LocalCacheEntry;
+
+typedef struct
+{
+    uint64 clock;
+    uint64 used;            /* Bytes taken by ready and copying entries */
+    LocalCacheEntry entries[LOCALCACHE_NENTRIES];
+} LocalCacheIndex;
+
+typedef struct LocalCacheCopy
+{
+    uint64 key;
+    char * src;
+    char * tmp;
+    char * dst;
+    bool ok;                        /* Copy is complete and renamed */
+    struct LocalCacheCopy * next;   /* Next finished copy */
+} LocalCacheCopy;
+
+static LocalCacheIndex * cacheIndex = NULL;
+
+/* 
+ * Copies of this backend are made one by one by a single worker thread. 
+ * Finished copies are passed back to the backend, which updates their 
+ * entries, because the thread must not call postgres routines.
+ */
+static pthread_mutex_t copyMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t copyCond = PTHREAD_COND_INITIALIZER;
+static pthread_t copyWorker;
+static bool workerRunning = false;
+static bool exitRegistered = false;
+/* Protected by copyMutex */
+static LocalCacheCopy * queue[LOCALCACHE_QUEUE_SIZE];
+static int queueLength = 0;
+static LocalCacheCopy * finished = NULL;
+static bool stopWorker = false;
+
+Size
+hvaultLocalCacheShmemSize (void)
+{
+    return MAXALIGN(sizeof(LocalCacheIndex));
+}
+
+/* Returns true if name is produced by cachedName */
+static bool
+isCachedName (char const * name)
+{
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        if (!isxdigit((unsigned char) name[i]))
+            return false;
+    }
+    return name[16] == '\0' || strcmp(name + 16, ".tmp") == 0;
+}
+
+/* 
+ * Removes files left by previous server run. Index starts empty, so its
+ * copies are not accounted and temporary files of interrupted copies are
+ * never renamed.
+ */
+static void
+removeStaleFiles (void)
+{
+    DIR * dir;
+    struct dirent * de;
+
+    if (hvaultCacheDir == NULL || hvaultCacheDir[0] == '\0')
+        return;
+
+    dir = opendir(hvaultCacheDir);
+    if (dir == NULL)
+        return;
+    while ((de = readdir(dir)) != NULL)
+    {
+        char * path;
+
+        if (!isCachedName(de->d_name))
+            continue;
+        path = psprintf("%s/%s", hvaultCacheDir, de->d_name);
+        if (unlink(path) != 0 && errno != ENOENT)
+            elog(WARNING, "Can't remove stale cached file %s: %m", path);
+        pfree(path);
+    }
+    closedir(dir);
+}
+
+void
+hvaultLocalCacheShmemInit (bool found)
+{
+    cacheIndex = ShmemInitStruct("hvault local cache",
+                                 sizeof(LocalCacheIndex), &found);
+    if (!found)
+    {
+        memset(cacheIndex, 0, sizeof(LocalCacheIndex));
+        removeStaleFiles();
+    }
+}
+
+static char *
+cachedName (uint64 key, char const * suffix)
+{
+    return psprintf("%s/%016llx%s", hvaultCacheDir,
+                    (unsigned long long) key, suffix);
+}
+
+/* Frees entry, cached file must be removed by caller. Lock must be held */
+static void
+freeEntry (LocalCacheEntry * entry)
+{
+    cacheIndex->used -= entry->size;
+    entry->state = LocalCacheFree;
+}
+
+/*
+ * Takes free entry for a new copy, evicting least recently used copies.
+ * Keys of evicted copies are appended to list. Lock must be held.
+ */
+static LocalCacheEntry *
+reserveEntry (off_t size, List ** evicted)
+{
+    uint64 limit = (uint64) hvaultCacheSize * 1024 * 1024;
+    LocalCacheEntry * entry, * victim;
+    int i;
+
+    if ((uint64) size > limit)
+        return NULL;
+
+    for (;;)
+    {
+        entry = victim = NULL;
+        for (i = 0; i < LOCALCACHE_NENTRIES; i++)
+        {
+            LocalCacheEntry * cur = cacheIndex->entries + i;
+
+            if (cur->state == LocalCacheFree)
+            {
+                if (entry == NULL)
+                    entry = cur;
+            }
+            else if (cur->state == LocalCacheReady &&
+                     (victim == NULL || cur->stamp < victim->stamp))
+            {
+                victim = cur;
+            }
+        }
+
+        if (entry != NULL && cacheIndex->used + size <= limit)
+            break;
+        if (victim == NULL)
+            return NULL; /* Space is taken by running copies */
+
+        *evicted = lappend(*evicted, cachedName(victim->key, ""));
+        freeEntry(victim);
+    }
+
+    entry->size = size;
+    entry->state = LocalCacheCopying;
+    cacheIndex->used += size;
+    return entry;
+}
+
+static LocalCacheEntry *
+findEntry (uint64 key)
+{
+    int i;
+
+    for (i = 0; i < LOCALCACHE_NENTRIES; i++)
+    {
+        if (cacheIndex->entries[i].state != LocalCacheFree &&
+            cacheIndex->entries[i].key == key)
+            return cacheIndex->entries + i;
+    }
+    return NULL;
+}
+
+static void
+freeCopy (LocalCacheCopy * copy)
+{
+    free(copy->src);
+    free(copy->tmp);
+    free(copy->dst);
+    free(copy);
+}
+
+static bool
+workerStopping (void)
+{
+    bool res;
+
+    pthread_mutex_lock(&copyMutex);
+    res = stopWorker;
+    pthread_mutex_unlock(&copyMutex);
+    return res;
+}
+
+/* 
+ * Copies file to temporary name and renames it when copy is complete.
+ * Copy is interrupted if backend exits.
+ */
+static bool
+copyFile (LocalCacheCopy * copy)
+{
+    char * buf;
+    int in, out;
+    ssize_t res, written;
+    bool ok = false;
+
+    buf = malloc(LOCALCACHE_BLOCK_SIZE);
+    in = open(copy->src, O_RDONLY);
+    out = open(copy->tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (buf != NULL && in >= 0 && out >= 0)
+    {
+        for (;;)
+        {
+            if (workerStopping())
+                break;
+            res = read(in, buf, LOCALCACHE_BLOCK_SIZE);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+            {
+                ok = res == 0;
+                break;
+            }
+
+            written = 0;
+            while (written < res)
+            {
+                ssize_t n = write(out, buf + written, res - written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                written += n;
+            }
+            if (written < res)
+                break;
+        }
+    }
+    if (in >= 0)
+        close(in);
+    if (out >= 0 && close(out) != 0)
+        ok = false;
+
+    if (!ok || rename(copy->tmp, copy->dst) != 0)
+    {
+        unlink(copy->tmp);
+        ok = false;
+    }
+
+    free(buf);
+    return ok;
+}
+
+/* Takes queued copies until backend exits */
+static void *
+copyThread (void * arg)
+{
+    LocalCacheCopy * copy;
+    int i;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&copyMutex);
+        while (!stopWorker && queueLength == 0)
+            pthread_cond_wait(&copyCond, &copyMutex);
+        if (stopWorker)
+        {
+            pthread_mutex_unlock(&copyMutex);
+            break;
+        }
+        copy = queue[0];
+        for (i = 1; i < queueLength; i++)
+            queue[i-1] = queue[i];
+        queueLength--;
+        pthread_mutex_unlock(&copyMutex);
+
+        copy->ok = copyFile(copy);
+
+        pthread_mutex_lock(&copyMutex);
+        copy->next = finished;
+        finished = copy;
+        pthread_mutex_unlock(&copyMutex);
+    }
+    return NULL;
+}
+
+/* Forgets cached copy of the file if the entry still describes it */
+static void
+dropEntry (uint64 key, char const * filename, LocalCacheState state)
+{
+    LocalCacheEntry * entry;
+
+    LWLockAcquire(hvaultShmemLock(HvaultLocalCacheLock), LW_EXCLUSIVE);
+    entry = findEntry(key);
+    if (entry != NULL && entry->state == state &&
+        strcmp(entry->path, filename) == 0)
+        freeEntry(entry);
+    LWLockRelease(hvaultShmemLock(HvaultLocalCacheLock));
+}
+
+/* Updates entries of copies finished by the worker */
+static void
+completeCopies (void)
+{
+    LocalCacheCopy * copy, * next;
+    LocalCacheEntry * entry;
+
+    pthread_mutex_lock(&copyMutex);
+    copy = finished;
+    finished = NULL;
+    pthread_mutex_unlock(&copyMutex);
+
+    for (; copy != NULL; copy = next)
+    {
+        next = copy->next;
+        if (!copy->ok)
+        {
+            dropEntry(copy->key, copy->src, LocalCacheCopying);
+        }
+        else
+        {
+            LWLockAcquire(hvaultShmemLock(HvaultLocalCacheLock), 
+                          LW_EXCLUSIVE);
+            entry = findEntry(copy->key);
+            if (entry != NULL && entry->state == LocalCacheCopying &&
+                strcmp(entry->path, copy->src) == 0)
+                entry->state = LocalCacheReady;
+            LWLockRelease(hvaultShmemLock(HvaultLocalCacheLock));
+        }
+        freeCopy(copy);
+    }
+}
+
+/* 
+ * Stops worker when backend exits. Queued copies are cancelled and running
+ * one is interrupted, so their entries are freed now instead of waiting for
+ * copy timeout.
+ */
+static void
+localCacheExit (int code, Datum arg)
+{
+    int i;
+
+    if (!workerRunning)
+        return;
+
+    pthread_mutex_lock(&copyMutex);
+    stopWorker = true;
+    for (i = 0; i < queueLength; i++)
+    {
+        queue[i]->ok = false;
+        queue[i]->next = finished;
+        finished = queue[i];
+    }
+    queueLength = 0;
+    pthread_cond_signal(&copyCond);
+    pthread_mutex_unlock(&copyMutex);
+
+    pthread_join(copyWorker, NULL);
+    workerRunning = false;
+    completeCopies();
+}
+
+static bool
+startWorker (void)
+{
+    sigset_t sigs, oldsigs;
+    int res;
+
+    if (workerRunning)
+        return true;
+
+    if (!exitRegistered)
+    {
+#if PG_VERSION_NUM >= 90400
+        before_shmem_exit(localCacheExit, 0);
+#else
+        on_shmem_exit(localCacheExit, 0);
+#endif
+        exitRegistered = true;
+    }
+
+    /* Signals must be handled by backend thread only */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+    res = pthread_create(&copyWorker, NULL, copyThread, NULL);
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+    if (res != 0)
+    {
+        elog(WARNING, "Can't start cache copy thread: %s", strerror(res));
+        return false;
+    }
+    workerRunning = true;
+    return true;
+}
+
+/* 
+ * Queues copying of the file. Returns false if it can't be started or 
+ * the queue is full, other backends or later scans will copy the file.
+ */
+static bool
+startCopy (char const * src, uint64 key)
+{
+    LocalCacheCopy * copy;
+    char * tmp, * dst;
+    bool queued = false;
+
+    if (mkdir(hvaultCacheDir, S_IRWXU) != 0 && errno != EEXIST)
+    {
+        elog(WARNING, "Can't create cache directory %s: %m", hvaultCacheDir);
+        return false;
+    }
+    if (!startWorker())
+        return false;
+
+    copy = malloc(sizeof(LocalCacheCopy));
+    if (copy == NULL)
+        return false;
+    tmp = cachedName(key, ".tmp");
+    dst = cachedName(key, "");
+    copy->key = key;
+    copy->src = strdup(src);
+    copy->tmp = strdup(tmp);
+    copy->dst = strdup(dst);
+    copy->ok = false;
+    copy->next = NULL;
+    pfree(tmp);
+    pfree(dst);
+    if (copy->src == NULL || copy->tmp == NULL || copy->dst == NULL)
+    {
+        freeCopy(copy);
+        return false;
+    }
+
+    pthread_mutex_lock(&copyMutex);
+    if (queueLength < LOCALCACHE_QUEUE_SIZE)
+    {
+        queue[queueLength++] = copy;
+        pthread_cond_signal(&copyCond);
+        queued = true;
+    }
+    pthread_mutex_unlock(&copyMutex);
+
+    if (!queued)
+        freeCopy(copy);
+    return queued;
+}
+
+/*
+ * Returns name of the file to read instead of the catalog one, allocated in
+ * current memory context. Starts copying of the file if it is not cached.
+ */
+char const *
+hvaultLocalCacheResolve (char const * filename)
+{
+    LocalCacheEntry * entry;
+    List * evicted = NIL;
+    ListCell * l;
+    struct stat st, cst;
+    uint64 key;
+    char * cached;
+    bool ready = false, copy = false;
+
+    if (cacheIndex == NULL || hvaultCacheDir == NULL ||
+        hvaultCacheDir[0] == '\0' || hvaultCacheSize <= 0)
+        return filename;
+
+    if (strlen(filename) >= MAXPGPATH)
+        return filename;
+
+    completeCopies();
+
+    /* Source is checked every time to notice its changes */
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+        return filename;
+
+    /* Copies are named by hash, entries keep full name to detect collisions */
+    key = hvaultHashString(filename);
+    cached = cachedName(key, "");
+
+    LWLockAcquire(hvaultShmemLock(HvaultLocalCacheLock), LW_EXCLUSIVE);
+    entry = findEntry(key);
+    if (entry != NULL && strcmp(entry->path, filename) != 0)
+    {
+        /* Other file with the same hash keeps its copy */
+        LWLockRelease(hvaultShmemLock(HvaultLocalCacheLock));
+        pfree(cached);
+        return filename;
+    }
+    if (entry != NULL &&
+        (entry->size != st.st_size || entry->mtime != st.st_mtime))
+    {
+        /* Cached copy is outdated */
+        if (entry->state == LocalCacheReady)
+            evicted = lappend(evicted, pstrdup(cached));
+        else
+            evicted = lappend(evicted, cachedName(key, ".tmp"));
+        freeEntry(entry);
+        entry = NULL;
+    }
+    if (entry != NULL && entry->state == LocalCacheCopying)
+    {
+        if (stat(cached, &cst) == 0 && cst.st_size == entry->size)
+        {
+            entry->state = LocalCacheReady;
+        }
+        else if (time(NULL) - entry->started > LOCALCACHE_COPY_TIMEOUT)
+        {
+            /* Copying backend has probably failed, try again */
+            evicted = lappend(evicted, cachedName(key, ".tmp"));
+            freeEntry(entry);
+            entry = NULL;
+        }
+    }
+
+    if (entry == NULL)
+    {
+        entry = reserveEntry(st.st_size, &evicted);
+        if (entry != NULL)
+        {
+            entry->key = key;
+            strlcpy(entry->path, filename, MAXPGPATH);
+            entry->mtime = st.st_mtime;
+            entry->started = time(NULL);
+            entry->stamp = ++cacheIndex->clock;
+            copy = true;
+        }
+    }
+    else if (entry->state == LocalCacheReady)
+    {
+        entry->stamp = ++cacheIndex->clock;
+        ready = true;
+    }
+    LWLockRelease(hvaultShmemLock(HvaultLocalCacheLock));
+
+    foreach(l, evicted)
+    {
+        if (unlink(lfirst(l)) != 0 && errno != ENOENT)
+            elog(WARNING, "Can't remove cached file %s: %m",
+                 (char *) lfirst(l));
+    }
+    list_free_deep(evicted);
+
+    if (copy && !startCopy(filename, key))
+        dropEntry(key, filename, LocalCacheCopying);
+
+    if (ready)
+    {
+        /* Copy may be removed by eviction in other backend */
+        if (stat(cached, &cst) == 0 && cst.st_size == st.st_size)
+        {
+            elog(DEBUG1, "using cached copy %s of %s", cached, filename);
+            return cached;
+        }
+        dropEntry(key, filename, LocalCacheReady);
+    }
+
+    pfree(cached);
+    return filename;
+}
@@ -0,0 +1,29 @@
+#ifndef _LOCALCACHE_H_
+#define _LOCALCACHE_H_
+
+#include "common.h"
+
+/*
+ * Copies of granule files on fast local storage. Files are copied to
+ * hvault.cache_dir in background after the first access and served from
+ * there afterwards. Every backend copies files one at a time in a single
+ * thread and cancels its queued copies on exit. Least recently used
+ * copies are removed when the cache exceeds hvault.cache_size. Index of 
+ * copies is kept in shared memory, so
+ * the cache works only if hvault is loaded by shared_preload_libraries.
+ * Files left in the cache directory by previous server run are removed.
+ */
+
+/* Shared memory needed by cache index */
+Size hvaultLocalCacheShmemSize (void);
+
+/* Initializes cache index, called from shmem startup hook */
+void hvaultLocalCacheShmemInit (bool found);
+
+/*
+ * Returns name of the file to read instead of the catalog one, allocated in
+ * current memory context. Starts copying of the file if it is not cached.
+ */
+char const * hvaultLocalCacheResolve (char const * filename);
+
+#endif /* _LOCALCACHE_H_ */
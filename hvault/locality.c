@@ -0,0 +1,131 @@
+/* mincore is hidden by -D_POSIX_C_SOURCE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#include "locality.h"
+
+/* Granule is considered cached if this fraction of its pages is resident */
+#define LOCALITY_CACHED_FRACTION 0.5
+
+struct HvaultLocalityData
+{
+    bool cached;
+    dev_t dev;
+    uint64 physical;    /* Offset of the first extent on device, 0 if unknown */
+    ino_t inode;
+};
+
+/* Counts pages of file resident in page cache */
+static size_t
+residentPages (int fd, size_t size, size_t pagesize)
+{
+    void * addr;
+    unsigned char * vec;
+    size_t npages, i, res;
+
+    npages = (size + pagesize - 1) / pagesize;
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return 0;
+
+    res = 0;
+    vec = palloc(npages);
+    if (mincore(addr, size, vec) == 0)
+    {
+        for (i = 0; i < npages; i++)
+            res += vec[i] & 1;
+    }
+    pfree(vec);
+    munmap(addr, size);
+    return res;
+}
+
+/* Returns physical offset of the beginning of file */
+static uint64
+physicalOffset (int fd)
+{
+#ifdef FS_IOC_FIEMAP
+    struct
+    {
+        struct fiemap map;
+        struct fiemap_extent extent;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.map.fm_start = 0;
+    req.map.fm_length = FIEMAP_MAX_OFFSET;
+    req.map.fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, &req.map) == 0 && 
+        req.map.fm_mapped_extents > 0)
+        return req.map.fm_extents[0].fe_physical;
+#endif
+    return 0;
+}
+
+/* Examines granule files. Result is allocated in current memory context */
+HvaultLocality 
+hvaultGetLocality (List * filenames)
+{
+    HvaultLocality loc;
+    ListCell * l;
+    size_t pagesize, total, resident;
+    bool first = true;
+
+    loc = palloc0(sizeof(struct HvaultLocalityData));
+    pagesize = sysconf(_SC_PAGESIZE);
+    total = resident = 0;
+    foreach(l, filenames)
+    {
+        struct stat st;
+        int fd;
+
+        fd = open(lfirst(l), O_RDONLY);
+        if (fd < 0)
+            continue; /* Driver will report it when opening file */
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            total += (st.st_size + pagesize - 1) / pagesize;
+            resident += residentPages(fd, st.st_size, pagesize);
+
+            /* Granule is located where its first file is */
+            if (first)
+            {
+                loc->dev = st.st_dev;
+                loc->inode = st.st_ino;
+                loc->physical = physicalOffset(fd);
+                first = false;
+            }
+        }
+        close(fd);
+    }
+    loc->cached = total > 0 && resident >= total * LOCALITY_CACHED_FRACTION;
+    return loc;
+}
+
+#define COMPARE(a, b) if ((a) != (b)) return (a) < (b) ? -1 : 1
+
+/* Compares locality of two granules, suitable for sorting */
+int 
+hvaultCompareLocality (void const * a, void const * b)
+{
+    HvaultLocality la = (HvaultLocality) a;
+    HvaultLocality lb = (HvaultLocality) b;
+
+    COMPARE(!la->cached, !lb->cached);
+    COMPARE(la->dev, lb->dev);
+    COMPARE(la->physical, lb->physical);
+    COMPARE(la->inode, lb->inode);
+    return 0;
+}
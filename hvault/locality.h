@@ -0,0 +1,19 @@
+#ifndef _LOCALITY_H_
+#define _LOCALITY_H_
+
+#include "common.h"
+
+/*
+ * Physical locality of granule files. Granules whose files are in the OS
+ * page cache are read first, the rest are read in order of their position
+ * on disk to avoid seeks.
+ */
+typedef struct HvaultLocalityData * HvaultLocality;
+
+/* Examines granule files. Result is allocated in current memory context */
+HvaultLocality hvaultGetLocality (List * filenames);
+
+/* Compares locality of two granules, suitable for sorting */
+int hvaultCompareLocality (void const * a, void const * b);
+
+#endif /* _LOCALITY_H_ */
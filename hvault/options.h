@@ -20,6 +20,29 @@
 #define HVAULT_TABLE_OPTION_DRIVER "driver"
 #define HVAULT_TABLE_OPTION_SHIFT_LONGITUDE "shift_longitude"
 #define HVAULT_TABLE_OPTION_SCANLINE "scanline"
+#define HVAULT_TABLE_OPTION_SCAN_BBOX "scan_bbox"
+#define HVAULT_TABLE_OPTION_CHUNK_CACHE "chunk_cache"
+#define HVAULT_TABLE_OPTION_PREFETCH "prefetch"
+#define HVAULT_TABLE_OPTION_CATALOG_KEY "catalog_key"
+#define HVAULT_TABLE_OPTION_WORK_QUEUE "work_queue"
+#define HVAULT_TABLE_OPTION_LOCALITY_ORDER "locality_order"
+#define HVAULT_TABLE_OPTION_GEO_SIDECAR "geo_sidecar"
+
+/* Name of catalog column that uniquely identifies granule */
+#define HVAULT_DEFAULT_CATALOG_KEY "id"
+
+/* Configuration parameters */
+extern int hvaultMetadataCacheSize;
+extern int hvaultFileCacheSize;
+extern int hvaultPipelineWorkers;
+extern int hvaultShardIndex;
+extern int hvaultShardCount;
+extern bool hvaultSynchronizeScans;
+extern int hvaultMaxDeviceReaders;
+extern char * hvaultCacheDir;
+extern int hvaultCacheSize;
+extern int hvaultGeoCacheSize;
+extern char * hvaultGeoSidecarDir;
 
 HvaultColumnType hvaultGetColumnType (DefElem * def);
 
@@ -44,4 +67,11 @@ hvaultGetTableOptionDouble (Oid foreigntableid, char const * option, double defv
     return def == NULL ? defval : defGetDouble(def);
 }
 
+static inline bool 
+hvaultGetTableOptionBool (Oid foreigntableid, char const * option, bool defval)
+{
+    DefElem * def = hvaultGetTableOption(foreigntableid, option);
+    return def == NULL ? defval : defGetBoolean(def);
+}
+
 #endif /* _OPTIONS_H_ */
@@ -11,6 +11,21 @@
 #define PIXEL_COST 0.001
 #define FILE_COST 1
 
+/* Scan path has got target and outer path for EPQ recheck in later versions */
+#if PG_VERSION_NUM >= 90600
+#define createScanPath(root, rel, rows, startup_cost, total_cost, pathkeys, \
+                       req_outer, fdw_private) \
+    create_foreignscan_path(root, rel, NULL, rows, startup_cost, total_cost, \
+                            pathkeys, req_outer, NULL, fdw_private)
+#elif PG_VERSION_NUM >= 90500
+#define createScanPath(root, rel, rows, startup_cost, total_cost, pathkeys, \
+                       req_outer, fdw_private) \
+    create_foreignscan_path(root, rel, rows, startup_cost, total_cost, \
+                            pathkeys, req_outer, NULL, fdw_private)
+#else
+#define createScanPath create_foreignscan_path
+#endif
+
 /* 
  * This file includes routines involved in query planning
  */
@@ -31,12 +46,16 @@ typedef struct
     List *join_quals;
     List *ec_quals;
     List *considered_relids;
+
+    Expr *order_arg;    /* argument of ORDER BY point <-> arg */
+    double order_limit; /* LIMIT of the ordered query */
     
     Cost startup_cost;
     Cost file_read_cost;
     Cost predicate_cost;
     Cost byte_cost;
     double rows_per_file;
+    bool async_capable;
 } HvaultPlannerContext;
 
 static inline HvaultTableInfo * table (HvaultPlannerContext * ctx)
@@ -52,8 +71,22 @@ typedef struct
     List *fdw_expr;
     List *packed_query;
     List *predicates;
+    List *ordering;
+    bool async_capable;
+    bool sync_order;        /* Catalog query is ordered by catalog key */
 } HvaultPathData;
 
+/* Pushed down join of two tables over the same granules */
+typedef struct
+{
+    HvaultPathData base;        /* Scan of the outer table */
+    List *scan_tlist;           /* Vars of both tables emitted by the scan */
+    List *local_quals;          /* RestrictInfos checked on the scan tuple */
+    List *coltypes;             /* Column types of scan_tlist entries */
+    List *reloids;              /* Source foreign table of every entry */
+    List *attnos;               /* Source attribute of every entry */
+} HvaultJoinPathData;
+
 static void
 extractCatalogQuals (HvaultPlannerContext * ctx)
 {
@@ -65,25 +98,30 @@ extractCatalogQuals (HvaultPlannerContext * ctx)
     
 }
 
-static void 
-addForeignPaths (HvaultPlannerContext * ctx,
-                 List * quals,
-                 Relids req_outer)
+/* 
+ * Adds quals to the catalog query, creates geometry predicates and 
+ * estimates costs of the scan.
+ */
+static HvaultPathData *
+createPathData (HvaultPlannerContext * ctx,
+                HvaultCatalogQuery query,
+                List * quals,
+                double * rows,
+                Cost * startup_cost,
+                Cost * total_cost)
 {
     ListCell *l;
     List *predicates, *own_quals, *pred_quals;
-    HvaultCatalogQuery query;
     List * fdw_expr;
     Cost catmin, catmax;
     double catrows;
     int catwidth;
-    double rows;
-    Cost startup_cost, total_cost, file_cost, pixel_cost;
+    Cost file_cost, pixel_cost;
     Selectivity selectivity;
+    HvaultPathData *path_data;
     
     /* Prepare catalog query */
     own_quals = NIL;
-    query = hvaultCatalogCloneQuery(ctx->query);
     foreach(l, quals)
     {
         HvaultQual * qual = lfirst(l);
@@ -117,28 +155,172 @@ addForeignPaths (HvaultPlannerContext * ctx,
         (predicates != NIL ? ctx->predicate_cost : 0) * ctx->rows_per_file;
     pixel_cost = ctx->byte_cost * ctx->tuple_width;
 
-    rows = ctx->rows_per_file * catrows * selectivity;
-    startup_cost = ctx->startup_cost + catmin + file_cost + pixel_cost;
-    total_cost = ctx->startup_cost + catmax + catrows * file_cost 
-        + rows * pixel_cost;
+    *rows = ctx->rows_per_file * catrows * selectivity;
+    *startup_cost = ctx->startup_cost + catmin + file_cost + pixel_cost;
+    *total_cost = ctx->startup_cost + catmax + catrows * file_cost 
+        + *rows * pixel_cost;
+
+    path_data = palloc(sizeof(HvaultPathData));    
+    path_data->table = table(ctx);
+    path_data->own_quals = own_quals;
+    path_data->packed_query = hvaultCatalogPackQuery(query);
+    path_data->fdw_expr = fdw_expr;
+    path_data->predicates = predicates;
+    path_data->ordering = NIL;
+    path_data->async_capable = ctx->async_capable;
+    path_data->sync_order = false;
+    return path_data;
+}
+
+/* 
+ * Synchronized scans skip and wrap around records by position, so catalog 
+ * query must return them in the same order in every backend.
+ */
+static bool
+addSyncOrder (HvaultCatalogQuery query, Oid foreigntableid)
+{
+    char *key;
+
+    if (!hvaultSynchronizeScans)
+        return false;
+
+    key = hvaultGetTableOptionString(foreigntableid, 
+                                     HVAULT_TABLE_OPTION_CATALOG_KEY);
+    hvaultCatalogAddSort(query, key ? key : HVAULT_DEFAULT_CATALOG_KEY, false);
+    return true;
+}
+
+#if PG_VERSION_NUM >= 90600
+/* 
+ * Partial path of parallel scan. All participants run the same catalog 
+ * query ordered by catalog key and claim its records one by one, so the 
+ * order must be the same in every process. Catalog key is expected to be
+ * unique; row location breaks ties if it is not, so parallel scan is
+ * considered only for catalogs stored in tables. Participants share the
+ * snapshot, so row locations don't change between them.
+ */
+static void
+addPartialPath (HvaultPlannerContext * ctx, List * quals)
+{
+    HvaultCatalogQuery query;
+    HvaultPathData *path_data;
+    ForeignPath *path;
+    char *key;
+    double rows, files, threshold, divisor;
+    Cost startup_cost, total_cost;
+    int workers;
+    Oid catalog;
+    char relkind;
+
+    if (max_parallel_workers_per_gather <= 0)
+        return;
+
+    catalog = RelnameGetRelid(table(ctx)->catalog);
+    relkind = OidIsValid(catalog) ? get_rel_relkind(catalog) : '\0';
+    if (relkind != RELKIND_RELATION && relkind != RELKIND_MATVIEW)
+        return;
+
+    key = hvaultGetTableOptionString(ctx->foreigntableid, HVAULT_TABLE_OPTION_CATALOG_KEY);
+    query = hvaultCatalogCloneQuery(ctx->query);
+    hvaultCatalogAddSort(query, key ? key : HVAULT_DEFAULT_CATALOG_KEY, false);
+    hvaultCatalogAddSort(query, "ctid", false);
+    path_data = createPathData(ctx, query, quals, 
+                               &rows, &startup_cost, &total_cost);
+    hvaultCatalogFreeQuery(query);
+
+    /* Add a worker for every threefold increase of number of granules */
+    files = rows / Max(ctx->rows_per_file, 1);
+    workers = 0;
+    for (threshold = 3; files >= threshold; threshold *= 3)
+    {
+        if (workers >= max_parallel_workers_per_gather)
+            break;
+        workers++;
+    }
+    if (workers == 0)
+        return;
+
+    /* Leader processes granules too while it is not busy with workers */
+    divisor = workers;
+    if (1.0 - 0.3 * workers > 0)
+        divisor += 1.0 - 0.3 * workers;
+
+    path = createScanPath(ctx->root, ctx->baserel, rows / divisor, 
+                          startup_cost, 
+                          startup_cost + 
+                          (total_cost - startup_cost) / divisor,
+                          NIL, NULL, (List *) path_data);
+    path->path.parallel_aware = true;
+    path->path.parallel_safe = true;
+    path->path.parallel_workers = workers;
+    add_partial_path(ctx->baserel, (Path *) path);
+}
+#endif
+
+static void 
+addForeignPaths (HvaultPlannerContext * ctx,
+                 List * quals,
+                 Relids req_outer)
+{
+    HvaultCatalogQuery query;
+    HvaultPathData *scan_data;
+    double rows;
+    Cost startup_cost, total_cost;
+    bool sync_order;
+
+    query = hvaultCatalogCloneQuery(ctx->query);
+    sync_order = addSyncOrder(query, ctx->foreigntableid);
+    scan_data = createPathData(ctx, query, quals, 
+                               &rows, &startup_cost, &total_cost);
+    scan_data->sync_order = sync_order;
 
     if (add_path_precheck(ctx->baserel, startup_cost, total_cost, 
                           NIL, req_outer))
     {
         ForeignPath *path;
+
+        path = createScanPath(ctx->root, ctx->baserel, rows, 
+                              startup_cost, total_cost, 
+                              NIL, req_outer, 
+                              (List *) scan_data);
+        add_path(ctx->baserel, (Path *) path);
+    }
+
+#if PG_VERSION_NUM >= 90600
+    if (req_outer == NULL && ctx->baserel->consider_parallel)
+        addPartialPath(ctx, quals);
+#endif
+
+    /* 
+     * Ordered kNN path. The whole scan is consumed into a bounded heap of 
+     * nearest pixels, so the first tuple is available only at the end. 
+     * Quals that are not pushed down are checked before tuple is added to 
+     * the heap. Parametrized scan is filtered by the join above it, so it 
+     * can't stop at LIMIT.
+     */
+    if (ctx->order_arg != NULL && req_outer == NULL &&
+        !contain_var_clause((Node *) ctx->order_arg) &&
+        add_path_precheck(ctx->baserel, total_cost, total_cost,
+                          ctx->root->query_pathkeys, NULL))
+    {
+        ForeignPath *path;
         HvaultPathData *path_data;
+        List *knn_expr;
+        int argno;
+
+        knn_expr = list_copy(scan_data->fdw_expr);
+        argno = list_append_unique_pos(&knn_expr, ctx->order_arg);
 
         path_data = palloc(sizeof(HvaultPathData));    
-        path_data->table = table(ctx);
-        path_data->own_quals = own_quals;
-        path_data->packed_query = hvaultCatalogPackQuery(query);
-        path_data->fdw_expr = fdw_expr;
-        path_data->predicates = predicates;
-
-        path = create_foreignscan_path(ctx->root, ctx->baserel, rows, 
-                                       startup_cost, total_cost, 
-                                       NIL, req_outer, 
-                                       (List *) path_data);
+        *path_data = *scan_data;
+        path_data->fdw_expr = knn_expr;
+        path_data->ordering = list_make2_int(argno, (int) ctx->order_limit);
+
+        path = createScanPath(ctx->root, ctx->baserel, 
+                              Min(rows, ctx->order_limit),
+                              total_cost, total_cost, 
+                              ctx->root->query_pathkeys, NULL, 
+                              (List *) path_data);
         add_path(ctx->baserel, (Path *) path);
     }
 
@@ -222,7 +404,7 @@ processUsedColumn (Var * var, void * arg)
         case HvaultColumnCatalog:
         case HvaultColumnDataset:
             /* get width from datatype */
-            attlen = ctx->tupdesc->attrs[var->varattno-1]->attlen;
+            attlen = TupleDescAttr(ctx->tupdesc, var->varattno-1)->attlen;
             if (attlen > 0)
                 ctx->tuple_width += attlen;
             else
@@ -238,8 +420,9 @@ processUsedColumn (Var * var, void * arg)
  * This function is intened to provide first estimate of a size of relation
  * involved in query. Generally we have all query information available at 
  * planner stage and can build our estimate basing on:
- *  baserel->reltargetlist - List of Var and PlaceHolderVar nodes for 
- *      the values we need to output from this relation. 
+ *  baserel->reltarget->exprs (reltargetlist before 9.6) - 
+ *      List of Var and PlaceHolderVar nodes for the values we need to 
+ *      output from this relation. 
  *  baserel->baserestrictinfo - 
  *      List of RestrictInfo nodes, containing info about
  *      each non-join qualification clause in which this relation
@@ -267,6 +450,7 @@ hvaultGetRelSize (PlannerInfo *root,
 {
     HvaultPlannerContext * ctx = palloc0(sizeof(HvaultPlannerContext));
     Relation rel;
+    char * scan_bbox;
 
     elog(DEBUG1, "in hvaultGetRelSize");
 
@@ -287,8 +471,13 @@ hvaultGetRelSize (PlannerInfo *root,
 
     ctx->query = hvaultCatalogInitQuery(table(ctx));
     ctx->tuple_width = 0;
+#if PG_VERSION_NUM >= 90600
+    hvaultAnalyzeUsedColumns((Node *) baserel->reltarget->exprs, 
+                             baserel->relid, processUsedColumn, ctx);
+#else
     hvaultAnalyzeUsedColumns((Node *) baserel->reltargetlist, baserel->relid, 
                              processUsedColumn, ctx);
+#endif
     hvaultAnalyzeUsedColumns((Node *) baserel->baserestrictinfo, baserel->relid, 
                              processUsedColumn, ctx);
     hvaultAnalyzeUsedColumns((Node *) baserel->joininfo, baserel->relid, 
@@ -296,6 +485,20 @@ hvaultGetRelSize (PlannerInfo *root,
     hvaultAnalyzeUsedColumns((Node *) root->eq_classes, baserel->relid, 
                              processUsedColumn, ctx);
     /* TODO: add driver-dependent metadata columns */
+    scan_bbox = hvaultGetTableOptionString(foreigntableid, 
+                                           HVAULT_TABLE_OPTION_SCAN_BBOX);
+    if (scan_bbox != NULL)
+        hvaultCatalogAddColumn(ctx->query, scan_bbox);
+    /* Catalog key is needed to select granules of this instance */
+    if (hvaultShardCount > 1 || 
+        hvaultGetTableOption(foreigntableid, 
+                             HVAULT_TABLE_OPTION_WORK_QUEUE) != NULL)
+    {
+        char * key = hvaultGetTableOptionString(
+            foreigntableid, HVAULT_TABLE_OPTION_CATALOG_KEY);
+        hvaultCatalogAddColumn(ctx->query, 
+                               key ? key : HVAULT_DEFAULT_CATALOG_KEY);
+    }
 
     ctx->startup_cost = hvaultGetTableOptionDouble(
             foreigntableid, "startup_cost", 10);
@@ -307,6 +510,8 @@ hvaultGetRelSize (PlannerInfo *root,
             foreigntableid, "byte_cost", 0.001);
     ctx->rows_per_file = hvaultGetTableOptionDouble(
             foreigntableid, "rows_per_file", HVAULT_TUPLES_PER_FILE);
+    ctx->async_capable = hvaultGetTableOptionBool(
+            foreigntableid, "async_capable", true);
 
     /* TODO: Use constant catalog quals for better estimate */
     baserel->rows = hvaultGetNumFiles(table(ctx)->catalog) 
@@ -337,6 +542,23 @@ hvaultGetPaths (PlannerInfo *root,
     ctx->analyzer = hvaultAnalyzerInit(table(ctx));
 
     extractCatalogQuals(ctx);
+
+    /* 
+     * Check for ORDER BY point <-> arg LIMIT k. We keep k nearest tuples 
+     * in memory, so limit them by work_mem. LIMIT belongs to the whole 
+     * query, so the scan may stop at k tuples only when no join filters 
+     * them afterwards, i.e. the table is the only relation of the query.
+     */
+    ctx->order_arg = NULL;
+    if (root->query_pathkeys != NIL && root->limit_tuples > 0 &&
+        root->limit_tuples * ctx->tuple_width <= work_mem * 1024.0 &&
+        bms_membership(root->all_baserels) == BMS_SINGLETON)
+    {
+        ctx->order_arg = hvaultAnalyzeOrdering(ctx->analyzer, 
+                                               root->query_pathkeys);
+        ctx->order_limit = root->limit_tuples;
+    }
+
     /* Create simple unparametrized path */
     addForeignPaths(ctx, ctx->static_quals, NULL);
     
@@ -423,13 +645,311 @@ hvaultGetPaths (PlannerInfo *root,
     hvaultAnalyzerFree(ctx->analyzer);
 }
 
+#if PG_VERSION_NUM >= 90600
+/*
+ * Join pushdown.
+ *
+ * Two hvault tables with the same table options read the same catalog with
+ * the same driver, so they describe the same pixel grid. Their inner join on
+ * the catalog key and pixel position (line and sample or index) is replaced 
+ * with a single scan of the outer table that also emits columns of the 
+ * inner one. Every granule is read once and no join is performed. Quals of 
+ * the inner table and remaining join quals are checked on the scan tuple.
+ */
+
+#if PG_VERSION_NUM >= 120000
+#define createJoinPath create_foreignjoin_path
+#else
+#define createJoinPath create_foreignscan_path
+#endif
+
+static HvaultColumnInfo const *
+joinColumn (HvaultPlannerContext * ctx, Node * expr)
+{
+    Var * var;
+
+    while (IsA(expr, RelabelType))
+        expr = (Node *) ((RelabelType *) expr)->arg;
+
+    if (!IsA(expr, Var))
+        return NULL;
+
+    var = (Var *) expr;
+    if (var->varno != ctx->baserel->relid || var->varattno <= 0)
+        return NULL;
+
+    return table(ctx)->columns + var->varattno - 1;
+}
+
+/* 
+ * Checks whether clause is equality of the same pixel attribute of both 
+ * tables. Sets corresponding flag in keys.
+ */
+static bool
+isPixelEquality (HvaultPlannerContext * octx,
+                 HvaultPlannerContext * ictx,
+                 RestrictInfo * rinfo,
+                 char const * catalog_key,
+                 bool keys[HvaultColumnNumTypes])
+{
+    OpExpr * op;
+    HvaultColumnInfo const *ocol, *icol;
+
+    if (!IsA(rinfo->clause, OpExpr) || rinfo->mergeopfamilies == NIL)
+        return false;
+
+    op = (OpExpr *) rinfo->clause;
+    if (list_length(op->args) != 2)
+        return false;
+
+    ocol = joinColumn(octx, linitial(op->args));
+    icol = joinColumn(ictx, lsecond(op->args));
+    if (ocol == NULL || icol == NULL)
+    {
+        ocol = joinColumn(octx, lsecond(op->args));
+        icol = joinColumn(ictx, linitial(op->args));
+    }
+    if (ocol == NULL || icol == NULL || ocol->type != icol->type)
+        return false;
+
+    switch (ocol->type)
+    {
+        case HvaultColumnCatalog:
+            if (ocol->cat_name == NULL || icol->cat_name == NULL ||
+                strcmp(ocol->cat_name, catalog_key) != 0 ||
+                strcmp(icol->cat_name, catalog_key) != 0)
+                return false;
+            break;
+        case HvaultColumnIndex:
+        case HvaultColumnLineIdx:
+        case HvaultColumnSampleIdx:
+            break;
+        default:
+            return false;
+    }
+
+    keys[ocol->type] = true;
+    return true;
+}
+
+/* Geolocation columns of both tables must be computed the same way */
+static bool
+sameGeolocation (HvaultPlannerContext * octx, HvaultPlannerContext * ictx)
+{
+    int i, j;
+
+    for (i = 0; i < table(octx)->natts; i++)
+    {
+        HvaultColumnType type = table(octx)->columns[i].type;
+
+        if (type != HvaultColumnPoint && type != HvaultColumnFootprint)
+            continue;
+
+        for (j = 0; j < table(ictx)->natts; j++)
+        {
+            if (table(ictx)->columns[j].type == type &&
+                !equal(GetForeignColumnOptions(octx->foreigntableid, i + 1),
+                       GetForeignColumnOptions(ictx->foreigntableid, j + 1)))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool
+addJoinColumn (HvaultJoinPathData * data, 
+               HvaultPlannerContext * octx, 
+               HvaultPlannerContext * ictx,
+               Var * var)
+{
+    HvaultPlannerContext * ctx;
+    int len = list_length(data->scan_tlist);
+
+    if (var->varno == octx->baserel->relid)
+        ctx = octx;
+    else if (var->varno == ictx->baserel->relid)
+        ctx = ictx;
+    else
+        return false;
+
+    /* System columns are not supported */
+    if (var->varattno <= 0)
+        return false;
+
+    data->scan_tlist = add_to_flat_tlist(data->scan_tlist, 
+                                         list_make1(var));
+    if (list_length(data->scan_tlist) == len)
+    {
+        /* Already added */
+        return true;
+    }
+
+    data->coltypes = lappend_int(data->coltypes, 
+        table(ctx)->columns[var->varattno - 1].type);
+    data->reloids = lappend_oid(data->reloids, ctx->foreigntableid);
+    data->attnos = lappend_int(data->attnos, var->varattno);
+    return true;
+}
+
+void
+hvaultGetJoinPaths (PlannerInfo * root,
+                    RelOptInfo * joinrel,
+                    RelOptInfo * outerrel,
+                    RelOptInfo * innerrel,
+                    JoinType jointype,
+                    JoinPathExtraData * extra)
+{
+    HvaultPlannerContext *octx, *ictx;
+    HvaultJoinPathData *data;
+    HvaultQualAnalyzer analyzer;
+    HvaultCatalogQuery query;
+    ForeignTable *otable, *itable;
+    char const *okey, *ikey;
+    bool keys[HvaultColumnNumTypes];
+    List *quals, *vars;
+    ListCell *l;
+    double rows;
+    Cost startup_cost, total_cost;
+    bool sync_order;
+    int i;
+
+    /* Join is already considered */
+    if (joinrel->fdw_private != NULL)
+        return;
+
+    if (jointype != JOIN_INNER ||
+        outerrel->reloptkind != RELOPT_BASEREL ||
+        innerrel->reloptkind != RELOPT_BASEREL ||
+        root->parse->commandType != CMD_SELECT ||
+        root->parse->rowMarks != NIL)
+        return;
+
+    octx = outerrel->fdw_private;
+    ictx = innerrel->fdw_private;
+    otable = GetForeignTable(octx->foreigntableid);
+    itable = GetForeignTable(ictx->foreigntableid);
+    if (!equal(otable->options, itable->options) || 
+        !sameGeolocation(octx, ictx))
+        return;
+
+    okey = hvaultGetTableOptionString(octx->foreigntableid, 
+                                      HVAULT_TABLE_OPTION_CATALOG_KEY);
+    ikey = hvaultGetTableOptionString(ictx->foreigntableid, 
+                                      HVAULT_TABLE_OPTION_CATALOG_KEY);
+    okey = okey ? okey : HVAULT_DEFAULT_CATALOG_KEY;
+    ikey = ikey ? ikey : HVAULT_DEFAULT_CATALOG_KEY;
+    if (strcmp(okey, ikey) != 0)
+        return;
+
+    data = palloc0(sizeof(HvaultJoinPathData));
+
+    /* Join quals that are satisfied by construction are dropped */
+    memset(keys, 0, sizeof(keys));
+    foreach(l, extra->restrictlist)
+    {
+        RestrictInfo * rinfo = lfirst(l);
+        if (!isPixelEquality(octx, ictx, rinfo, okey, keys))
+            data->local_quals = lappend(data->local_quals, rinfo);
+    }
+    if (!keys[HvaultColumnCatalog] || 
+        !(keys[HvaultColumnIndex] || 
+          (keys[HvaultColumnLineIdx] && keys[HvaultColumnSampleIdx])))
+        return;
+
+    /* Build scan of the outer table with columns of both tables */
+    analyzer = hvaultAnalyzerInit(table(octx));
+    quals = hvaultAnalyzeQuals(analyzer, outerrel->baserestrictinfo);
+    query = hvaultCatalogCloneQuery(octx->query);
+    sync_order = addSyncOrder(query, octx->foreigntableid);
+    for (i = 0; i < table(ictx)->natts; i++)
+    {
+        HvaultColumnInfo * col = table(ictx)->columns + i;
+        if (col->cat_name != NULL && col->type >= HvaultColumnFootprint 
+                                  && col->type <= HvaultColumnCatalog)
+            hvaultCatalogAddColumn(query, col->cat_name);
+    }
+    data->base = *createPathData(octx, query, quals, 
+                                 &rows, &startup_cost, &total_cost);
+    data->base.sync_order = sync_order;
+    hvaultCatalogFreeQuery(query);
+    hvaultAnalyzerFree(analyzer);
+
+    foreach(l, outerrel->baserestrictinfo)
+    {
+        if (!list_member_ptr(data->base.own_quals, lfirst(l)))
+            data->local_quals = lappend(data->local_quals, lfirst(l));
+    }
+    data->local_quals = list_concat(data->local_quals, 
+                                    list_copy(innerrel->baserestrictinfo));
+
+    /* Columns emitted by the scan */
+    vars = pull_var_clause((Node *) joinrel->reltarget->exprs, 
+                           PVC_RECURSE_PLACEHOLDERS);
+    vars = list_concat(vars, pull_var_clause(
+        (Node *) extract_actual_clauses(data->local_quals, false), 
+        PVC_RECURSE_PLACEHOLDERS));
+    foreach(l, vars)
+    {
+        if (!IsA(lfirst(l), Var) || 
+            !addJoinColumn(data, octx, ictx, lfirst(l)))
+            return;
+    }
+
+    /* Inner table columns are emitted from the same pixels */
+    rows = joinrel->rows;
+    total_cost += rows * ictx->byte_cost * ictx->tuple_width;
+
+    joinrel->fdw_private = data;
+    add_path(joinrel, (Path *) createJoinPath(root, joinrel, NULL, rows,
+                                              startup_cost, total_cost,
+                                              NIL, NULL, NULL, 
+                                              (List *) data));
+}
+
+static ForeignScan *
+getJoinPlan (ForeignPath *best_path, List *tlist, Plan *outer_plan)
+{
+    HvaultJoinPathData *data = (HvaultJoinPathData *) best_path->fdw_private;
+    List *fdw_plan_private;
+    
+    fdw_plan_private = list_make4(data->base.packed_query,
+                                  data->base.predicates,
+                                  data->coltypes,
+                                  data->base.ordering);
+    fdw_plan_private = lappend(fdw_plan_private, 
+                               list_make2(data->reloids, data->attnos));
+    fdw_plan_private = lappend(fdw_plan_private, 
+                               makeInteger(data->base.sync_order));
+
+    return make_foreignscan(tlist, 
+                            extract_actual_clauses(data->local_quals, false),
+                            0, data->base.fdw_expr, fdw_plan_private,
+                            data->scan_tlist, NIL, outer_plan);
+}
+#endif
+
+#if PG_VERSION_NUM >= 140000
+/* Plain scans may run asynchronously under Append */
+bool
+hvaultIsAsyncCapable (ForeignPath *path)
+{
+    HvaultPathData *data = (HvaultPathData *) path->fdw_private;
+    return data->async_capable && data->ordering == NIL;
+}
+#endif
+
 ForeignScan *
 hvaultGetPlan (PlannerInfo *root, 
                RelOptInfo *baserel,
                Oid foreigntableid, 
                ForeignPath *best_path,
                List *tlist, 
+#if PG_VERSION_NUM >= 90500
+               List *scan_clauses,
+               Plan *outer_plan)
+#else
                List *scan_clauses)
+#endif
 {
     HvaultPathData *fdw_private = (HvaultPathData *) best_path->fdw_private; 
 
@@ -443,6 +963,12 @@ hvaultGetPlan (PlannerInfo *root,
     (void)(foreigntableid);
 
     elog(DEBUG1, "in hvaultGetPlan");
+
+#if PG_VERSION_NUM >= 90600
+    if (baserel->reloptkind == RELOPT_JOINREL)
+        return getJoinPlan(best_path, tlist, outer_plan);
+#endif
+
     elog(DEBUG1, "Selected path quals: %s", 
          nodeToString(fdw_private->own_quals));
 
@@ -474,10 +1000,20 @@ hvaultGetPlan (PlannerInfo *root,
     }
 
     /* store fdw_private in List */
-    fdw_plan_private = list_make3(fdw_private->packed_query, 
+    fdw_plan_private = list_make4(fdw_private->packed_query, 
                                   fdw_private->predicates,
-                                  coltypes);
+                                  coltypes,
+                                  fdw_private->ordering);
+    fdw_plan_private = lappend(fdw_plan_private, NIL);
+    fdw_plan_private = lappend(fdw_plan_private, 
+                               makeInteger(fdw_private->sync_order));
 
+#if PG_VERSION_NUM >= 90500
+    return make_foreignscan(tlist, rest_clauses, baserel->relid, 
+                            fdw_private->fdw_expr, fdw_plan_private,
+                            NIL, NIL, outer_plan);
+#else
     return make_foreignscan(tlist, rest_clauses, baserel->relid, 
                             fdw_private->fdw_expr, fdw_plan_private);
+#endif
 }
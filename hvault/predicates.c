@@ -1,430 +1,1014 @@
+#include <math.h>
 #include "predicates.h"
 
-static inline bool 
-Overlaps_op(float latmin, 
-            float latmax, 
-            float lonmin, 
-            float lonmax, 
-            GBOX const *arg)
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Every geometry predicate is a disjunction of up to four comparisons of
+ * pixel bounds with argument bounds, optionally inverted. Operators are
+ * written exactly as PostGIS box operators, including NaN behaviour.
+ */
+
+typedef enum
+{
+    BoundLatMin = 0,
+    BoundLatMax,
+    BoundLonMin,
+    BoundLonMax,
+
+    BoundNum
+} PixelBound;
+
+typedef enum
+{
+    ArgXMin,
+    ArgXMax,
+    ArgYMin,
+    ArgYMax
+} ArgBound;
+
+typedef enum
+{
+    CmpLT,
+    CmpLE,
+    CmpGT,
+    CmpGE,
+    CmpNE
+} Comparison;
+
+typedef struct
+{
+    PixelBound bound;
+    Comparison cmp;
+    ArgBound arg;
+} TermSpec;
+
+typedef struct
+{
+    bool invert;
+    int nterms;
+    TermSpec terms[4];
+} OperatorSpec;
+
+static OperatorSpec const operators[HvaultGeomNumAllOpers] =
+{
+    /* Overlaps */
+    { true, 4, { { BoundLatMin, CmpGT, ArgYMax },
+                 { BoundLatMax, CmpLT, ArgYMin },
+                 { BoundLonMin, CmpGT, ArgXMax },
+                 { BoundLonMax, CmpLT, ArgXMin } } },
+    /* Contains */
+    { true, 4, { { BoundLatMin, CmpGT, ArgYMin },
+                 { BoundLatMax, CmpLT, ArgYMax },
+                 { BoundLonMin, CmpGT, ArgXMin },
+                 { BoundLonMax, CmpLT, ArgXMax } } },
+    /* Within */
+    { true, 4, { { BoundLatMin, CmpLT, ArgYMin },
+                 { BoundLatMax, CmpGT, ArgYMax },
+                 { BoundLonMin, CmpLT, ArgXMin },
+                 { BoundLonMax, CmpGT, ArgXMax } } },
+    /* Same */
+    { true, 4, { { BoundLatMin, CmpNE, ArgYMin },
+                 { BoundLatMax, CmpNE, ArgYMax },
+                 { BoundLonMin, CmpNE, ArgXMin },
+                 { BoundLonMax, CmpNE, ArgXMax } } },
+    /* Overleft */
+    { false, 1, { { BoundLatMax, CmpLE, ArgYMax } } },
+    /* Overright */
+    { false, 1, { { BoundLatMin, CmpGE, ArgYMin } } },
+    /* Overabove */
+    { false, 1, { { BoundLonMin, CmpGE, ArgXMin } } },
+    /* Overbelow */
+    { false, 1, { { BoundLonMax, CmpLE, ArgXMax } } },
+    /* Left */
+    { false, 1, { { BoundLatMax, CmpLT, ArgYMin } } },
+    /* Right */
+    { false, 1, { { BoundLatMin, CmpGT, ArgYMax } } },
+    /* Above */
+    { false, 1, { { BoundLonMin, CmpGT, ArgXMax } } },
+    /* Below */
+    { false, 1, { { BoundLonMax, CmpLT, ArgXMin } } },
+    /* CommLeft */
+    { false, 1, { { BoundLatMax, CmpGE, ArgYMax } } },
+    /* CommRight */
+    { false, 1, { { BoundLatMin, CmpLE, ArgYMin } } },
+    /* CommAbove */
+    { false, 1, { { BoundLonMin, CmpLE, ArgXMin } } },
+    /* CommBelow */
+    { false, 1, { { BoundLonMax, CmpGE, ArgXMax } } }
+};
+
+#define MAX_TERMS 4
+
+/* Compiled predicate */
+typedef struct
+{
+    HvaultColumnType coltype;
+    bool invert;
+    int nterms;
+    PixelBound bound[MAX_TERMS];
+    Comparison cmp[MAX_TERMS];
+    float val[MAX_TERMS];
+    float const * src[MAX_TERMS]; /* bound arrays of current chunk */
+
+    /* Statistics, survive rescans as predicates are added in same order */
+    uint64 tested, passed;
+} Predicate;
+
+struct HvaultPredicatesData
 {
-    return !( (latmin > arg->ymax) || (arg->ymin > latmax) ||
-              (lonmin > arg->xmax) || (arg->xmin > lonmax) );
+    MemoryContext memctx;
+    HvaultGeolocationType geotype;
+
+    Predicate * preds;
+    size_t num, bufsize;
+    size_t num_stats;    /* number of predicates with collected statistics */
+    size_t * order;      /* evaluation order of predicates */
+    bool empty;          /* some argument is NULL */
+    bool has_region;     /* region bounds all passing pixels */
+    GBOX region;
+    bool need_footprint, need_point;
+
+    /* SoA footprint bounds of current chunk */
+    float * bounds[BoundNum];
+    size_t bounds_size;
+
+    /* Bounds of chunk tiles */
+    struct Tile * tiles;
+    size_t tiles_size;
+};
+
+HvaultPredicates
+hvaultPredicatesInit (HvaultGeolocationType geotype, MemoryContext memctx)
+{
+    HvaultPredicates preds = MemoryContextAllocZero(memctx,
+        sizeof(struct HvaultPredicatesData));
+    preds->memctx = memctx;
+    preds->geotype = geotype;
+    return preds;
 }
 
-static inline bool 
-Contains_op(float latmin, 
-            float latmax, 
-            float lonmin, 
-            float lonmax, 
-            GBOX const *arg)
+bool
+hvaultPredicatesSupported (HvaultPredicates preds, HvaultColumnType coltype)
 {
-    return !( (latmin > arg->ymin) || (latmax < arg->ymax) ||
-              (lonmin > arg->xmin) || (lonmax < arg->xmax) );
+    switch (coltype)
+    {
+        case HvaultColumnPoint:
+            return true;
+        case HvaultColumnFootprint:
+            return preds->geotype == HvaultGeolocationCompact ||
+                   preds->geotype == HvaultGeolocationSimple;
+        default:
+            return false;
+    }
 }
 
-static inline bool 
-Within_op(float latmin, 
-          float latmax, 
-          float lonmin, 
-          float lonmax, 
-          GBOX const *arg)
+void
+hvaultPredicatesReset (HvaultPredicates preds)
 {
-    return !( (arg->ymin > latmin) || (arg->ymax < latmax) ||
-              (arg->xmin > lonmin) || (arg->xmax < lonmax) );
+    preds->num = 0;
+    preds->empty = false;
+    preds->has_region = false;
+    preds->need_footprint = false;
+    preds->need_point = false;
 }
 
-static inline bool 
-Same_op(float latmin, 
-          float latmax, 
-          float lonmin, 
-          float lonmax, 
-          GBOX const *arg)
+/* Float value nearest to c that is not greater than c */
+static inline float
+floorFloat (double c)
 {
-    return !( (latmin != arg->ymin) || (latmax != arg->ymax) ||
-              (lonmin != arg->xmin) || (lonmax != arg->xmax) );
+    float f = (float) c;
+    if ((double) f > c)
+        f = nextafterf(f, -INFINITY);
+    return f;
 }
 
-static inline bool 
-Overleft_op(float latmin, 
-            float latmax, 
-            float lonmin, 
-            float lonmax, 
-            GBOX const *arg)
+/* Float value nearest to c that is not less than c */
+static inline float
+ceilFloat (double c)
 {
-    (void)(latmin);
-    (void)(lonmin);
-    (void)(lonmax);
+    float f = (float) c;
+    if ((double) f < c)
+        f = nextafterf(f, INFINITY);
+    return f;
+}
 
-    return latmax <= arg->ymax;
+/*
+ * Converts comparison of float bound with double argument value to
+ * the equivalent comparison of floats.
+ */
+static float
+compileConstant (Comparison cmp, double c)
+{
+    switch (cmp)
+    {
+        case CmpLT:
+        case CmpGE:
+            return ceilFloat(c);
+        case CmpLE:
+        case CmpGT:
+            return floorFloat(c);
+        case CmpNE:
+            /* Nothing is equal to unrepresentable value, NaN is never equal */
+            return (double) (float) c == c ? (float) c : NAN;
+    }
+    return NAN; /* Will never reach this */
 }
 
-static inline bool 
-Left_op(float latmin, 
-        float latmax, 
-        float lonmin, 
-        float lonmax, 
-        GBOX const *arg)
+void
+hvaultPredicatesAdd (HvaultPredicates   preds,
+                     HvaultColumnType   coltype,
+                     HvaultGeomOperator op,
+                     bool               isneg,
+                     GBOX const *       arg)
 {
-    (void)(latmin);
-    (void)(lonmin);
-    (void)(lonmax);
+    OperatorSpec const * spec;
+    Predicate * pred;
+    int i;
+
+    Assert(op >= 0 && op < HvaultGeomNumAllOpers);
+    Assert(hvaultPredicatesSupported(preds, coltype));
+
+    if (preds->num == preds->bufsize)
+    {
+        preds->bufsize = preds->bufsize == 0 ? 4 : preds->bufsize * 2;
+        if (preds->preds == NULL)
+        {
+            preds->preds = MemoryContextAlloc(preds->memctx,
+                sizeof(Predicate) * preds->bufsize);
+            preds->order = MemoryContextAlloc(preds->memctx,
+                sizeof(size_t) * preds->bufsize);
+        }
+        else
+        {
+            preds->preds = repalloc(preds->preds,
+                                    sizeof(Predicate) * preds->bufsize);
+            preds->order = repalloc(preds->order,
+                                    sizeof(size_t) * preds->bufsize);
+        }
+    }
+
+    spec = &operators[op];
+    preds->order[preds->num] = preds->num;
+    pred = preds->preds + preds->num++;
+    if (preds->num > preds->num_stats)
+    {
+        pred->tested = pred->passed = 0;
+        preds->num_stats = preds->num;
+    }
+    pred->coltype = coltype;
+    pred->invert = spec->invert ^ isneg;
+    pred->nterms = spec->nterms;
+    if (arg == NULL)
+    {
+        /* Predicate is never evaluated, it only keeps statistics slot */
+        pred->nterms = 0;
+        preds->empty = true;
+        return;
+    }
+
+    /* Passing pixels of these operators intersect argument box */
+    if (!isneg && (op == HvaultGeomOverlaps || op == HvaultGeomContains ||
+                   op == HvaultGeomWithin || op == HvaultGeomSame))
+    {
+        if (!preds->has_region)
+        {
+            preds->region = *arg;
+            preds->has_region = true;
+        }
+        else
+        {
+            preds->region.xmin = Max(preds->region.xmin, arg->xmin);
+            preds->region.xmax = Min(preds->region.xmax, arg->xmax);
+            preds->region.ymin = Max(preds->region.ymin, arg->ymin);
+            preds->region.ymax = Min(preds->region.ymax, arg->ymax);
+        }
+    }
+
+    for (i = 0; i < spec->nterms; i++)
+    {
+        double c = 0;
 
-    return latmax < arg->ymin;
+        switch (spec->terms[i].arg)
+        {
+            case ArgXMin: c = arg->xmin; break;
+            case ArgXMax: c = arg->xmax; break;
+            case ArgYMin: c = arg->ymin; break;
+            case ArgYMax: c = arg->ymax; break;
+        }
+        pred->bound[i] = spec->terms[i].bound;
+        pred->cmp[i] = spec->terms[i].cmp;
+        pred->val[i] = compileConstant(spec->terms[i].cmp, c);
+        pred->src[i] = NULL;
+    }
+
+    if (coltype == HvaultColumnFootprint)
+        preds->need_footprint = true;
+    else
+        preds->need_point = true;
 }
 
-static inline bool 
-Right_op(float latmin, 
-         float latmax, 
-         float lonmin, 
-         float lonmax, 
-         GBOX const *arg)
-{
-    (void)(latmax);
-    (void)(lonmin);
-    (void)(lonmax);
+/*
+ * Min and max are defined so that they match SIMD instructions:
+ * min(a, b) == minps(a, b) and max(a, b) == maxps(b, a)
+ */
+#define min(a, b) ((a < b) ? a : b)
+#define max(a, b) ((a < b) ? b : a)
+
+#if defined(__AVX__)
+
+#define VEC_WIDTH 8
+typedef __m256 vec;
+#define vec_load(p)      _mm256_loadu_ps(p)
+#define vec_store(p, a)  _mm256_storeu_ps(p, a)
+#define vec_set1(v)      _mm256_set1_ps(v)
+#define vec_zero()       _mm256_setzero_ps()
+#define vec_ones()       _mm256_castsi256_ps(_mm256_set1_epi32(-1))
+#define vec_min(a, b)    _mm256_min_ps(a, b)
+#define vec_max(a, b)    _mm256_max_ps(b, a)
+#define vec_or(a, b)     _mm256_or_ps(a, b)
+#define vec_and(a, b)    _mm256_and_ps(a, b)
+#define vec_xor(a, b)    _mm256_xor_ps(a, b)
+#define vec_lt(a, b)     _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define vec_le(a, b)     _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define vec_gt(a, b)     _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define vec_ge(a, b)     _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define vec_ne(a, b)     _mm256_cmp_ps(a, b, _CMP_NEQ_UQ)
+#define vec_mask(a)      _mm256_movemask_ps(a)
+#define vec_isnan(a)     _mm256_cmp_ps(a, a, _CMP_UNORD_Q)
+
+#elif defined(__SSE2__)
+
+#define VEC_WIDTH 4
+typedef __m128 vec;
+#define vec_load(p)      _mm_loadu_ps(p)
+#define vec_store(p, a)  _mm_storeu_ps(p, a)
+#define vec_set1(v)      _mm_set1_ps(v)
+#define vec_zero()       _mm_setzero_ps()
+#define vec_ones()       _mm_castsi128_ps(_mm_set1_epi32(-1))
+#define vec_min(a, b)    _mm_min_ps(a, b)
+#define vec_max(a, b)    _mm_max_ps(b, a)
+#define vec_or(a, b)     _mm_or_ps(a, b)
+#define vec_and(a, b)    _mm_and_ps(a, b)
+#define vec_xor(a, b)    _mm_xor_ps(a, b)
+#define vec_lt(a, b)     _mm_cmplt_ps(a, b)
+#define vec_le(a, b)     _mm_cmple_ps(a, b)
+#define vec_gt(a, b)     _mm_cmpgt_ps(a, b)
+#define vec_ge(a, b)     _mm_cmpge_ps(a, b)
+#define vec_ne(a, b)     _mm_cmpneq_ps(a, b)
+#define vec_mask(a)      _mm_movemask_ps(a)
+#define vec_isnan(a)     _mm_cmpunord_ps(a, a)
+
+#endif
+
+#define bounds(a, b, c, d, minval, maxval, mn, mx) \
+do { \
+    minval = mn(mn(a, b), mn(c, d)); \
+    maxval = mx(mx(a, b), mx(c, d)); \
+} while(0)
 
-    return latmin > arg->ymax;
+/*
+ * Corner bounds of compact geolocation: (stride+1) x (lines+1) grid.
+ * Computes bounds of pixels [s0, s1) of the line.
+ */
+static void
+compactBounds (HvaultPredicates        preds,
+               HvaultFileChunk const * chunk,
+               size_t                  line,
+               size_t                  s0,
+               size_t                  s1)
+{
+    size_t const stride = chunk->stride;
+    float const * const lat0 = chunk->lat + line * (stride + 1);
+    float const * const lat1 = lat0 + stride + 1;
+    float const * const lon0 = chunk->lon + line * (stride + 1);
+    float const * const lon1 = lon0 + stride + 1;
+    float * const latmin = preds->bounds[BoundLatMin] + line * stride;
+    float * const latmax = preds->bounds[BoundLatMax] + line * stride;
+    float * const lonmin = preds->bounds[BoundLonMin] + line * stride;
+    float * const lonmax = preds->bounds[BoundLonMax] + line * stride;
+    size_t s = s0;
+
+#ifdef VEC_WIDTH
+    for (; s + VEC_WIDTH <= s1; s += VEC_WIDTH)
+    {
+        vec mn, mx;
+
+        bounds(vec_load(lat0 + s), vec_load(lat0 + s + 1),
+               vec_load(lat1 + s + 1), vec_load(lat1 + s),
+               mn, mx, vec_min, vec_max);
+        vec_store(latmin + s, mn);
+        vec_store(latmax + s, mx);
+
+        bounds(vec_load(lon0 + s), vec_load(lon0 + s + 1),
+               vec_load(lon1 + s + 1), vec_load(lon1 + s),
+               mn, mx, vec_min, vec_max);
+        vec_store(lonmin + s, mn);
+        vec_store(lonmax + s, mx);
+    }
+#endif
+    for (; s < s1; s++)
+    {
+        bounds(lat0[s], lat0[s+1], lat1[s+1], lat1[s],
+               latmin[s], latmax[s], min, max);
+        bounds(lon0[s], lon0[s+1], lon1[s+1], lon1[s],
+               lonmin[s], lonmax[s], min, max);
+    }
 }
 
-static inline bool 
-Overright_op(float latmin, 
-             float latmax, 
-             float lonmin, 
-             float lonmax, 
-             GBOX const *arg)
+/* Corner bounds of simple geolocation: 4 corners for every pixel */
+static void
+simpleBounds (HvaultPredicates        preds,
+              HvaultFileChunk const * chunk,
+              size_t                  from,
+              size_t                  to)
 {
-    (void)(latmax);
-    (void)(lonmin);
-    (void)(lonmax);
+    size_t i;
 
-    return latmin >= arg->ymin;
+    for (i = from; i < to; i++)
+    {
+        float const * const lat = chunk->lat + 4*i;
+        float const * const lon = chunk->lon + 4*i;
+
+        bounds(lat[0], lat[1], lat[2], lat[3],
+               preds->bounds[BoundLatMin][i], preds->bounds[BoundLatMax][i],
+               min, max);
+        bounds(lon[0], lon[1], lon[2], lon[3],
+               preds->bounds[BoundLonMin][i], preds->bounds[BoundLonMax][i],
+               min, max);
+    }
 }
 
-static inline bool 
-Overbelow_op(float latmin, 
-             float latmax, 
-             float lonmin, 
-             float lonmax, 
-             GBOX const *arg)
+static void
+footprintBounds (HvaultPredicates        preds,
+                 HvaultFileChunk const * chunk,
+                 size_t                  line,
+                 size_t                  s0,
+                 size_t                  s1)
+{
+    switch (preds->geotype)
+    {
+        case HvaultGeolocationCompact:
+            compactBounds(preds, chunk, line, s0, s1);
+            break;
+        case HvaultGeolocationSimple:
+            simpleBounds(preds, chunk, line * chunk->stride + s0,
+                         line * chunk->stride + s1);
+            break;
+    }
+}
+
+/*
+ * Chunk is split into tiles. Predicates are first checked against the range
+ * of pixel bounds inside a tile, so that tiles which entirely match or
+ * entirely fail don't need per-pixel evaluation.
+ */
+#define TILE_LINES 16
+#define TILE_SAMPLES 64
+
+typedef enum
+{
+    TileNone = 0,  /* no pixel matches */
+    TileSome,      /* pixels need to be checked one by one */
+    TileAll        /* every pixel matches */
+} TileClass;
+
+/* Range of values, NaNs are tracked separately */
+typedef struct
 {
-    (void)(latmin);
-    (void)(latmax);
-    (void)(lonmin);
+    float lo, hi;
+    bool nan;
+} Range;
 
-    return lonmax <= arg->xmax;
+typedef struct Tile
+{
+    Range footprint[2];  /* lat, lon */
+    Range point[2];
+} Tile;
+
+static inline void
+rangeInit (Range * r)
+{
+    r->lo = INFINITY;
+    r->hi = -INFINITY;
+    r->nan = false;
+}
+
+static inline void
+rangeMerge (Range * r, Range const * other)
+{
+    if (other->lo < r->lo) r->lo = other->lo;
+    if (other->hi > r->hi) r->hi = other->hi;
+    r->nan |= other->nan;
 }
 
-static inline bool 
-Below_op(float latmin, 
-         float latmax, 
-         float lonmin, 
-         float lonmax, 
-         GBOX const *arg)
+static void
+rangeUpdate (Range * r, float const * p, size_t n)
 {
-    (void)(latmin);
-    (void)(latmax);
-    (void)(lonmin);
+    size_t i = 0;
+
+#ifdef VEC_WIDTH
+    if (n >= VEC_WIDTH)
+    {
+        vec lo = vec_set1(r->lo), hi = vec_set1(r->hi), nan = vec_zero();
+        float buf[VEC_WIDTH];
+        int j;
+
+        for (; i + VEC_WIDTH <= n; i += VEC_WIDTH)
+        {
+            vec v = vec_load(p + i);
+            /* min(v, lo) returns lo if v is NaN */
+            lo = vec_min(v, lo);
+            hi = vec_max(hi, v);
+            nan = vec_or(nan, vec_isnan(v));
+        }
 
-    return lonmax < arg->xmin;
+        r->nan |= vec_mask(nan) != 0;
+        vec_store(buf, lo);
+        for (j = 0; j < VEC_WIDTH; j++)
+            if (buf[j] < r->lo) r->lo = buf[j];
+        vec_store(buf, hi);
+        for (j = 0; j < VEC_WIDTH; j++)
+            if (buf[j] > r->hi) r->hi = buf[j];
+    }
+#endif
+    for (; i < n; i++)
+    {
+        if (isnan(p[i]))
+            r->nan = true;
+        if (p[i] < r->lo) r->lo = p[i];
+        if (p[i] > r->hi) r->hi = p[i];
+    }
 }
 
-static inline bool 
-Above_op(float latmin, 
-         float latmax, 
-         float lonmin, 
-         float lonmax, 
-         GBOX const *arg)
+/* Computes value ranges of tile pixels [s0, s1) of lines [l0, l1) */
+static void
+tileBounds (HvaultPredicates        preds,
+            HvaultFileChunk const * chunk,
+            Tile                  * tile,
+            size_t l0, size_t l1, size_t s0, size_t s1)
 {
-    (void)(latmin);
-    (void)(latmax);
-    (void)(lonmax);
+    size_t const stride = chunk->stride;
+    size_t line;
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        rangeInit(&tile->footprint[i]);
+        rangeInit(&tile->point[i]);
+    }
 
-    return lonmin > arg->xmax;
+    if (preds->need_footprint)
+    {
+        switch (preds->geotype)
+        {
+            case HvaultGeolocationCompact:
+                for (line = l0; line <= l1; line++)
+                {
+                    size_t const pos = line * (stride + 1) + s0;
+                    rangeUpdate(&tile->footprint[0], chunk->lat + pos,
+                                s1 - s0 + 1);
+                    rangeUpdate(&tile->footprint[1], chunk->lon + pos,
+                                s1 - s0 + 1);
+                }
+                break;
+            case HvaultGeolocationSimple:
+                for (line = l0; line < l1; line++)
+                {
+                    size_t const pos = 4 * (line * stride + s0);
+                    rangeUpdate(&tile->footprint[0], chunk->lat + pos,
+                                4 * (s1 - s0));
+                    rangeUpdate(&tile->footprint[1], chunk->lon + pos,
+                                4 * (s1 - s0));
+                }
+                break;
+        }
+    }
+
+    if (preds->need_point)
+    {
+        for (line = l0; line < l1; line++)
+        {
+            size_t const pos = line * stride + s0;
+            rangeUpdate(&tile->point[0], chunk->point_lat + pos, s1 - s0);
+            rangeUpdate(&tile->point[1], chunk->point_lon + pos, s1 - s0);
+        }
+    }
 }
 
-static inline bool 
-Overabove_op(float latmin, 
-             float latmax, 
-             float lonmin, 
-             float lonmax, 
-             GBOX const *arg)
+/* Classifies comparison of value from range r with c */
+static TileClass
+classifyTerm (Comparison cmp, float c, Range const * r)
 {
-    (void)(latmin);
-    (void)(latmax);
-    (void)(lonmax);
+    bool all, none;
 
-    return lonmin >= arg->xmin;
+    switch (cmp)
+    {
+        case CmpLT:
+            all = r->hi < c;
+            none = !(r->lo < c);
+            break;
+        case CmpLE:
+            all = r->hi <= c;
+            none = !(r->lo <= c);
+            break;
+        case CmpGT:
+            all = r->lo > c;
+            none = !(r->hi > c);
+            break;
+        case CmpGE:
+            all = r->lo >= c;
+            none = !(r->hi >= c);
+            break;
+        case CmpNE:
+            /* NaN is not equal to anything */
+            if (isnan(c) || c < r->lo || c > r->hi)
+                return TileAll;
+            if (r->lo == c && r->hi == c && !r->nan)
+                return TileNone;
+            return TileSome;
+        default:
+            return TileSome;
+    }
+
+    /* Comparisons with NaN are always false */
+    if (none)
+        return TileNone;
+    if (all && !r->nan)
+        return TileAll;
+    return TileSome;
 }
 
-static inline bool 
-CommLeft_op(float latmin, 
-            float latmax, 
-            float lonmin, 
-            float lonmax, 
-            GBOX const *arg)
+static TileClass
+classifyPredicate (Predicate const * pred, Tile const * tile)
 {
-    (void)(latmin);
-    (void)(lonmin);
-    (void)(lonmax);
+    Range const * ranges = pred->coltype == HvaultColumnPoint ?
+        tile->point : tile->footprint;
+    TileClass res = TileNone;
+    int t;
+
+    for (t = 0; t < pred->nterms; t++)
+    {
+        Range const * r = ranges +
+            (pred->bound[t] == BoundLatMin || pred->bound[t] == BoundLatMax ?
+             0 : 1);
+        TileClass c = classifyTerm(pred->cmp[t], pred->val[t], r);
+
+        if (c > res)
+            res = c;
+        if (res == TileAll)
+            break;
+    }
 
-    return latmax >= arg->ymax;
+    if (pred->invert)
+        res = TileAll - res;
+    return res;
 }
 
-static inline bool 
-CommRight_op(float latmin, 
-             float latmax, 
-             float lonmin, 
-             float lonmax, 
-             GBOX const *arg)
+/*
+ * Classifies tile of npix pixels against all predicates in evaluation order.
+ * Indices of predicates that need per-pixel evaluation are stored in active.
+ * Decided predicates are accounted in statistics for all tile pixels.
+ */
+static TileClass
+classifyTile (HvaultPredicates preds,
+              Tile const     * tile,
+              size_t           npix,
+              size_t         * active,
+              size_t         * nactive)
 {
-    (void)(latmax);
-    (void)(lonmin);
-    (void)(lonmax);
+    size_t k;
 
-    return latmin <= arg->ymin;
+    *nactive = 0;
+    for (k = 0; k < preds->num; k++)
+    {
+        Predicate * const pred = preds->preds + preds->order[k];
+
+        switch (classifyPredicate(pred, tile))
+        {
+            case TileNone:
+                pred->tested += npix;
+                return TileNone;
+            case TileSome:
+                active[(*nactive)++] = preds->order[k];
+                break;
+            case TileAll:
+                pred->tested += npix;
+                pred->passed += npix;
+                break;
+        }
+    }
+    return *nactive == 0 ? TileAll : TileSome;
 }
 
-static inline bool 
-CommBelow_op(float latmin, 
-             float latmax, 
-             float lonmin, 
-             float lonmax, 
-             GBOX const *arg)
+/*
+ * Sorts predicates by their rank, so that cheap predicates which reject
+ * many pixels are evaluated first. Cost of predicate is proportional to 
+ * the number of its comparisons.
+ */
+static void
+reorderPredicates (HvaultPredicates preds)
 {
-    (void)(latmin);
-    (void)(latmax);
-    (void)(lonmin);
+    size_t * const order = preds->order;
+    double rank[preds->num];
+    size_t i, j;
 
-    return lonmax >= arg->xmax;
+    for (i = 0; i < preds->num; i++)
+    {
+        Predicate const * const pred = preds->preds + i;
+        double sel = (pred->passed + 1.0) / (pred->tested + 2.0);
+        rank[i] = pred->nterms / (1.0 - sel);
+    }
+
+    /* Insertion sort, number of predicates is small */
+    for (i = 1; i < preds->num; i++)
+    {
+        size_t const cur = order[i];
+        for (j = i; j > 0 && rank[order[j-1]] > rank[cur]; j--)
+            order[j] = order[j-1];
+        order[j] = cur;
+    }
 }
 
-static inline bool 
-CommAbove_op(float latmin, 
-             float latmax, 
-             float lonmin, 
-             float lonmax, 
-             GBOX const *arg)
+static inline bool
+evalTerm (Comparison cmp, float a, float b)
 {
-    (void)(latmin);
-    (void)(latmax);
-    (void)(lonmax);
+    switch (cmp)
+    {
+        case CmpLT: return a < b;
+        case CmpLE: return a <= b;
+        case CmpGT: return a > b;
+        case CmpGE: return a >= b;
+        case CmpNE: return a != b;
+    }
+    return false;
+}
 
-    return lonmin <= arg->xmin;
+#ifdef VEC_WIDTH
+static inline vec
+evalTermVec (Comparison cmp, vec a, vec b)
+{
+    switch (cmp)
+    {
+        case CmpLT: return vec_lt(a, b);
+        case CmpLE: return vec_le(a, b);
+        case CmpGT: return vec_gt(a, b);
+        case CmpGE: return vec_ge(a, b);
+        case CmpNE: return vec_ne(a, b);
+    }
+    return vec_zero();
 }
+#endif
+
+/* Evaluates active predicates on pixels [from, to) in one fused pass */
+static size_t
+evalPixels (Predicate       * pred,
+            size_t const    * active,
+            size_t            nactive,
+            size_t            from,
+            size_t            to,
+            size_t          * sel)
+{
+    size_t i = from, n = 0, a;
+    int t;
 
-typedef bool (*geom_predicate_op)(float latmin,
-                                  float latmax,
-                                  float lonmin,
-                                  float lonmax,
-                                  GBOX const *arg);
-
-#define min(a, b) ((a < b) ? a : b) 
-#define max(a, b) ((a < b) ? b : a) 
-#define bounds(a, b, c, d, minval, maxval) \
-{ \
-    float minab, maxab, mincd, maxcd; \
-    minab = min(a, b); \
-    maxab = max(a, b); \
-    mincd = min(c, d); \
-    maxcd = max(c, d); \
-    minval = min(minab, mincd); \
-    maxval = max(maxab, maxcd); \
-} while(0)
+#ifdef VEC_WIDTH
+    for (; i + VEC_WIDTH <= to; i += VEC_WIDTH)
+    {
+        vec acc = vec_ones();
+        unsigned mask;
 
-#define compact_bounds \
-{ \
-    float ul, ur, lr, ll; \
-    size_t pos = cur + cur / data->stride; \
-  \
-    ul = data->lat[pos]; \
-    ur = data->lat[pos + 1]; \
-    lr = data->lat[pos + data->stride + 2]; \
-    ll = data->lat[pos + data->stride + 1]; \
-    bounds(ul, ur, lr, ll, latmin, latmax); \
- \
-    ul = data->lon[pos]; \
-    ur = data->lon[pos + 1]; \
-    lr = data->lon[pos + data->stride + 2]; \
-    ll = data->lon[pos + data->stride + 1]; \
-    bounds(ul, ur, lr, ll, lonmin, lonmax); \
-} while(0)
+        for (a = 0; a < nactive; a++)
+        {
+            Predicate * const cur = pred + active[a];
+            vec res = vec_zero();
 
-#define simple_bounds \
-{ \
-    float ul, ur, lr, ll; \
-  \
-    ul = data->lat[4*cur + 0]; \
-    ur = data->lat[4*cur + 1]; \
-    lr = data->lat[4*cur + 2]; \
-    ll = data->lat[4*cur + 3]; \
-    bounds(ul, ur, lr, ll, latmin, latmax); \
-  \
-    ul = data->lon[4*cur + 0]; \
-    ur = data->lon[4*cur + 1]; \
-    lr = data->lon[4*cur + 2]; \
-    ll = data->lon[4*cur + 3]; \
-    bounds(ul, ur, lr, ll, lonmin, lonmax); \
-} while(0)
+            for (t = 0; t < cur->nterms; t++)
+            {
+                res = vec_or(res, evalTermVec(cur->cmp[t],
+                                              vec_load(cur->src[t] + i),
+                                              vec_set1(cur->val[t])));
+            }
+            if (cur->invert)
+                res = vec_xor(res, vec_ones());
+            cur->tested += __builtin_popcount(vec_mask(acc));
+            acc = vec_and(acc, res);
+            mask = vec_mask(acc);
+            cur->passed += __builtin_popcount(mask);
+            if (mask == 0)
+                break;
+        }
 
-#define point_bounds \
-{ \
-    float lat, lon; \
-  \
-    lat = data->point_lat[cur]; \
-    lon = data->point_lon[cur]; \
-  \
-    latmin = latmax = lat; \
-    lonmin = lonmax = lon; \
-} while(0)
+        mask = vec_mask(acc);
+        while (mask)
+        {
+            sel[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < to; i++)
+    {
+        bool pass = true;
 
-#define cur_simple size_t cur = i
-#define cur_indexed size_t cur = idx[i]
-
-#define predicate_cycle(cur, my_bounds, op, neg) \
-{ \
-    for (i = 0, j = 0; i < len; i++) \
-    { \
-        float latmin, latmax, lonmin, lonmax; \
-        cur; \
-        my_bounds; \
-        if (op(latmin, latmax, lonmin, lonmax, arg) ^ (neg)) \
-            idx[j++] = i; \
-    } \
-} while(0)
+        for (a = 0; a < nactive && pass; a++)
+        {
+            Predicate * const cur = pred + active[a];
+            bool res = false;
+
+            for (t = 0; t < cur->nterms; t++)
+                res |= evalTerm(cur->cmp[t], cur->src[t][i], cur->val[t]);
+
+            pass = res != cur->invert;
+            cur->tested++;
+            cur->passed += pass;
+        }
+        if (pass)
+            sel[n++] = i;
+    }
 
-#define positive false 
-#define negative true
-
-#define predicate_template(src_type, op, neg) \
-static size_t op ## _ ## src_type ## _ ## neg (  \
-    size_t * idx,  \
-    size_t len,  \
-    HvaultFileChunk const * const data, \
-    GBOX const * const arg) \
-{ \
-    size_t i, j; \
-    if (len == data->size) \
-    { \
-        /* Use full dataset */ \
-        predicate_cycle(cur_simple, src_type ## _bounds, op ## _op, neg); \
-    } \
-    else \
-    { \
-        /* Use selected indices */ \
-        predicate_cycle(cur_indexed, src_type ## _bounds, op ## _op, neg); \
-    } \
-    return j; \
-} 
-
-/* predicate template */
-static size_t Overlaps_compact_positive (
-    size_t * idx,
-    size_t len,
-    HvaultFileChunk const * const data,
-    GBOX const * const arg)
+    return n;
+}
+
+size_t
+hvaultPredicatesEval (HvaultPredicates        preds,
+                      HvaultFileChunk const * chunk,
+                      size_t                  * sel)
 {
-    size_t i, j;
-    if (len == data->size)
+    float const * point[BoundNum];
+    Predicate * const pred = preds->preds;
+    size_t const num = preds->num;
+    size_t const size = chunk->size;
+    size_t const stride = chunk->stride;
+    size_t const lines = stride > 0 ? size / stride : 0;
+    size_t const tiles_per_line = (stride + TILE_SAMPLES - 1) / TILE_SAMPLES;
+    size_t const ntiles = (lines + TILE_LINES - 1) / TILE_LINES *
+                          tiles_per_line;
+    size_t active[Max(tiles_per_line, 1)][Max(num, 1)];
+    size_t nactive[Max(tiles_per_line, 1)];
+    TileClass cls[Max(tiles_per_line, 1)];
+    Tile chunk_tile;
+    size_t l0, line, tx, p, n;
+    int i, t;
+
+    if (preds->empty)
+        return 0;
+
+    if (num == 0 || size == 0)
+        return size;
+
+    /* Allocate buffers */
+    if (preds->need_footprint && preds->bounds_size < size)
     {
-        /* Use full dataset */
-        /*predicate_cycle(cur_simple, src_type ## _bounds, op ## _op, neg);*/
-        for (i = 0, j = 0; i < len; i++)
+        for (i = 0; i < BoundNum; i++)
         {
-            float latmin, latmax, lonmin, lonmax;
+            if (preds->bounds[i] != NULL)
+                pfree(preds->bounds[i]);
+            preds->bounds[i] = MemoryContextAlloc(preds->memctx,
+                                                  sizeof(float) * size);
+        }
+        preds->bounds_size = size;
+    }
+    if (preds->tiles_size < ntiles)
+    {
+        if (preds->tiles != NULL)
+            pfree(preds->tiles);
+        preds->tiles = MemoryContextAlloc(preds->memctx,
+                                          sizeof(Tile) * ntiles);
+        preds->tiles_size = ntiles;
+    }
 
-            /* cur_simple */
-            size_t cur = i;
+    /* Bind bound arrays of this chunk */
+    point[BoundLatMin] = point[BoundLatMax] = chunk->point_lat;
+    point[BoundLonMin] = point[BoundLonMax] = chunk->point_lon;
+    for (p = 0; p < num; p++)
+    {
+        for (t = 0; t < pred[p].nterms; t++)
+        {
+            pred[p].src[t] = (pred[p].coltype == HvaultColumnPoint) ?
+                point[pred[p].bound[t]] : preds->bounds[pred[p].bound[t]];
+        }
+    }
 
-            /* compact bounds */
-            float ul, ur, lr, ll;
-            size_t pos = cur + cur / data->stride;
-          
-            ul = data->lat[pos];
-            ur = data->lat[pos + 1];
-            lr = data->lat[pos + data->stride + 2];
-            ll = data->lat[pos + data->stride + 1];
+    /* Tile bounds and chunk bounds as their union */
+    for (i = 0; i < 2; i++)
+    {
+        rangeInit(&chunk_tile.footprint[i]);
+        rangeInit(&chunk_tile.point[i]);
+    }
+    for (l0 = 0; l0 < lines; l0 += TILE_LINES)
+    {
+        size_t const l1 = Min(l0 + TILE_LINES, lines);
+        for (tx = 0; tx < tiles_per_line; tx++)
+        {
+            size_t const s0 = tx * TILE_SAMPLES;
+            size_t const s1 = Min(s0 + TILE_SAMPLES, stride);
+            Tile * const tile = preds->tiles +
+                                l0 / TILE_LINES * tiles_per_line + tx;
 
-            /*bounds(ul, ur, lr, ll, latmin, latmax);*/
+            tileBounds(preds, chunk, tile, l0, l1, s0, s1);
+            for (i = 0; i < 2; i++)
             {
-                float minab, maxab, mincd, maxcd;
-                minab = min(ul, ur);
-                maxab = max(ul, ur);
-                mincd = min(lr, ll);
-                maxcd = max(lr, ll);
-                latmin = min(minab, mincd);
-                latmax = max(maxab, maxcd);
+                rangeMerge(&chunk_tile.footprint[i], &tile->footprint[i]);
+                rangeMerge(&chunk_tile.point[i], &tile->point[i]);
             }
+        }
+    }
+
+    reorderPredicates(preds);
+    switch (classifyTile(preds, &chunk_tile, 0, active[0], nactive))
+    {
+        case TileNone:
+            /* Account statistics for whole chunk */
+            classifyTile(preds, &chunk_tile, size, active[0], nactive);
+            return 0;
+        case TileAll:
+            classifyTile(preds, &chunk_tile, size, active[0], nactive);
+            return size;
+        case TileSome:
+            break;
+    }
+
+    /* Process tiles row by row, so that selection stays sorted */
+    n = 0;
+    for (l0 = 0; l0 < lines; l0 += TILE_LINES)
+    {
+        size_t const l1 = Min(l0 + TILE_LINES, lines);
+        Tile const * const row = preds->tiles +
+                                 l0 / TILE_LINES * tiles_per_line;
 
-         
-            ul = data->lon[pos];
-            ur = data->lon[pos + 1];
-            lr = data->lon[pos + data->stride + 2];
-            ll = data->lon[pos + data->stride + 1];
-            /*bounds(ul, ur, lr, ll, lonmin, lonmax); */
+        for (tx = 0; tx < tiles_per_line; tx++)
+        {
+            size_t const npix = (l1 - l0) *
+                (Min((tx + 1) * TILE_SAMPLES, stride) - tx * TILE_SAMPLES);
+            cls[tx] = classifyTile(preds, row + tx, npix, 
+                                   active[tx], nactive + tx);
+        }
+
+        for (line = l0; line < l1; line++)
+        {
+            for (tx = 0; tx < tiles_per_line; tx++)
             {
-                float minab, maxab, mincd, maxcd;
-                minab = min(ul, ur);
-                maxab = max(ul, ur);
-                mincd = min(lr, ll);
-                maxcd = max(lr, ll);
-                lonmin = min(minab, mincd);
-                lonmax = max(maxab, maxcd);
+                size_t const s0 = tx * TILE_SAMPLES;
+                size_t const s1 = Min(s0 + TILE_SAMPLES, stride);
+                size_t s;
+
+                switch (cls[tx])
+                {
+                    case TileNone:
+                        break;
+                    case TileAll:
+                        for (s = s0; s < s1; s++)
+                            sel[n++] = line * stride + s;
+                        break;
+                    case TileSome:
+                        for (p = 0; p < nactive[tx]; p++)
+                        {
+                            if (pred[active[tx][p]].coltype == 
+                                HvaultColumnFootprint)
+                            {
+                                footprintBounds(preds, chunk, line, s0, s1);
+                                break;
+                            }
+                        }
+                        n += evalPixels(pred, active[tx], nactive[tx],
+                                        line * stride + s0,
+                                        line * stride + s1, sel + n);
+                        break;
+                }
             }
-            
-            if (Overlaps_op(latmin, latmax, lonmin, lonmax, arg) ^ (false))
-                idx[j++] = i;
         }
     }
+
+    return n;
+}
+
+bool
+hvaultPredicatesGetRegion (HvaultPredicates preds, GBOX * region)
+{
+    if (!preds->has_region)
+        return false;
+    *region = preds->region;
+    return true;
+}
+
+void
+hvaultPredicatesGetStats (HvaultPredicates preds,
+                          size_t           idx,
+                          uint64         * tested,
+                          uint64         * passed)
+{
+    if (idx < preds->num_stats)
+    {
+        *tested = preds->preds[idx].tested;
+        *passed = preds->preds[idx].passed;
+    }
     else
     {
-        /* Use selected indices */
-        predicate_cycle(cur_indexed, compact_bounds, Overlaps_op, false);
-    }
-    return j;
-} 
-
-#define predicate_multitemplate(op) \
-    predicate_template(simple, op, positive) \
-    predicate_template(simple, op, negative) \
-    predicate_template(compact, op, positive) \
-    predicate_template(compact, op, negative) \
-    predicate_template(point, op, positive) \
-    predicate_template(point, op, negative) 
-
-#define operators_list(item) \
-    item(Overlaps) \
-    item(Contains) \
-    item(Within) \
-    item(Same) \
-    item(Overleft) \
-    item(Overright) \
-    item(Overabove) \
-    item(Overbelow) \
-    item(Left) \
-    item(Right) \
-    item(Above) \
-    item(Below) \
-    item(CommLeft) \
-    item(CommRight) \
-    item(CommAbove) \
-    item(CommBelow) 
-
-#define Overlaps_compact_positive Overlaps_compact_positive_other
-operators_list(predicate_multitemplate)
-#undef Overlaps_compact_positive
-
-#define predicate_name(op, src_type) \
-    op ## _ ## src_type ## _ ## positive, \
-    op ## _ ## src_type ## _ ## negative, 
-
-#define point_predicate_name(op) predicate_name(op, point)
-HvaultPredicate hvaultPredicatesPoint[HvaultGeomNumAllOpers * 2] = 
-    { operators_list(point_predicate_name) };
-    
-#define simple_predicate_name(op) predicate_name(op, simple)
-HvaultPredicate hvaultPredicatesSimple[HvaultGeomNumAllOpers * 2] = 
-    { operators_list(simple_predicate_name) };
-
-#define compact_predicate_name(op) predicate_name(op, compact)
-HvaultPredicate hvaultPredicatesCompact[HvaultGeomNumAllOpers * 2] = 
-    { operators_list(compact_predicate_name) };
+        *tested = *passed = 0;
+    }
+}
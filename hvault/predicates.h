@@ -3,38 +3,53 @@
 
 #include "driver.h"
 
-typedef size_t (* HvaultPredicate)(size_t * idx,
-                                   size_t len, 
-                                   HvaultFileChunk const * data,
-                                   GBOX const * arg);
-
-extern HvaultPredicate hvaultPredicatesPoint[HvaultGeomNumAllOpers * 2];
-extern HvaultPredicate hvaultPredicatesSimple[HvaultGeomNumAllOpers * 2];
-extern HvaultPredicate hvaultPredicatesCompact[HvaultGeomNumAllOpers * 2];
-
-static inline HvaultPredicate 
-hvaultGetPredicate (HvaultGeomOperator op, 
-                    bool isneg, 
-                    HvaultColumnType coltype, 
-                    HvaultGeolocationType geotype)
-{
-    switch (coltype) 
-    {
-        case HvaultColumnPoint:
-            return hvaultPredicatesPoint[op*2 + isneg];
-        case HvaultColumnFootprint:
-            switch (geotype)
-            {
-                case HvaultGeolocationSimple:
-                    return hvaultPredicatesSimple[op*2 + isneg];
-                case HvaultGeolocationCompact:
-                    return hvaultPredicatesCompact[op*2 + isneg];
-                default:
-                    return NULL;
-            }
-        default:
-            return NULL;
-    }
-}
+/*
+ * Predicate engine evaluates all geometry predicates pushed to the scan in
+ * one pass over a chunk. Predicate arguments are evaluated once per scan and
+ * compiled into float comparisons with pixel bounds.
+ */
+typedef struct HvaultPredicatesData * HvaultPredicates;
+
+/* Creates empty predicate set for given geolocation type */
+HvaultPredicates hvaultPredicatesInit (HvaultGeolocationType geotype,
+                                       MemoryContext         memctx);
+
+/* Returns true if predicate on this column is supported */
+bool hvaultPredicatesSupported (HvaultPredicates preds,
+                                HvaultColumnType coltype);
+
+/* Removes all predicates from the set, e.g. on rescan */
+void hvaultPredicatesReset (HvaultPredicates preds);
+
+/* Adds predicate with evaluated argument. NULL arg makes result empty. */
+void hvaultPredicatesAdd (HvaultPredicates   preds,
+                          HvaultColumnType   coltype,
+                          HvaultGeomOperator op,
+                          bool               isneg,
+                          GBOX const *       arg);
+
+/*
+ * Evaluates predicates on the chunk. Fills sel with sorted indices of
+ * matching pixels and returns their count. If all pixels match, sel may be
+ * left untouched.
+ */
+size_t hvaultPredicatesEval (HvaultPredicates        preds,
+                             HvaultFileChunk const * chunk,
+                             size_t                * sel);
+
+/*
+ * Returns box in lon/lat coordinates that every passing pixel intersects.
+ * Returns false if predicates don't bound pixel location.
+ */
+bool hvaultPredicatesGetRegion (HvaultPredicates preds, GBOX * region);
+
+/* 
+ * Returns number of pixels tested by predicate and number of passed ones. 
+ * Predicates are indexed in order of addition.
+ */
+void hvaultPredicatesGetStats (HvaultPredicates preds,
+                               size_t           idx,
+                               uint64         * tested,
+                               uint64         * passed);
 
 #endif
@@ -0,0 +1,304 @@
+/* pread and posix_fadvise are hidden by -D_POSIX_C_SOURCE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "readahead.h"
+
+#define READAHEAD_BLOCK_SIZE (1024*1024)
+
+struct HvaultReadaheadData
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int pipefd[2];      /* Completion notification, read end is nonblocking */
+    bool running;
+
+    /* Protected by mutex */
+    char ** files;      /* Pending request, malloc'ed */
+    int nfiles;
+    uint64 requested;   /* Generation of the last request */
+    uint64 completed;   /* Generation of the last completed request */
+    bool stop;
+};
+
+static void
+freeFiles (char ** files, int nfiles)
+{
+    int i;
+
+    if (files == NULL)
+        return;
+    for (i = 0; i < nfiles; i++)
+        free(files[i]);
+    free(files);
+}
+
+static inline bool
+isCancelled (HvaultReadahead ra, uint64 gen)
+{
+    bool res;
+
+    pthread_mutex_lock(&ra->mutex);
+    res = ra->stop || ra->requested != gen;
+    pthread_mutex_unlock(&ra->mutex);
+    return res;
+}
+
+/* Reads whole file so that its pages get into page cache */
+static void
+warmFile (HvaultReadahead ra, char const * filename, uint64 gen, char * buf)
+{
+    int fd;
+    off_t offset;
+    ssize_t res;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return; /* Driver will report it when opening file */
+
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+    offset = 0;
+    while (!isCancelled(ra, gen))
+    {
+        res = pread(fd, buf, READAHEAD_BLOCK_SIZE, offset);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        offset += res;
+    }
+
+    close(fd);
+}
+
+static void *
+readaheadThread (void * arg)
+{
+    HvaultReadahead ra = arg;
+    char * buf;
+
+    buf = malloc(READAHEAD_BLOCK_SIZE);
+
+    pthread_mutex_lock(&ra->mutex);
+    while (!ra->stop)
+    {
+        char ** files;
+        int nfiles, i;
+        uint64 gen;
+
+        if (ra->files == NULL)
+        {
+            pthread_cond_wait(&ra->cond, &ra->mutex);
+            continue;
+        }
+
+        files = ra->files;
+        nfiles = ra->nfiles;
+        gen = ra->requested;
+        ra->files = NULL;
+        ra->nfiles = 0;
+        pthread_mutex_unlock(&ra->mutex);
+
+        for (i = 0; buf != NULL && i < nfiles; i++)
+            warmFile(ra, files[i], gen, buf);
+        freeFiles(files, nfiles);
+
+        pthread_mutex_lock(&ra->mutex);
+        if (ra->requested == gen)
+        {
+            ssize_t res;
+
+            ra->completed = gen;
+            do
+            {
+                res = write(ra->pipefd[1], "", 1);
+            } while (res < 0 && errno == EINTR);
+        }
+    }
+    pthread_mutex_unlock(&ra->mutex);
+
+    free(buf);
+    return NULL;
+}
+
+/* Removes stale notifications, must be called with mutex held */
+static void
+drainPipe (HvaultReadahead ra)
+{
+    char buf[64];
+    while (read(ra->pipefd[0], buf, sizeof(buf)) > 0);
+}
+
+static void
+stopThread (HvaultReadahead ra)
+{
+    if (!ra->running)
+        return;
+
+    pthread_mutex_lock(&ra->mutex);
+    ra->stop = true;
+    ra->requested++;
+    freeFiles(ra->files, ra->nfiles);
+    ra->files = NULL;
+    pthread_cond_signal(&ra->cond);
+    pthread_mutex_unlock(&ra->mutex);
+
+    pthread_join(ra->thread, NULL);
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->mutex);
+    close(ra->pipefd[0]);
+    close(ra->pipefd[1]);
+    ra->running = false;
+}
+
+#if PG_VERSION_NUM >= 90500
+/* Stops thread when query is aborted */
+static void
+readaheadResetCallback (void * arg)
+{
+    stopThread((HvaultReadahead) arg);
+}
+#endif
+
+HvaultReadahead
+hvaultReadaheadInit (MemoryContext memctx)
+{
+    HvaultReadahead ra;
+    sigset_t sigs, oldsigs;
+    int res;
+
+    ra = MemoryContextAllocZero(memctx, sizeof(struct HvaultReadaheadData));
+    if (pipe(ra->pipefd) != 0)
+    {
+        elog(WARNING, "Can't create read-ahead pipe: %m");
+        pfree(ra);
+        return NULL;
+    }
+    fcntl(ra->pipefd[0], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&ra->mutex, NULL);
+    pthread_cond_init(&ra->cond, NULL);
+
+    /* Signals must be handled by backend thread only */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+    res = pthread_create(&ra->thread, NULL, readaheadThread, ra);
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+    if (res != 0)
+    {
+        elog(WARNING, "Can't start read-ahead thread: %s", strerror(res));
+        pthread_cond_destroy(&ra->cond);
+        pthread_mutex_destroy(&ra->mutex);
+        close(ra->pipefd[0]);
+        close(ra->pipefd[1]);
+        pfree(ra);
+        return NULL;
+    }
+    ra->running = true;
+
+#if PG_VERSION_NUM >= 90500
+    {
+        MemoryContextCallback * cb;
+
+        cb = MemoryContextAlloc(memctx, sizeof(MemoryContextCallback));
+        cb->func = readaheadResetCallback;
+        cb->arg = ra;
+        MemoryContextRegisterResetCallback(memctx, cb);
+    }
+#endif
+
+    return ra;
+}
+
+void
+hvaultReadaheadFree (HvaultReadahead ra)
+{
+    stopThread(ra);
+}
+
+void
+hvaultReadaheadStart (HvaultReadahead ra, List * filenames)
+{
+    char ** files;
+    int nfiles;
+    ListCell * l;
+
+    Assert(ra->running);
+
+    nfiles = 0;
+    files = malloc(sizeof(char *) * Max(list_length(filenames), 1));
+    if (files != NULL)
+    {
+        foreach(l, filenames)
+        {
+            char * filename = strdup(lfirst(l));
+            if (filename != NULL)
+                files[nfiles++] = filename;
+        }
+    }
+
+    pthread_mutex_lock(&ra->mutex);
+    freeFiles(ra->files, ra->nfiles);
+    drainPipe(ra);
+    ra->requested++;
+    if (files != NULL && nfiles > 0)
+    {
+        ra->files = files;
+        ra->nfiles = nfiles;
+        pthread_cond_signal(&ra->cond);
+    }
+    else
+    {
+        /* Nothing to read */
+        freeFiles(files, nfiles);
+        ra->files = NULL;
+        ra->completed = ra->requested;
+    }
+    pthread_mutex_unlock(&ra->mutex);
+}
+
+void
+hvaultReadaheadCancel (HvaultReadahead ra)
+{
+    Assert(ra->running);
+
+    pthread_mutex_lock(&ra->mutex);
+    freeFiles(ra->files, ra->nfiles);
+    ra->files = NULL;
+    drainPipe(ra);
+    ra->requested++;
+    ra->completed = ra->requested;
+    pthread_mutex_unlock(&ra->mutex);
+}
+
+bool
+hvaultReadaheadReady (HvaultReadahead ra)
+{
+    bool res;
+
+    Assert(ra->running);
+
+    pthread_mutex_lock(&ra->mutex);
+    res = ra->completed == ra->requested;
+    if (res)
+        drainPipe(ra);
+    pthread_mutex_unlock(&ra->mutex);
+    return res;
+}
+
+int
+hvaultReadaheadGetFd (HvaultReadahead ra)
+{
+    return ra->pipefd[0];
+}
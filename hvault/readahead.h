@@ -0,0 +1,37 @@
+#ifndef _READAHEAD_H_
+#define _READAHEAD_H_
+
+#include "common.h"
+
+/*
+ * Read-ahead helper loads granule files into OS page cache in a background
+ * thread, so that following HDF reads do not block on disk. The thread
+ * performs only plain file I/O: HDF and postgres routines are not thread
+ * safe and are called from the backend only.
+ */
+typedef struct HvaultReadaheadData * HvaultReadahead;
+
+/* 
+ * Starts read-ahead thread. Returns NULL if thread can't be started.
+ * Thread is stopped when memctx is reset, so that aborted query doesn't leave
+ * it running. Callers must not use read-ahead on versions before 9.5, where
+ * memory context callbacks are not available.
+ */
+HvaultReadahead hvaultReadaheadInit (MemoryContext memctx);
+
+/* Stops thread and frees its resources */
+void hvaultReadaheadFree (HvaultReadahead ra);
+
+/* Starts reading of file list. Previous request is cancelled */
+void hvaultReadaheadStart (HvaultReadahead ra, List * filenames);
+
+/* Cancels current request */
+void hvaultReadaheadCancel (HvaultReadahead ra);
+
+/* Returns true if current request is complete */
+bool hvaultReadaheadReady (HvaultReadahead ra);
+
+/* Returns descriptor that becomes readable when current request completes */
+int hvaultReadaheadGetFd (HvaultReadahead ra);
+
+#endif /* _READAHEAD_H_ */
@@ -0,0 +1,107 @@
+#include "shmem.h"
+#include "geocache.h"
+#include "iosched.h"
+#include "localcache.h"
+#include "syncscan.h"
+
+#define HVAULT_TRANCHE_NAME "hvault"
+
+typedef struct
+{
+    HvaultLock locks[HvaultNumLocks];
+} HvaultShmemHeader;
+
+static HvaultShmemHeader * shmemHeader = NULL;
+static shmem_startup_hook_type prevStartupHook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prevRequestHook = NULL;
+#endif
+
+static Size
+shmemSize (void)
+{
+    Size size = MAXALIGN(sizeof(HvaultShmemHeader));
+
+    size = add_size(size, hvaultSyncScanShmemSize());
+    size = add_size(size, hvaultIOSchedShmemSize());
+    size = add_size(size, hvaultLocalCacheShmemSize());
+    size = add_size(size, hvaultGeoCacheShmemSize());
+    return size;
+}
+
+static void
+requestShmem (void)
+{
+#if PG_VERSION_NUM >= 150000
+    if (prevRequestHook != NULL)
+        prevRequestHook();
+#endif
+
+    RequestAddinShmemSpace(shmemSize());
+#if PG_VERSION_NUM >= 90600
+    RequestNamedLWLockTranche(HVAULT_TRANCHE_NAME, HvaultNumLocks);
+#else
+    RequestAddinLWLocks(HvaultNumLocks);
+#endif
+}
+
+static void
+startupShmem (void)
+{
+    bool found;
+    int i;
+
+    if (prevStartupHook != NULL)
+        prevStartupHook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+    shmemHeader = ShmemInitStruct("hvault", sizeof(HvaultShmemHeader),
+                                  &found);
+    if (!found)
+    {
+        for (i = 0; i < HvaultNumLocks; i++)
+        {
+#if PG_VERSION_NUM >= 90600
+            shmemHeader->locks[i] =
+                &(GetNamedLWLockTranche(HVAULT_TRANCHE_NAME) + i)->lock;
+#else
+            shmemHeader->locks[i] = LWLockAssign();
+#endif
+        }
+    }
+    hvaultSyncScanShmemInit(found);
+    hvaultIOSchedShmemInit(found);
+    hvaultLocalCacheShmemInit(found);
+    hvaultGeoCacheShmemInit();
+    LWLockRelease(AddinShmemInitLock);
+}
+
+void
+hvaultShmemRequest (void)
+{
+    if (!process_shared_preload_libraries_in_progress)
+        return;
+
+#if PG_VERSION_NUM >= 150000
+    prevRequestHook = shmem_request_hook;
+    shmem_request_hook = requestShmem;
+#else
+    requestShmem();
+#endif
+    prevStartupHook = shmem_startup_hook;
+    shmem_startup_hook = startupShmem;
+}
+
+bool
+hvaultShmemReady (void)
+{
+    return shmemHeader != NULL;
+}
+
+HvaultLock
+hvaultShmemLock (HvaultLockId id)
+{
+    Assert(shmemHeader != NULL);
+    Assert(id >= 0 && id < HvaultNumLocks);
+    return shmemHeader->locks[id];
+}
@@ -0,0 +1,40 @@
+#ifndef _SHMEM_H_
+#define _SHMEM_H_
+
+#include "common.h"
+
+#include <storage/ipc.h>
+#include <storage/lwlock.h>
+#include <storage/shmem.h>
+
+/*
+ * Shared memory of hvault backends. It is available only if hvault is
+ * listed in shared_preload_libraries, features that need it are disabled
+ * otherwise.
+ */
+
+#if PG_VERSION_NUM >= 90400
+typedef LWLock * HvaultLock;
+#else
+typedef LWLockId HvaultLock;
+#endif
+
+typedef enum
+{
+    HvaultSyncScanLock = 0,
+    HvaultIOSchedLock,
+    HvaultLocalCacheLock,
+    HvaultGeoCacheLock,
+    HvaultNumLocks
+} HvaultLockId;
+
+/* Requests shared memory and locks, must be called from _PG_init */
+void hvaultShmemRequest (void);
+
+/* Returns true if shared memory is initialized */
+bool hvaultShmemReady (void);
+
+/* Returns lock from hvault tranche */
+HvaultLock hvaultShmemLock (HvaultLockId id);
+
+#endif /* _SHMEM_H_ */
@@ -0,0 +1,99 @@
+#include "syncscan.h"
+#include "shmem.h"
+
+/* Number of concurrent queries tracked by registry */
+#define SYNC_SCAN_NELEM 64
+
+typedef struct
+{
+    uint32 key;             /* Hash of catalog query and its parameters */
+    uint32 location;        /* Record being read by the last reporter */
+    uint64 stamp;           /* Time of last report, 0 if entry is free */
+} SyncScanEntry;
+
+typedef struct
+{
+    uint64 clock;
+    SyncScanEntry entries[SYNC_SCAN_NELEM];
+} SyncScanRegistry;
+
+static SyncScanRegistry * registry = NULL;
+
+Size
+hvaultSyncScanShmemSize (void)
+{
+    return MAXALIGN(sizeof(SyncScanRegistry));
+}
+
+void
+hvaultSyncScanShmemInit (bool found)
+{
+    registry = ShmemInitStruct("hvault sync scans",
+                               sizeof(SyncScanRegistry), &found);
+    if (!found)
+        memset(registry, 0, sizeof(SyncScanRegistry));
+}
+
+static SyncScanEntry *
+findEntry (uint32 key)
+{
+    int i;
+
+    for (i = 0; i < SYNC_SCAN_NELEM; i++)
+    {
+        if (registry->entries[i].stamp != 0 &&
+            registry->entries[i].key == key)
+            return registry->entries + i;
+    }
+    return NULL;
+}
+
+uint32
+hvaultSyncScanGetLocation (uint32 key)
+{
+    SyncScanEntry * entry;
+    uint32 location = 0;
+
+    if (registry == NULL)
+        return 0;
+
+    LWLockAcquire(hvaultShmemLock(HvaultSyncScanLock), LW_SHARED);
+    entry = findEntry(key);
+    if (entry != NULL)
+        location = entry->location;
+    LWLockRelease(hvaultShmemLock(HvaultSyncScanLock));
+
+    return location;
+}
+
+void
+hvaultSyncScanReport (uint32 key, uint32 location)
+{
+    SyncScanEntry * entry;
+    int i;
+
+    if (registry == NULL)
+        return;
+
+    /* Location is a hint, so skip report if registry is busy */
+    if (!LWLockConditionalAcquire(hvaultShmemLock(HvaultSyncScanLock),
+                                  LW_EXCLUSIVE))
+        return;
+
+    entry = findEntry(key);
+    if (entry == NULL)
+    {
+        /* Replace least recently reported entry */
+        entry = registry->entries;
+        for (i = 1; i < SYNC_SCAN_NELEM; i++)
+        {
+            if (registry->entries[i].stamp < entry->stamp)
+                entry = registry->entries + i;
+        }
+        entry->key = key;
+    }
+    entry->location = location;
+    entry->stamp = ++registry->clock;
+
+    LWLockRelease(hvaultShmemLock(HvaultSyncScanLock));
+}
@@ -0,0 +1,25 @@
+#ifndef _SYNCSCAN_H_
+#define _SYNCSCAN_H_
+
+#include "common.h"
+
+/*
+ * Synchronized scans. Concurrent scans running the same catalog query
+ * report the catalog record they are reading, so that a new scan starts
+ * from it and wraps around at the end. Granule files are then read once
+ * for all of them while they are still in page cache.
+ */
+
+/* Shared memory needed by scan registry */
+Size hvaultSyncScanShmemSize (void);
+
+/* Initializes scan registry, called from shmem startup hook */
+void hvaultSyncScanShmemInit (bool found);
+
+/* Returns number of record that scan of the query should start from */
+uint32 hvaultSyncScanGetLocation (uint32 key);
+
+/* Reports number of record being read by scan of the query */
+void hvaultSyncScanReport (uint32 key, uint32 location);
+
+#endif /* _SYNCSCAN_H_ */
@@ -0,0 +1,24 @@
+-- Chunks and scans outside of the region of predicates are skipped by 
+-- their bounding boxes without changing the result of the scan
+SELECT ST_AsText(ST_Expand(c, 0.5)) AS region,
+       ST_AsText(ST_MakeEnvelope(ST_X(c) - 5, ST_Y(c) - 0.05, 
+                                 ST_X(c) + 5, ST_Y(c) + 0.05)) AS strip
+    FROM (SELECT ST_Centroid(footprint) AS c 
+          FROM catalog ORDER BY id LIMIT 1) s \gset
+CREATE TEMP TABLE region_skipped AS
+    SELECT file_id, index FROM modis_test_bbox
+    WHERE point && ST_GeomFromText(:'region');
+CREATE TEMP TABLE region_full AS
+    SELECT file_id, index FROM (SELECT * FROM modis_test OFFSET 0) t
+    WHERE point && ST_GeomFromText(:'region');
+SELECT count(*) > 0 AS ok FROM region_skipped;
+SELECT test_same_rows('region_skipped', 'region_full') AS ok;
+-- Narrow strip crosses few scans
+CREATE TEMP TABLE strip_skipped AS
+    SELECT file_id, index FROM modis_test_bbox
+    WHERE footprint && ST_GeomFromText(:'strip');
+CREATE TEMP TABLE strip_full AS
+    SELECT file_id, index FROM (SELECT * FROM modis_test OFFSET 0) t
+    WHERE footprint && ST_GeomFromText(:'strip');
+SELECT count(*) > 0 AS ok FROM strip_skipped;
+SELECT test_same_rows('strip_skipped', 'strip_full') AS ok;
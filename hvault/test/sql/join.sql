@@ -0,0 +1,20 @@
+-- Join of two tables over the same granules is done by a single scan and 
+-- gives the same rows as a join of separate scans
+SELECT ST_AsText(ST_Expand(ST_Centroid(footprint), 0.5)) AS region
+    FROM catalog ORDER BY id LIMIT 1 \gset
+CREATE TEMP TABLE join_pushed AS
+    SELECT a.file_id, a.index, a.height, b.sensor_zenith
+    FROM modis_test a 
+    JOIN modis_test_angles b ON a.file_id = b.file_id AND a.index = b.index
+    WHERE a.footprint && ST_GeomFromText(:'region') AND
+          b.sensor_zenith IS NOT NULL;
+CREATE TEMP TABLE join_separate AS
+    SELECT a.file_id, a.index, a.height, b.sensor_zenith
+    FROM (SELECT * FROM modis_test 
+          WHERE footprint && ST_GeomFromText(:'region') OFFSET 0) a
+    JOIN (SELECT * FROM modis_test_angles 
+          WHERE footprint && ST_GeomFromText(:'region') OFFSET 0) b 
+    ON a.file_id = b.file_id AND a.index = b.index
+    WHERE b.sensor_zenith IS NOT NULL;
+SELECT count(*) > 0 AS ok FROM join_pushed;
+SELECT test_same_rows('join_pushed', 'join_separate') AS ok;
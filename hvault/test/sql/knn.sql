@@ -0,0 +1,25 @@
+-- Ordered kNN scan returns the nearest pixels in order of distance, the 
+-- same ones as sorting of all pixels above an optimization fence
+SELECT ST_AsText(ST_Centroid(footprint)) AS center 
+    FROM catalog ORDER BY id LIMIT 1 \gset
+CREATE TEMP TABLE knn AS
+    SELECT array_agg(dist) AS dists FROM (
+        SELECT point <-> ST_GeomFromText(:'center') AS dist
+        FROM modis_test
+        ORDER BY point <-> ST_GeomFromText(:'center')
+        LIMIT 25) s;
+CREATE TEMP TABLE sorted AS
+    SELECT array_agg(dist) AS dists FROM (
+        SELECT point <-> ST_GeomFromText(:'center') AS dist
+        FROM (SELECT * FROM modis_test OFFSET 0) t
+        ORDER BY point <-> ST_GeomFromText(:'center')
+        LIMIT 25) s;
+SELECT array_length(dists, 1) = 25 AS ok FROM knn;
+SELECT dists = ARRAY(SELECT unnest(dists) ORDER BY 1) AS ok FROM knn;
+-- Pixels at equal distance may come in different order
+SELECT knn.dists = sorted.dists AS ok FROM knn, sorted;
+-- Scan stops at LIMIT of a single row too
+SELECT count(*) = 1 AS ok FROM (
+    SELECT index FROM modis_test
+    ORDER BY point <-> ST_GeomFromText(:'center')
+    LIMIT 1) s;
@@ -0,0 +1,43 @@
+-- Geometry predicates evaluated by the scan over chunks and tiles select 
+-- the same pixels as PostGIS operators checked on every pixel above an 
+-- optimization fence
+SELECT ST_AsText(ST_Centroid(footprint)) AS center,
+       ST_AsText(ST_Expand(ST_Centroid(footprint), 0.5)) AS region
+    FROM catalog ORDER BY id LIMIT 1 \gset
+CREATE TEMP TABLE overlaps_scan AS
+    SELECT file_id, index FROM modis_test
+    WHERE point && ST_GeomFromText(:'region');
+CREATE TEMP TABLE overlaps_pixel AS
+    SELECT file_id, index FROM (SELECT * FROM modis_test OFFSET 0) t
+    WHERE point && ST_GeomFromText(:'region');
+SELECT count(*) > 0 AS ok FROM overlaps_scan;
+SELECT test_same_rows('overlaps_scan', 'overlaps_pixel') AS ok;
+CREATE TEMP TABLE within_scan AS
+    SELECT file_id, index FROM modis_test
+    WHERE footprint @ ST_GeomFromText(:'region');
+CREATE TEMP TABLE within_pixel AS
+    SELECT file_id, index FROM (SELECT * FROM modis_test OFFSET 0) t
+    WHERE footprint @ ST_GeomFromText(:'region');
+SELECT count(*) > 0 AS ok FROM within_scan;
+SELECT test_same_rows('within_scan', 'within_pixel') AS ok;
+CREATE TEMP TABLE contains_scan AS
+    SELECT file_id, index FROM modis_test
+    WHERE footprint ~ ST_GeomFromText(:'center');
+CREATE TEMP TABLE contains_pixel AS
+    SELECT file_id, index FROM (SELECT * FROM modis_test OFFSET 0) t
+    WHERE footprint ~ ST_GeomFromText(:'center');
+SELECT count(*) > 0 AS ok FROM contains_scan;
+SELECT test_same_rows('contains_scan', 'contains_pixel') AS ok;
+-- Several predicates are evaluated together
+CREATE TEMP TABLE fused_scan AS
+    SELECT file_id, index FROM modis_test
+    WHERE footprint && ST_GeomFromText(:'region') AND
+          NOT point @ ST_Expand(ST_GeomFromText(:'center'), 0.2) AND
+          ST_GeomFromText(:'region') ~ point;
+CREATE TEMP TABLE fused_pixel AS
+    SELECT file_id, index FROM (SELECT * FROM modis_test OFFSET 0) t
+    WHERE footprint && ST_GeomFromText(:'region') AND
+          NOT point @ ST_Expand(ST_GeomFromText(:'center'), 0.2) AND
+          ST_GeomFromText(:'region') ~ point;
+SELECT count(*) > 0 AS ok FROM fused_scan;
+SELECT test_same_rows('fused_scan', 'fused_pixel') AS ok;
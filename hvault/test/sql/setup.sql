@@ -0,0 +1,64 @@
+-- Regression tests run in an existing database (hvault_test by default) 
+-- whose table catalog describes a few MODIS granules. Load it from MOD03 
+-- files with catalog/catalog_load2.py, setting scan_bbox_products to 
+-- { 'mod03': 10 } so that bounding boxes of scans are stored too.
+SET client_min_messages = warning;
+CREATE EXTENSION IF NOT EXISTS postgis;
+CREATE EXTENSION IF NOT EXISTS hvault;
+DROP FOREIGN TABLE IF EXISTS modis_test, modis_test_angles, 
+                             modis_test_bbox, modis_test_queue;
+DROP TABLE IF EXISTS test_queue;
+CREATE FOREIGN TABLE modis_test (
+    file_id   int4      OPTIONS (type 'catalog', cat_name 'id'),
+    index     int4      OPTIONS (type 'index'),
+    line_id   int4      OPTIONS (type 'line_index'),
+    sample_id int4      OPTIONS (type 'sample_index'),
+    point     geometry  OPTIONS (type 'point', cat_name 'mod03'),
+    footprint geometry  OPTIONS (type 'footprint', cat_name 'mod03'),
+    height    float8    OPTIONS (cat_name 'mod03', dataset 'Height')
+) SERVER hvault_service
+  OPTIONS (catalog 'catalog',
+           driver 'modis_swath',
+           shift_longitude 'true');
+-- Same options as modis_test, so joins of the two are pushed down
+CREATE FOREIGN TABLE modis_test_angles (
+    file_id       int4      OPTIONS (type 'catalog', cat_name 'id'),
+    index         int4      OPTIONS (type 'index'),
+    footprint     geometry  OPTIONS (type 'footprint', cat_name 'mod03'),
+    sensor_zenith float8    OPTIONS (cat_name 'mod03', dataset 'SensorZenith')
+) SERVER hvault_service
+  OPTIONS (catalog 'catalog',
+           driver 'modis_swath',
+           shift_longitude 'true');
+CREATE FOREIGN TABLE modis_test_bbox (
+    file_id   int4      OPTIONS (type 'catalog', cat_name 'id'),
+    index     int4      OPTIONS (type 'index'),
+    point     geometry  OPTIONS (type 'point', cat_name 'mod03'),
+    footprint geometry  OPTIONS (type 'footprint', cat_name 'mod03')
+) SERVER hvault_service
+  OPTIONS (catalog 'catalog',
+           driver 'modis_swath',
+           shift_longitude 'true',
+           scan_bbox 'scan_bbox');
+CREATE TABLE test_queue (id int4);
+CREATE FOREIGN TABLE modis_test_queue (
+    file_id   int4      OPTIONS (type 'catalog', cat_name 'id'),
+    index     int4      OPTIONS (type 'index')
+) SERVER hvault_service
+  OPTIONS (catalog 'catalog',
+           driver 'modis_swath',
+           shift_longitude 'true',
+           work_queue 'test_queue');
+-- Compares two tables as multisets of rows
+CREATE OR REPLACE FUNCTION test_same_rows(a text, b text) RETURNS bool AS $$
+DECLARE
+    res bool;
+BEGIN
+    EXECUTE format('SELECT NOT EXISTS ((TABLE %I EXCEPT ALL TABLE %I) '
+                   'UNION ALL (TABLE %I EXCEPT ALL TABLE %I))', 
+                   a, b, b, a) INTO res;
+    RETURN res;
+END
+$$ LANGUAGE plpgsql;
+-- Catalog must not be empty for the tests to mean anything
+SELECT count(*) > 0 AS ok FROM catalog;
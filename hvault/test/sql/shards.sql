@@ -0,0 +1,24 @@
+-- Shards and work queue together cover every granule exactly once
+CREATE TEMP TABLE all_rows AS
+    SELECT file_id, count(*) AS n FROM modis_test GROUP BY file_id;
+SET hvault.shard_count = 3;
+SET hvault.shard_index = 0;
+CREATE TEMP TABLE shard_rows AS
+    SELECT file_id, count(*) AS n FROM modis_test GROUP BY file_id;
+SET hvault.shard_index = 1;
+INSERT INTO shard_rows
+    SELECT file_id, count(*) AS n FROM modis_test GROUP BY file_id;
+SET hvault.shard_index = 2;
+INSERT INTO shard_rows
+    SELECT file_id, count(*) AS n FROM modis_test GROUP BY file_id;
+RESET hvault.shard_index;
+RESET hvault.shard_count;
+SELECT count(*) > 0 AS ok FROM all_rows;
+SELECT test_same_rows('shard_rows', 'all_rows') AS ok;
+-- Granules are taken from the queue and are not scanned again
+INSERT INTO test_queue SELECT id FROM catalog;
+CREATE TEMP TABLE queue_rows AS
+    SELECT file_id, count(*) AS n FROM modis_test_queue GROUP BY file_id;
+SELECT test_same_rows('queue_rows', 'all_rows') AS ok;
+SELECT count(*) = 0 AS ok FROM test_queue;
+SELECT count(*) = 0 AS ok FROM modis_test_queue;
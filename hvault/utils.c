@@ -1,5 +1,8 @@
 #include "utils.h"
+/* int8in is declared in fmgrprotos.h since 15 */
+#if PG_VERSION_NUM < 150000
 #include <utils/int8.h>
+#endif
 
 int 
 list_append_unique_pos (List ** list, void * item)
@@ -105,3 +108,17 @@ defGetDouble (DefElem * def)
     }
     return 0;                   /* keep compiler quiet */
 }
+
+/* Computes 64-bit FNV-1a hash of string */
+uint64
+hvaultHashString (char const * str)
+{
+    uint64 hash = UINT64CONST(14695981039346656037);
+
+    for (; *str; str++)
+    {
+        hash ^= (unsigned char) *str;
+        hash *= UINT64CONST(1099511628211);
+    }
+    return hash;
+}
@@ -35,4 +35,7 @@ int64_t defGetInt (DefElem * def);
 /* Extracts double from DefElem converting from string if necessary */
 double defGetDouble (DefElem * def);
 
+/* Computes 64-bit FNV-1a hash of string */
+uint64 hvaultHashString (char const * str);
+
 #endif /* _UTILS_H_ */
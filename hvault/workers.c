@@ -0,0 +1,192 @@
+/* pthread_sigmask is hidden by -D_POSIX_C_SOURCE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "workers.h"
+
+#define WORKERS_MAX_THREADS 64
+#define WORKERS_QUEUE_SIZE 16
+
+struct HvaultWorkersData
+{
+    pthread_t threads[WORKERS_MAX_THREADS];
+    int nthreads;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        /* Signalled when task is queued */
+    pthread_cond_t done;        /* Signalled when all tasks are complete */
+    bool running;
+
+    /* Protected by mutex */
+    HvaultWorkerTask tasks[WORKERS_QUEUE_SIZE];
+    void * args[WORKERS_QUEUE_SIZE];
+    int head, queued;
+    int pending;                /* Queued and running tasks */
+    bool stop;
+};
+
+static void *
+workerThread (void * arg)
+{
+    HvaultWorkers workers = arg;
+
+    pthread_mutex_lock(&workers->mutex);
+    while (!workers->stop)
+    {
+        HvaultWorkerTask task;
+        void * task_arg;
+
+        if (workers->queued == 0)
+        {
+            pthread_cond_wait(&workers->cond, &workers->mutex);
+            continue;
+        }
+
+        task = workers->tasks[workers->head];
+        task_arg = workers->args[workers->head];
+        workers->head = (workers->head + 1) % WORKERS_QUEUE_SIZE;
+        workers->queued--;
+        pthread_mutex_unlock(&workers->mutex);
+
+        task(task_arg);
+
+        pthread_mutex_lock(&workers->mutex);
+        workers->pending--;
+        if (workers->pending == 0)
+            pthread_cond_broadcast(&workers->done);
+    }
+    pthread_mutex_unlock(&workers->mutex);
+
+    return NULL;
+}
+
+static void
+stopThreads (HvaultWorkers workers)
+{
+    int i;
+
+    if (!workers->running)
+        return;
+
+    pthread_mutex_lock(&workers->mutex);
+    workers->stop = true;
+    pthread_cond_broadcast(&workers->cond);
+    pthread_mutex_unlock(&workers->mutex);
+
+    for (i = 0; i < workers->nthreads; i++)
+        pthread_join(workers->threads[i], NULL);
+    pthread_cond_destroy(&workers->done);
+    pthread_cond_destroy(&workers->cond);
+    pthread_mutex_destroy(&workers->mutex);
+    workers->running = false;
+}
+
+#if PG_VERSION_NUM >= 90500
+/* Stops threads before memory used by tasks is freed */
+static void
+workersResetCallback (void * arg)
+{
+    stopThreads((HvaultWorkers) arg);
+}
+#endif
+
+HvaultWorkers
+hvaultWorkersInit (int nthreads, MemoryContext memctx)
+{
+    HvaultWorkers workers;
+    sigset_t sigs, oldsigs;
+    int res = 0;
+
+    workers = MemoryContextAllocZero(memctx, sizeof(struct HvaultWorkersData));
+    pthread_mutex_init(&workers->mutex, NULL);
+    pthread_cond_init(&workers->cond, NULL);
+    pthread_cond_init(&workers->done, NULL);
+
+    /* Signals must be handled by backend thread only */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+    nthreads = Min(nthreads, WORKERS_MAX_THREADS);
+    while (workers->nthreads < nthreads)
+    {
+        res = pthread_create(&workers->threads[workers->nthreads], NULL,
+                             workerThread, workers);
+        if (res != 0)
+            break;
+        workers->nthreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+    if (workers->nthreads == 0)
+    {
+        elog(WARNING, "Can't start worker threads: %s", strerror(res));
+        pthread_cond_destroy(&workers->done);
+        pthread_cond_destroy(&workers->cond);
+        pthread_mutex_destroy(&workers->mutex);
+        pfree(workers);
+        return NULL;
+    }
+    if (res != 0)
+    {
+        elog(DEBUG1, "Started only %d of %d worker threads: %s",
+             workers->nthreads, nthreads, strerror(res));
+    }
+    workers->running = true;
+
+#if PG_VERSION_NUM >= 90500
+    {
+        MemoryContextCallback * cb;
+
+        cb = MemoryContextAlloc(memctx, sizeof(MemoryContextCallback));
+        cb->func = workersResetCallback;
+        cb->arg = workers;
+        MemoryContextRegisterResetCallback(memctx, cb);
+    }
+#endif
+
+    return workers;
+}
+
+void
+hvaultWorkersFree (HvaultWorkers workers)
+{
+    stopThreads(workers);
+}
+
+void
+hvaultWorkersSubmit (HvaultWorkers    workers,
+                     HvaultWorkerTask task,
+                     void           * arg)
+{
+    Assert(workers->running);
+
+    pthread_mutex_lock(&workers->mutex);
+    if (workers->queued == WORKERS_QUEUE_SIZE)
+    {
+        pthread_mutex_unlock(&workers->mutex);
+        task(arg);
+        return;
+    }
+    workers->tasks[(workers->head + workers->queued) % WORKERS_QUEUE_SIZE] =
+        task;
+    workers->args[(workers->head + workers->queued) % WORKERS_QUEUE_SIZE] =
+        arg;
+    workers->queued++;
+    workers->pending++;
+    pthread_cond_signal(&workers->cond);
+    pthread_mutex_unlock(&workers->mutex);
+}
+
+void
+hvaultWorkersWait (HvaultWorkers workers)
+{
+    if (!workers->running)
+        return;
+
+    pthread_mutex_lock(&workers->mutex);
+    while (workers->pending > 0)
+        pthread_cond_wait(&workers->done, &workers->mutex);
+    pthread_mutex_unlock(&workers->mutex);
+}
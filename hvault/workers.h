@@ -0,0 +1,30 @@
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+#include "common.h"
+
+/*
+ * Pool of threads that run CPU bound stages of chunk processing in
+ * background. Tasks must not call postgres, HDF or liblwgeom routines, they
+ * are not thread safe. Memory used by tasks must stay valid until
+ * hvaultWorkersWait returns.
+ */
+typedef struct HvaultWorkersData * HvaultWorkers;
+
+typedef void (* HvaultWorkerTask) (void * arg);
+
+/* Starts worker threads. Returns NULL if no thread can be started */
+HvaultWorkers hvaultWorkersInit (int nthreads, MemoryContext memctx);
+
+/* Stops threads and frees their resources */
+void hvaultWorkersFree (HvaultWorkers workers);
+
+/* Queues task. Task is run immediately if queue is full */
+void hvaultWorkersSubmit (HvaultWorkers    workers,
+                          HvaultWorkerTask task,
+                          void           * arg);
+
+/* Waits until all submitted tasks are complete */
+void hvaultWorkersWait (HvaultWorkers workers);
+
+#endif /* _WORKERS_H_ */